@@ -46,7 +46,7 @@
 #define LLPC_INTERFACE_MAJOR_VERSION 40
 
 /// LLPC minor interface version.
-#define LLPC_INTERFACE_MINOR_VERSION 3
+#define LLPC_INTERFACE_MINOR_VERSION 5
 
 #ifndef LLPC_CLIENT_INTERFACE_MAJOR_VERSION
 #if VFX_INSIDE_SPVGEN
@@ -74,6 +74,8 @@
 //* %Version History
 //* | %Version | Change Description                                                                                    |
 //* | -------- | ----------------------------------------------------------------------------------------------------- |
+//* |     40.5 | Added enableScalarLoadMerge to PipelineOptions                                                        |
+//* |     40.4 | Added ICompiler::SetCompileTelemetryCallback and CompileTelemetry (with skippedBitcodeFunctionCount)  |
 //* |     40.3 | Added ICache interface                                                                                |
 //* |     40.2 | Added extendedRobustness in PipelineOptions to support VK_EXT_robustness2                             |
 //* |     40.1 | Added disableLoopUnroll to PipelineShaderOptions                                                      |
@@ -290,6 +292,8 @@ struct PipelineOptions {
   unsigned shadowDescriptorTablePtrHigh;                 ///< Sets high part of VA ptr for shadow descriptor table.
   ExtendedRobustness extendedRobustness;                 ///< ExtendedRobustness is intended to correspond to the
                                                          ///  features of VK_EXT_robustness2.
+  bool enableScalarLoadMerge;                            ///< If set, adjacent uniform constant buffer loads are
+                                                         ///  merged into wider scalar loads.
 };
 
 /// Prototype of allocator for output data buffer, used in shader-specific operations.
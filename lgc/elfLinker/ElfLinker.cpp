@@ -32,9 +32,11 @@
 #include "GlueShader.h"
 #include "RelocHandler.h"
 #include "lgc/state/AbiMetadata.h"
+#include "lgc/state/LinkableShader.h"
 #include "lgc/state/PalMetadata.h"
 #include "lgc/state/PipelineState.h"
 #include "lgc/state/TargetInfo.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/BinaryFormat/ELF.h"
 #include "llvm/Object/ELFObjectFile.h"
@@ -51,9 +53,9 @@ namespace {
 class ElfLinkerImpl;
 
 // =====================================================================================================================
-// An ELF input to the linker
+// An ELF input to the linker. The parsed ELF is shared with other links of the same ELF; the rest is per link.
 struct ElfInput {
-  std::unique_ptr<object::ObjectFile> objectFile;
+  std::shared_ptr<const LinkableShader> shader;
   SmallVector<std::pair<unsigned, unsigned>, 4> sectionMap;
   StringRef reduceAlign; // If non-empty, the name of a text section to reduce the alignment to 0x40
 };
@@ -61,10 +63,10 @@ struct ElfInput {
 // =====================================================================================================================
 // A single input section
 struct InputSection {
-  InputSection(object::SectionRef sectionRef) : sectionRef(sectionRef), size(sectionRef.getSize()) {}
-  object::SectionRef sectionRef; // Section from the input ELF
-  size_t offset = 0;             // Offset within the output ELF section
-  uint64_t size;                 // Size, possibly after removing s_end_code padding
+  InputSection(const LinkableSection &section) : section(&section), size(section.size) {}
+  const LinkableSection *section; // Section from the input ELF
+  size_t offset = 0;              // Offset within the output ELF section
+  uint64_t size;                  // Size, after removing s_end_code padding
 };
 
 // =====================================================================================================================
@@ -76,7 +78,7 @@ public:
       : m_linker(linker), m_name(name), m_type(type) {}
 
   // Add an input section
-  void addInputSection(ElfInput &elfInput, object::SectionRef inputSection, bool reduceAlign = false);
+  void addInputSection(ElfInput &elfInput, const LinkableSection &inputSection, bool reduceAlign = false);
 
   // Get name of output section
   StringRef getName();
@@ -88,7 +90,7 @@ public:
   void layout();
 
   // Add a symbol to the output symbol table
-  void addSymbol(const object::ELFSymbolRef &elfSymRef, unsigned inputSectIdx);
+  void addSymbol(const LinkableSymbol &symbol, unsigned inputSectIdx);
 
   // Get the output file offset of a particular input section in the output section
   uint64_t getOutputOffset(unsigned inputIdx) { return m_offset + m_inputSections[inputIdx].offset; }
@@ -127,7 +129,7 @@ private:
 class ElfLinkerImpl final : public ElfLinker {
 public:
   // Constructor given PipelineState and ELFs to link
-  ElfLinkerImpl(PipelineState *pipelineState, ArrayRef<MemoryBufferRef> elfs);
+  ElfLinkerImpl(PipelineState *pipelineState, ArrayRef<MemoryBufferRef> elfs, bool stageElfs);
 
   // Destructor
   ~ElfLinkerImpl() override final;
@@ -163,15 +165,21 @@ public:
   // Find symbol in output ELF
   unsigned findSymbol(unsigned nameIndex);
 
+  // Add symbol to output ELF
+  void addOutputSymbol(const ELF::Elf64_Sym &sym);
+
 private:
   // Get the value of the symbol referenced in a reloc
-  uint64_t getRelocValue(object::RelocationRef reloc);
+  uint64_t getRelocValue(const LinkableSymbol &symbol);
+
+  // Get the output file offset of the symbol referenced in a reloc
+  uint64_t getRelocSymbolOffset(ElfInput &elfInput, const LinkableSymbol &symbol, unsigned outputSectIdx);
 
   // Find where an input section contributes to an output section
-  std::pair<unsigned, unsigned> findInputSection(ElfInput &elfInput, object::SectionRef section);
+  std::pair<unsigned, unsigned> findInputSection(ElfInput &elfInput, unsigned sectionIndex);
 
-  // Read PAL metadata from an ELF file and merge it in to the PAL metadata that we already have
-  void mergePalMetadataFromElf(object::ObjectFile &objectFile);
+  // Merge the PAL metadata from an ELF in to the PAL metadata that we already have
+  void mergePalMetadataFromElf(const LinkableShader &shader);
 
   // Write the PAL metadata out into the .note section.
   void writePalMetadata();
@@ -190,10 +198,11 @@ private:
   ELF::Elf64_Ehdr m_ehdr;                                    // Output ELF header, copied from first input
   SmallVector<OutputSection, 4> m_outputSections;            // Output sections
   SmallVector<ELF::Elf64_Sym, 8> m_symbols;                  // Symbol table
-  StringMap<unsigned> m_symbolMap;                           // Map from name to symbol index
+  DenseMap<unsigned, unsigned> m_symbolMap;                  // Map from name string index to symbol index
   std::string m_strings;                                     // Strings for string table
   StringMap<unsigned> m_stringMap;                           // Map from string to string table index
   std::string m_notes;                                       // Notes to go in .note section
+  bool m_stageElfs;                                          // Inputs are per-stage ELFs of a whole pipeline
 };
 
 } // anonymous namespace
@@ -201,42 +210,45 @@ private:
 namespace lgc {
 // =====================================================================================================================
 // Create ELF linker given PipelineState and ELFs to link
-ElfLinker *createElfLinkerImpl(PipelineState *pipelineState, ArrayRef<MemoryBufferRef> elfs) {
-  return new ElfLinkerImpl(pipelineState, elfs);
+//
+// @param pipelineState : PipelineState object
+// @param elfs : Array of ELF modules to link
+// @param stageElfs : True if the ELFs are the per-stage codegen output of a whole pipeline, rather than unlinked
+//                    shader or half-pipeline ELFs
+ElfLinker *createElfLinkerImpl(PipelineState *pipelineState, ArrayRef<MemoryBufferRef> elfs, bool stageElfs) {
+  return new ElfLinkerImpl(pipelineState, elfs, stageElfs);
 }
 
 } // namespace lgc
 
-namespace llvm {
-// =====================================================================================================================
-// Temporary cantFail override to cope with a forthcoming change of the return type of ELFSymbolRef::getValue
-// from uint64_t to Expected<uint64_t>.
-inline uint64_t cantFail(uint64_t value, const char *Msg = nullptr) {
-  return value;
-}
-} // namespace llvm
-
 // =====================================================================================================================
 // Constructor given PipelineState and ELFs to link
 //
 // @param pipelineState : PipelineState object
 // @param elfs : Array of unlinked ELF modules to link
-ElfLinkerImpl::ElfLinkerImpl(PipelineState *pipelineState, ArrayRef<MemoryBufferRef> elfs)
-    : m_pipelineState(pipelineState), m_relocHandler(pipelineState) {
-  // For each input ELF, create an ELF object for it.
-  for (auto elfBuffer : elfs)
-    m_elfInputs.push_back({cantFail(object::ObjectFile::createELFObjectFile(elfBuffer))});
+// @param stageElfs : True if the ELFs are the per-stage codegen output of a whole pipeline
+ElfLinkerImpl::ElfLinkerImpl(PipelineState *pipelineState, ArrayRef<MemoryBufferRef> elfs, bool stageElfs)
+    : m_pipelineState(pipelineState), m_relocHandler(pipelineState), m_stageElfs(stageElfs) {
+  // For each input ELF, get its parsed form, which an earlier link of the same ELF may already have created.
+  // Per-stage ELFs are never linked again, so they bypass the cache rather than evicting reusable shaders from it.
+  LinkableShaderCache *linkableShaderCache = pipelineState->getLgcContext()->getLinkableShaderCache();
+  for (auto elfBuffer : elfs) {
+    if (m_stageElfs)
+      m_elfInputs.push_back({LinkableShader::create(elfBuffer)});
+    else
+      m_elfInputs.push_back({linkableShaderCache->get(elfBuffer)});
+  }
 
   // Gather and merge PAL metadata.
   m_pipelineState->clearPalMetadata();
   for (auto &elfInput : m_elfInputs)
-    mergePalMetadataFromElf(*elfInput.objectFile);
+    mergePalMetadataFromElf(*elfInput.shader);
 
   // Create any needed glue shaders.
   createGlueShaders();
 
   // Populate output ELF header
-  memcpy(&m_ehdr, elfs[0].getBuffer().data(), sizeof(ELF::Elf64_Ehdr));
+  memcpy(&m_ehdr, &m_elfInputs[0].shader->getHeader(), sizeof(ELF::Elf64_Ehdr));
 }
 
 // =====================================================================================================================
@@ -289,7 +301,7 @@ ArrayRef<StringRef> ElfLinkerImpl::getGlueInfo() {
 // @param glueIndex : Index into the array that was returned by getGlueInfo()
 // @param blob : Blob for the glue code
 void ElfLinkerImpl::addGlue(unsigned glueIndex, StringRef blob) {
-  llvm_unreachable("Not implemented");
+  m_glueShaders[glueIndex]->setElfBlob(blob);
 }
 
 // =====================================================================================================================
@@ -344,19 +356,17 @@ bool ElfLinkerImpl::link(raw_pwrite_stream &outStream) {
 
   // Allocate input sections to output sections.
   for (auto &elfInput : m_elfInputs) {
-    for (const object::SectionRef &section : elfInput.objectFile->sections()) {
-      object::ELFSectionRef elfSection(section);
-      if (elfSection.getType() == ELF::SHT_PROGBITS &&
-          (elfSection.getFlags() & (ELF::SHF_ALLOC | ELF::SHF_WRITE)) == ELF::SHF_ALLOC) {
+    for (const LinkableSection &section : elfInput.shader->getSections()) {
+      if (section.type == ELF::SHT_PROGBITS && (section.flags & (ELF::SHF_ALLOC | ELF::SHF_WRITE)) == ELF::SHF_ALLOC) {
         // All text and rodata sections get lumped together, even if they have different names.
         // Reduce the alignment (for gluing code together) if the section name matches elfInput.reduceAlign.
         bool reduceAlign = false;
         if (elfInput.reduceAlign != "")
-          reduceAlign = cantFail(elfSection.getName()) == elfInput.reduceAlign;
+          reduceAlign = section.name == elfInput.reduceAlign;
         m_outputSections[textSectionIdx].addInputSection(elfInput, section, reduceAlign);
-      } else if (elfSection.getType() == ELF::SHT_PROGBITS) {
+      } else if (section.type == ELF::SHT_PROGBITS) {
         // Put same-named sections together (excluding symbol table, string table, reloc sections).
-        StringRef name = cantFail(section.getName());
+        StringRef name = section.name;
         for (unsigned idx = 1;; ++idx) {
           if (idx == m_outputSections.size()) {
             m_outputSections.push_back(OutputSection(this));
@@ -389,15 +399,11 @@ bool ElfLinkerImpl::link(raw_pwrite_stream &outStream) {
 
   // Find public symbols in the input ELFs, and add them to the output ELF.
   for (auto &elfInput : m_elfInputs) {
-    for (object::SymbolRef symRef : elfInput.objectFile->symbols()) {
-      object::ELFSymbolRef elfSymRef(symRef);
-      if (elfSymRef.getBinding() == ELF::STB_GLOBAL) {
-        object::section_iterator containingSect = cantFail(elfSymRef.getSection());
-        if (containingSect != elfInput.objectFile->section_end()) {
-          auto outputIndices = findInputSection(elfInput, *containingSect);
-          if (outputIndices.first != UINT_MAX)
-            m_outputSections[outputIndices.first].addSymbol(elfSymRef, outputIndices.second);
-        }
+    for (const LinkableSymbol &symbol : elfInput.shader->getSymbols()) {
+      if (symbol.binding == ELF::STB_GLOBAL && symbol.sectionIndex != 0) {
+        auto outputIndices = findInputSection(elfInput, symbol.sectionIndex);
+        if (outputIndices.first != UINT_MAX)
+          m_outputSections[outputIndices.first].addSymbol(symbol, outputIndices.second);
       }
     }
   }
@@ -418,39 +424,38 @@ bool ElfLinkerImpl::link(raw_pwrite_stream &outStream) {
     outputSection.write(outStream, &shdrs[sectionIndex]);
   }
 
-  // Apply the relocs
+  // Apply the relocs. Their offsets, addends and symbols were read from the input ELFs when those were parsed.
   for (auto &elfInput : m_elfInputs) {
-    for (const object::SectionRef section : elfInput.objectFile->sections()) {
-      unsigned sectType = object::ELFSectionRef(section).getType();
-      if (sectType == ELF::SHT_REL || sectType == ELF::SHT_RELA) {
-        for (object::RelocationRef reloc : section.relocations()) {
-          unsigned outputSectIdx = UINT_MAX;
-          unsigned withinSectIdx = UINT_MAX;
-          std::tie(outputSectIdx, withinSectIdx) = findInputSection(elfInput, *cantFail(section.getRelocatedSection()));
-          if (outputSectIdx != UINT_MAX) {
-            uint64_t inputOffset = reloc.getOffset();
-            uint64_t outputOffset = m_outputSections[outputSectIdx].getOutputOffset(withinSectIdx) + inputOffset;
-            uint64_t addend = 0;
-            if (sectType == ELF::SHT_RELA)
-              addend = cantFail(object::ELFRelocationRef(reloc).getAddend());
-            uint64_t value = getRelocValue(reloc);
-
-            switch (reloc.getType()) {
-
-            case ELF::R_AMDGPU_ABS32: {
-              StringRef contents = cantFail(cantFail(section.getRelocatedSection())->getContents());
-              assert(inputOffset + sizeof(uint32_t) <= contents.size() && "Out of range reloc offset");
-              if (sectType == ELF::SHT_REL)
-                addend = *reinterpret_cast<const uint32_t *>(contents.data() + inputOffset);
-              uint32_t inst = addend + value;
-              outStream.pwrite(reinterpret_cast<const char *>(&inst), sizeof(inst), outputOffset);
-              break;
-            }
-
-            default:
-              report_fatal_error("Reloc not supported");
-            }
-          }
+    for (const LinkableReloc &reloc : elfInput.shader->getRelocs()) {
+      unsigned outputSectIdx = UINT_MAX;
+      unsigned withinSectIdx = UINT_MAX;
+      std::tie(outputSectIdx, withinSectIdx) = findInputSection(elfInput, reloc.sectionIndex);
+      if (outputSectIdx != UINT_MAX) {
+        uint64_t outputOffset = m_outputSections[outputSectIdx].getOutputOffset(withinSectIdx) + reloc.offset;
+        const LinkableSymbol &symbol = elfInput.shader->getSymbols()[reloc.symbolIndex];
+
+        switch (reloc.type) {
+
+        case ELF::R_AMDGPU_ABS32: {
+          uint32_t inst = reloc.addend + getRelocValue(symbol);
+          outStream.pwrite(reinterpret_cast<const char *>(&inst), sizeof(inst), outputOffset);
+          break;
+        }
+
+        case ELF::R_AMDGPU_REL32_LO:
+        case ELF::R_AMDGPU_REL32_HI: {
+          // PC-relative reloc, for example to a constant pool in .rodata. That works out the same on file offsets
+          // as on addresses, as long as the symbol is in the same output section as the reloc.
+          uint64_t symbolOffset = getRelocSymbolOffset(elfInput, symbol, outputSectIdx);
+          uint64_t value = symbolOffset + reloc.addend - outputOffset;
+          uint32_t inst = reloc.type == ELF::R_AMDGPU_REL32_LO ? value : value >> 32;
+          outStream.pwrite(reinterpret_cast<const char *>(&inst), sizeof(inst), outputOffset);
+          break;
+        }
+
+        default:
+          m_pipelineState->setError("Reloc type " + Twine(reloc.type) + " not supported");
+          break;
         }
       }
     }
@@ -495,74 +500,86 @@ unsigned ElfLinkerImpl::getStringIndex(StringRef string) {
 // @param nameIndex : Index of symbol name in string table
 // @return : Index in symbol table, or 0 if not found
 unsigned ElfLinkerImpl::findSymbol(unsigned nameIndex) {
-  for (auto &sym : getSymbols()) {
-    if (sym.st_name == nameIndex)
-      return &sym - getSymbols().data();
-  }
-  return 0;
+  auto it = m_symbolMap.find(nameIndex);
+  return it == m_symbolMap.end() ? 0 : it->second;
+}
+
+// =====================================================================================================================
+// Add symbol to output ELF
+//
+// @param sym : Symbol to add, whose name must not already be in the symbol table
+void ElfLinkerImpl::addOutputSymbol(const ELF::Elf64_Sym &sym) {
+  if (sym.st_name != 0)
+    m_symbolMap[sym.st_name] = m_symbols.size();
+  m_symbols.push_back(sym);
 }
 
 // =====================================================================================================================
 // Get the value of the symbol referenced in a reloc
-uint64_t ElfLinkerImpl::getRelocValue(object::RelocationRef reloc) {
-  StringRef name = cantFail(reloc.getSymbol()->getName());
+//
+// @param symbol : The symbol referenced by the reloc
+uint64_t ElfLinkerImpl::getRelocValue(const LinkableSymbol &symbol) {
+  StringRef name = symbol.name;
 
   // Handle the special case relocs from pipeline state
   uint64_t value = 0;
   if (m_relocHandler.getValue(name, value))
     return value;
 
-  // TODO: Handle a reloc to a symbol, so we are then able to generate a shader ELF with its constant pools
-  // in a separate .rodata section that gets merged into .text in the linker.
-
   report_fatal_error("Unknown reloc: " + name);
 }
 
+// =====================================================================================================================
+// Get the output file offset of the symbol referenced in a reloc. This sets a recoverable error if the symbol is not
+// defined in the given output section.
+//
+// @param elfInput : ElfInput object for the ELF input containing the reloc
+// @param symbol : The symbol referenced by the reloc
+// @param outputSectIdx : Index of the output section that the symbol must be in
+uint64_t ElfLinkerImpl::getRelocSymbolOffset(ElfInput &elfInput, const LinkableSymbol &symbol,
+                                             unsigned outputSectIdx) {
+  if (symbol.sectionIndex != 0) {
+    auto outputIndices = findInputSection(elfInput, symbol.sectionIndex);
+    if (outputIndices.first == outputSectIdx)
+      return m_outputSections[outputSectIdx].getOutputOffset(outputIndices.second) + symbol.value;
+  }
+  m_pipelineState->setError("Reloc to symbol " + symbol.name + " not in the same section");
+  return 0;
+}
+
 // =====================================================================================================================
 // Find where an input section contributes to an output section
 //
 // @param elfInput : ElfInput object for the ELF input
-// @param section : Section from that input
+// @param sectionIndex : Index of section in that input
 // @return : {outputSectionIdx,withinIdx} pair, both elements UINT_MAX if no contribution to an output section
-std::pair<unsigned, unsigned> ElfLinkerImpl::findInputSection(ElfInput &elfInput, object::SectionRef section) {
-  unsigned idx = section.getIndex();
-  if (idx >= elfInput.sectionMap.size())
+std::pair<unsigned, unsigned> ElfLinkerImpl::findInputSection(ElfInput &elfInput, unsigned sectionIndex) {
+  if (sectionIndex >= elfInput.sectionMap.size())
     return {UINT_MAX, UINT_MAX};
-  return elfInput.sectionMap[idx];
+  return elfInput.sectionMap[sectionIndex];
 }
 
 // =====================================================================================================================
-// Read PAL metadata from an ELF file and merge it in to the PAL metadata that we already have
+// Merge the PAL metadata from an ELF in to the PAL metadata that we already have. The PAL metadata notes were found
+// when the ELF was parsed.
 //
-// @param objectFile : The ELF input
-void ElfLinkerImpl::mergePalMetadataFromElf(object::ObjectFile &objectFile) {
-  for (const object::SectionRef &section : objectFile.sections()) {
-    object::ELFSectionRef elfSection(section);
-    if (elfSection.getType() == ELF::SHT_NOTE) {
-      // This is a .note section. Find the PAL metadata note and merge it into the PalMetadata object
-      // in the PipelineState.
-      Error err = ErrorSuccess();
-      auto elfFile = cast<object::ELFObjectFile<object::ELF64LE>>(&objectFile)->getELFFile();
-      auto shdr = cantFail(elfFile->getSection(elfSection.getIndex()));
-      for (auto note : elfFile->notes(*shdr, err)) {
-        if (note.getName() == Util::Abi::AmdGpuArchName && note.getType() == ELF::NT_AMDGPU_METADATA) {
-          ArrayRef<uint8_t> desc = note.getDesc();
-          m_pipelineState->mergePalMetadataFromBlob(
-              StringRef(reinterpret_cast<const char *>(desc.data()), desc.size()));
-        }
-      }
-    }
-  }
+// @param shader : The ELF input
+void ElfLinkerImpl::mergePalMetadataFromElf(const LinkableShader &shader) {
+  for (StringRef blob : shader.getPalMetadataBlobs())
+    m_pipelineState->mergePalMetadataFromBlob(blob);
 }
 
 // =====================================================================================================================
 // Write the PAL metadata out into the .note section.
 void ElfLinkerImpl::writePalMetadata() {
-  // Fix up user data registers.
   PalMetadata *palMetadata = m_pipelineState->getPalMetadata();
-  palMetadata->fixUpRegisters();
-  // Finalize the PAL metadata, writing pipeline state items into it.
-  palMetadata->finalizePipeline();
+  // Per-stage ELFs carry the whole pipeline's metadata, which the patch passes already finalized.
+  if (!m_stageElfs) {
+    // Fix up user data registers.
+    palMetadata->fixUpRegisters();
+    // Finalize the PAL metadata, writing pipeline state items into it.
+    palMetadata->finalizePipeline();
+  }
   // Write the MsgPack document into a blob.
   std::string blob;
   palMetadata->getDocument()->writeToBlob(blob);
@@ -592,53 +609,50 @@ bool ElfLinkerImpl::insertGlueShaders() {
     // Compile the glue shader (if not already done), and parse the ELF.
     StringRef elfBlob = glueShader->getElfBlob();
     MemoryBufferRef elfBuffer(elfBlob, glueShader->getName());
-    ElfInput glueElfInput = {cantFail(object::ObjectFile::createELFObjectFile(elfBuffer))};
+    ElfInput glueElfInput = {LinkableShader::create(elfBuffer)};
 
     // Find the input ELF containing the main shader that the glue shader wants to attach to.
     StringRef mainName = glueShader->getMainShaderName();
     unsigned insertPos = UINT_MAX;
     for (unsigned idx = 0; idx != m_elfInputs.size(); ++idx) {
       ElfInput &elfInput = m_elfInputs[idx];
-      for (auto sym : elfInput.objectFile->symbols()) {
-        if (cantFail(sym.getName()) == mainName) {
-          // Found it. Find other STT_FUNC symbols in the same text section so we can check the validity of
-          // gluing the glue shader on.
-          uint64_t symValue = cantFail(sym.getValue()), maxValue = symValue;
-          auto section = cantFail(sym.getSection());
-          auto type = cantFail(sym.getType());
-          for (auto otherSym : elfInput.objectFile->symbols()) {
-            if (cantFail(otherSym.getSection()) == section && cantFail(otherSym.getType()) == type)
-              maxValue = std::max(maxValue, cantFail(otherSym.getValue()));
-          }
-          if (glueShader->isProlog()) {
-            // For a prolog glue shader, we can only cope if the main shader is at the start of its text section.
-            // We can reduce the alignment of the main shader from 0x100 to 0x40, but only if there are no
-            // other shaders in its text section.
-            if (symValue != 0) {
-              getPipelineState()->setError("Shader " + mainName + " is not at the start of its text section");
-              return false;
-            }
-            elfInput.reduceAlign = cantFail(section->getName());
-            insertPos = idx;
-          } else {
-            // For an epilog glue shader, we can only cope if the main shader is the last one in its text section.
-            // Also we reduce the alignment of the glue shader from 0x100 to 0x40.
-            if (symValue != maxValue) {
-              getPipelineState()->setError("Shader " + mainName + " is not at the end of its text section");
-              return false;
-            }
-            glueElfInput.reduceAlign = cantFail(section->getName());
-            insertPos = idx + 1;
-          }
-          break;
+      const LinkableSymbol *sym = elfInput.shader->findSymbol(mainName);
+      if (!sym)
+        continue;
+      // Found it. Find other STT_FUNC symbols in the same text section so we can check the validity of
+      // gluing the glue shader on.
+      uint64_t maxValue = sym->value;
+      for (const LinkableSymbol &otherSym : elfInput.shader->getSymbols().drop_front()) {
+        if (otherSym.sectionIndex == sym->sectionIndex && otherSym.type == sym->type)
+          maxValue = std::max(maxValue, otherSym.value);
+      }
+      StringRef sectionName = elfInput.shader->getSections()[sym->sectionIndex].name;
+      if (glueShader->isProlog()) {
+        // For a prolog glue shader, we can only cope if the main shader is at the start of its text section.
+        // We can reduce the alignment of the main shader from 0x100 to 0x40, but only if there are no
+        // other shaders in its text section.
+        if (sym->value != 0) {
+          getPipelineState()->setError("Shader " + mainName + " is not at the start of its text section");
+          return false;
+        }
+        elfInput.reduceAlign = sectionName;
+        insertPos = idx;
+      } else {
+        // For an epilog glue shader, we can only cope if the main shader is the last one in its text section.
+        // Also we reduce the alignment of the glue shader from 0x100 to 0x40.
+        if (sym->value != maxValue) {
+          getPipelineState()->setError("Shader " + mainName + " is not at the end of its text section");
+          return false;
         }
+        glueElfInput.reduceAlign = sectionName;
+        insertPos = idx + 1;
       }
     }
 
     // Merge PAL metadata from glue ELF.
     // Note that the merger callback in PalMetadata.cpp relies on the PAL metadata for the shader/half-pipeline
     // ELFs being read first, and the glue shaders being merged in afterwards.
-    mergePalMetadataFromElf(*glueElfInput.objectFile);
+    mergePalMetadataFromElf(*glueElfInput.shader);
 
     // Insert the glue shader in the appropriate place in the list of ELFs.
     assert(insertPos != UINT_MAX && "Main shader not found for glue shader");
@@ -653,7 +667,7 @@ bool ElfLinkerImpl::insertGlueShaders() {
 // @param elfInput : ELF input that the section comes from
 // @param inputSection : Input section to add to this output section
 // @param reduceAlign : Reduce the alignment of the section (for gluing code together)
-void OutputSection::addInputSection(ElfInput &elfInput, object::SectionRef inputSection, bool reduceAlign) {
+void OutputSection::addInputSection(ElfInput &elfInput, const LinkableSection &inputSection, bool reduceAlign) {
   // Add the input section.
   m_inputSections.push_back(inputSection);
   // Remember reduceAlign request.
@@ -661,7 +675,7 @@ void OutputSection::addInputSection(ElfInput &elfInput, object::SectionRef input
     setReduceAlign(m_inputSections.back());
   // Add an entry to the ElfInput's sectionMap, so we can get from an input section to where it contributes
   // to an output section.
-  unsigned idx = inputSection.getIndex();
+  unsigned idx = inputSection.index;
   if (idx >= elfInput.sectionMap.size())
     elfInput.sectionMap.resize(idx + 1, {UINT_MAX, UINT_MAX});
   elfInput.sectionMap[idx] = {getIndex(), m_inputSections.size() - 1};
@@ -674,7 +688,7 @@ StringRef OutputSection::getName() {
     return m_name;
   if (m_inputSections.empty())
     return "";
-  return cantFail(m_inputSections[0].sectionRef.getName());
+  return m_inputSections[0].section->name;
 }
 
 // =====================================================================================================================
@@ -688,25 +702,10 @@ unsigned OutputSection::getIndex() {
 // Also copy global symbols for each input section to the output ELF's symbol table.
 // This is done as an initial separate step so that in the future we could support a reloc in one output section
 // referring to a symbol in a different output section. But we do not currently support that.
+// GFX10 s_end_code padding was already removed from the size of each input text section when its ELF was parsed.
 void OutputSection::layout() {
   uint64_t size = 0;
   for (InputSection &inputSection : m_inputSections) {
-    if (object::ELFSectionRef(inputSection.sectionRef).getFlags() & ELF::SHF_EXECINSTR) {
-      // Remove GFX10 s_end_code padding by removing any suffix of the section that is not inside a function symbol.
-      inputSection.size = 0;
-      for (auto &sym : inputSection.sectionRef.getObject()->symbols()) {
-        if (cantFail(sym.getSection()) == inputSection.sectionRef &&
-            cantFail(sym.getType()) == object::SymbolRef::ST_Function) {
-          inputSection.size =
-              std::max(inputSection.size, cantFail(sym.getValue()) + object::ELFSymbolRef(sym).getSize());
-        }
-      }
-      if (inputSection.size == 0) {
-        // No function symbols found. We'd better restore the size to the size of the whole section.
-        inputSection.size = inputSection.sectionRef.getSize();
-      }
-    }
-
     // Gain alignment as required for the next input section.
     uint64_t alignment = getAlignment(inputSection);
     m_alignment = std::max(m_alignment, alignment);
@@ -726,7 +725,7 @@ void OutputSection::layout() {
 //
 // @param inputSection : InputSection
 uint64_t OutputSection::getAlignment(const InputSection &inputSection) {
-  uint64_t alignment = inputSection.sectionRef.getAlignment();
+  uint64_t alignment = inputSection.section->alignment;
   // Check if alignment is reduced for this section
   // for gluing code together.
   if (alignment > 0x40 && getReduceAlign(inputSection))
@@ -737,21 +736,20 @@ uint64_t OutputSection::getAlignment(const InputSection &inputSection) {
 // =====================================================================================================================
 // Add a symbol to the output symbol table
 //
-// @param elfSymRef : The symbol from an input ELF
+// @param symbol : The symbol from an input ELF
 // @param inputSectIdx : Index of input section within this output section that the symbol refers to
-void OutputSection::addSymbol(const object::ELFSymbolRef &elfSymRef, unsigned inputSectIdx) {
+void OutputSection::addSymbol(const LinkableSymbol &symbol, unsigned inputSectIdx) {
   const InputSection &inputSection = m_inputSections[inputSectIdx];
-  StringRef name = cantFail(elfSymRef.getName());
   ELF::Elf64_Sym newSym = {};
-  newSym.st_name = m_linker->getStringIndex(name);
-  newSym.setBinding(elfSymRef.getBinding());
-  newSym.setType(cantFail(elfSymRef.getType()));
+  newSym.st_name = m_linker->getStringIndex(symbol.name);
+  newSym.setBinding(symbol.binding);
+  newSym.setType(symbol.type);
   newSym.st_shndx = getIndex();
-  newSym.st_value = cantFail(elfSymRef.getValue()) + inputSection.offset;
-  newSym.st_size = elfSymRef.getSize();
+  newSym.st_value = symbol.value + inputSection.offset;
+  newSym.st_size = symbol.size;
   if (m_linker->findSymbol(newSym.st_name) != 0)
-    report_fatal_error("Duplicate symbol '" + name + "'");
-  m_linker->getSymbols().push_back(newSym);
+    report_fatal_error("Duplicate symbol '" + symbol.name + "'");
+  m_linker->addOutputSymbol(newSym);
 }
 
 // =====================================================================================================================
@@ -794,8 +792,8 @@ void OutputSection::write(raw_pwrite_stream &outStream, ELF::Elf64_Shdr *shdr) {
     return;
 
   // This section has contributions from input sections. Get the type and flags from the first input section.
-  shdr->sh_type = object::ELFSectionRef(m_inputSections[0].sectionRef).getType();
-  shdr->sh_flags = object::ELFSectionRef(m_inputSections[0].sectionRef).getFlags();
+  shdr->sh_type = m_inputSections[0].section->type;
+  shdr->sh_flags = m_inputSections[0].section->flags;
 
   // Set up the pattern we will use for alignment padding.
   const size_t paddingUnit = 16;
@@ -821,8 +819,7 @@ void OutputSection::write(raw_pwrite_stream &outStream, ELF::Elf64_Shdr *shdr) {
     }
 
     // Write the input section
-    StringRef contents = cantFail(inputSection.sectionRef.getContents());
-    outStream << contents.slice(0, inputSection.size);
+    outStream << inputSection.section->contents.slice(0, inputSection.size);
     size += inputSection.size;
   }
 
@@ -41,11 +41,73 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IntrinsicsAMDGPU.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/Mutex.h"
 #include "llvm/Target/TargetMachine.h"
+#include <mutex>
 
 using namespace lgc;
 using namespace llvm;
 
+// -glue-shader-cache-size: maximum number of compiled glue shaders kept in the process-wide glue shader cache
+static cl::opt<unsigned> GlueShaderCacheSize("glue-shader-cache-size",
+                                             cl::desc("Maximum number of compiled glue shaders kept for reuse by "
+                                                      "later links in the process (0 to disable)"),
+                                             cl::init(256));
+
+namespace {
+
+// =====================================================================================================================
+// Process-wide cache of compiled glue shader ELFs. A title typically has few distinct vertex input layouts, so the
+// same fetch shader is needed by many pipelines, and by links in different LgcContexts.
+struct GlueShaderCache {
+  sys::Mutex lock;             // Lock for the map below
+  StringMap<std::string> elfs; // Compiled ELF for each target and glue shader string
+};
+
+} // anonymous namespace
+
+static ManagedStatic<GlueShaderCache> SGlueShaderCache;
+
+// =====================================================================================================================
+// Get the ELF blob for this glue shader. If it has not been set or compiled already, it is taken from the
+// process-wide glue shader cache, or compiled and added to that cache.
+StringRef GlueShader::getElfBlob() {
+  if (!m_elfRef.empty())
+    return m_elfRef;
+
+  // The glue shader string covers everything that the glue shader depends on except the target.
+  TargetMachine *targetMachine = m_lgcContext->getTargetMachine();
+  std::string key = (targetMachine->getTargetCPU() + "," + targetMachine->getTargetFeatureString() + ",").str();
+  key += getString();
+
+  if (GlueShaderCacheSize != 0) {
+    std::lock_guard<sys::Mutex> lock(SGlueShaderCache->lock);
+    auto it = SGlueShaderCache->elfs.find(key);
+    if (it != SGlueShaderCache->elfs.end()) {
+      // Copy it, as another thread may evict it from the cache while this link is using it.
+      m_elfBlob = it->second;
+      m_elfRef = m_elfBlob;
+      return m_elfRef;
+    }
+  }
+
+  // Compile outside the lock, so links on other threads are not held up. Two threads compiling the same glue
+  // shader at once both compile it, and the first to finish adds it to the cache.
+  raw_svector_ostream outStream(m_elfBlob);
+  compile(outStream);
+
+  if (GlueShaderCacheSize != 0 && !m_elfBlob.empty()) {
+    std::lock_guard<sys::Mutex> lock(SGlueShaderCache->lock);
+    if (SGlueShaderCache->elfs.size() >= GlueShaderCacheSize)
+      SGlueShaderCache->elfs.clear();
+    SGlueShaderCache->elfs.insert({key, std::string(m_elfBlob.str())});
+  }
+  m_elfRef = m_elfBlob;
+  return m_elfRef;
+}
+
 // =====================================================================================================================
 // Compile the glue shader
 //
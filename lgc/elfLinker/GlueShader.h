@@ -52,14 +52,12 @@ public:
   // that the front-end client can use as a cache key to avoid compiling the same glue shader more than once.
   virtual llvm::StringRef getString() = 0;
 
-  // Get the ELF blob for this glue shader, compiling if not already compiled.
-  llvm::StringRef getElfBlob() {
-    if (m_elfBlob.empty()) {
-      llvm::raw_svector_ostream outStream(m_elfBlob);
-      compile(outStream);
-    }
-    return m_elfBlob;
-  }
+  // Get the ELF blob for this glue shader, taking it from the glue shader cache or compiling it if not already set.
+  llvm::StringRef getElfBlob();
+
+  // Set the ELF blob for this glue shader, typically retrieved from the front-end client's cache. The blob is not
+  // copied, so it must stay valid until the link is done.
+  void setElfBlob(llvm::StringRef blob) { m_elfRef = blob; }
 
   // Get the symbol name of the main shader that this glue shader is prolog or epilog for
   virtual llvm::StringRef getMainShaderName() = 0;
@@ -84,7 +82,8 @@ protected:
   LgcContext *m_lgcContext;
 
 private:
-  llvm::SmallString<0> m_elfBlob;
+  llvm::SmallString<0> m_elfBlob; // ELF compiled here or copied from the glue shader cache
+  llvm::StringRef m_elfRef;       // ELF to use: m_elfBlob, or the blob given to setElfBlob
 };
 
 } // namespace lgc
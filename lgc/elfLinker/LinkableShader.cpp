@@ -0,0 +1,181 @@
+/*
+ ***********************************************************************************************************************
+ *
+ *  Copyright (c) 2020 Advanced Micro Devices, Inc. All Rights Reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ **********************************************************************************************************************/
+/**
+ ***********************************************************************************************************************
+ * @file  LinkableShader.cpp
+ * @brief LGC source file: Pre-indexed unlinked shader ELF for the ELF linker, and a cache of them
+ ***********************************************************************************************************************
+ */
+#include "lgc/state/LinkableShader.h"
+#include "lgc/state/AbiMetadata.h"
+#include "lgc/util/CantFail.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/xxhash.h"
+
+#define DEBUG_TYPE "lgc-elf-linker"
+
+using namespace lgc;
+using namespace llvm;
+
+// -linkable-shader-cache-size: maximum number of parsed unlinked shader ELFs kept for reuse by later links
+static cl::opt<unsigned> LinkableShaderCacheSize("linkable-shader-cache-size",
+                                                 cl::desc("Maximum number of parsed unlinked shader ELFs that the ELF "
+                                                          "linker keeps for reuse by later links (0 to disable)"),
+                                                 cl::init(64));
+
+// =====================================================================================================================
+// Create a linkable shader from an unlinked shader or glue shader ELF. The ELF is copied, so the caller's buffer
+// need not outlive the LinkableShader.
+//
+// @param elf : The ELF
+std::unique_ptr<LinkableShader> LinkableShader::create(MemoryBufferRef elf) {
+  std::unique_ptr<LinkableShader> shader(
+      new LinkableShader(MemoryBuffer::getMemBufferCopy(elf.getBuffer(), elf.getBufferIdentifier())));
+  std::unique_ptr<object::ObjectFile> objectFile =
+      cantFail(object::ObjectFile::createELFObjectFile(shader->m_buffer->getMemBufferRef()));
+  auto elfFile = cast<object::ELFObjectFile<object::ELF64LE>>(&*objectFile)->getELFFile();
+
+  // Sections, with GFX10 s_end_code padding measured off text sections: the size of a text section is the end of
+  // the last function symbol in it.
+  for (const object::SectionRef &section : objectFile->sections()) {
+    object::ELFSectionRef elfSection(section);
+    LinkableSection linkableSection = {};
+    linkableSection.index = section.getIndex();
+    linkableSection.name = cantFail(section.getName());
+    linkableSection.type = elfSection.getType();
+    linkableSection.flags = elfSection.getFlags();
+    linkableSection.alignment = section.getAlignment();
+    if (linkableSection.type != ELF::SHT_NOBITS)
+      linkableSection.contents = cantFail(section.getContents());
+    linkableSection.size = section.getSize();
+    assert(linkableSection.index == shader->m_sections.size());
+    shader->m_sections.push_back(linkableSection);
+  }
+  SmallVector<uint64_t, 8> textSizes(shader->m_sections.size());
+
+  // Symbols, with the null symbol at index 0 so that ELF symbol indices can be used.
+  shader->m_symbols.push_back({});
+  for (const object::SymbolRef &symRef : objectFile->symbols()) {
+    object::ELFSymbolRef elfSymRef(symRef);
+    LinkableSymbol symbol = {};
+    symbol.name = cantFail(elfSymRef.getName());
+    object::section_iterator containingSect = cantFail(elfSymRef.getSection());
+    if (containingSect != objectFile->section_end())
+      symbol.sectionIndex = containingSect->getIndex();
+    symbol.binding = elfSymRef.getBinding();
+    symbol.type = cantFail(elfSymRef.getType());
+    symbol.value = cantFail(elfSymRef.getValue());
+    symbol.size = elfSymRef.getSize();
+    assert(symRef.getRawDataRefImpl().d.b == shader->m_symbols.size());
+    shader->m_symbolMap.insert({symbol.name, shader->m_symbols.size()});
+    shader->m_symbols.push_back(symbol);
+
+    if (symbol.sectionIndex != 0 && symbol.type == object::SymbolRef::ST_Function)
+      textSizes[symbol.sectionIndex] = std::max(textSizes[symbol.sectionIndex], symbol.value + symbol.size);
+  }
+  for (LinkableSection &section : shader->m_sections) {
+    // If no function symbols were found, keep the size of the whole section.
+    if ((section.flags & ELF::SHF_EXECINSTR) && textSizes[section.index] != 0)
+      section.size = textSizes[section.index];
+  }
+
+  // Relocs and PAL metadata.
+  for (const object::SectionRef &section : objectFile->sections()) {
+    object::ELFSectionRef elfSection(section);
+    unsigned sectType = elfSection.getType();
+    if (sectType == ELF::SHT_REL || sectType == ELF::SHT_RELA) {
+      unsigned relocatedSectIdx = cantFail(section.getRelocatedSection())->getIndex();
+      StringRef contents = shader->m_sections[relocatedSectIdx].contents;
+      for (object::RelocationRef reloc : section.relocations()) {
+        LinkableReloc linkableReloc = {};
+        linkableReloc.sectionIndex = relocatedSectIdx;
+        linkableReloc.type = reloc.getType();
+        linkableReloc.offset = reloc.getOffset();
+        assert(linkableReloc.offset + sizeof(uint32_t) <= contents.size() && "Out of range reloc offset");
+        if (sectType == ELF::SHT_RELA)
+          linkableReloc.addend = cantFail(object::ELFRelocationRef(reloc).getAddend());
+        else
+          linkableReloc.addend = *reinterpret_cast<const uint32_t *>(contents.data() + linkableReloc.offset);
+        linkableReloc.symbolIndex = reloc.getSymbol()->getRawDataRefImpl().d.b;
+        shader->m_relocs.push_back(linkableReloc);
+      }
+    } else if (sectType == ELF::SHT_NOTE) {
+      Error err = ErrorSuccess();
+      auto shdr = cantFail(elfFile->getSection(elfSection.getIndex()));
+      for (auto note : elfFile->notes(*shdr, err)) {
+        if (note.getName() == Util::Abi::AmdGpuArchName && note.getType() == ELF::NT_AMDGPU_METADATA) {
+          ArrayRef<uint8_t> desc = note.getDesc();
+          shader->m_palMetadataBlobs.push_back(StringRef(reinterpret_cast<const char *>(desc.data()), desc.size()));
+        }
+      }
+    }
+  }
+
+  return shader;
+}
+
+// =====================================================================================================================
+// Find a symbol by name
+//
+// @param name : Symbol name
+// @return : The symbol, or nullptr if not found
+const LinkableSymbol *LinkableShader::findSymbol(StringRef name) const {
+  auto it = m_symbolMap.find(name);
+  if (it == m_symbolMap.end())
+    return nullptr;
+  return &m_symbols[it->second];
+}
+
+// =====================================================================================================================
+// Get the linkable shader for an ELF, creating it if it is not cached. The cache is looked up by a hash of the ELF,
+// and a hit is confirmed against the cached shader's copy of the ELF, so a hash collision is just a miss. When the
+// cache is full, the least recently used shader is evicted; links already holding it are unaffected.
+//
+// @param elf : The unlinked shader ELF
+std::shared_ptr<const LinkableShader> LinkableShaderCache::get(MemoryBufferRef elf) {
+  uint64_t hash = xxHash64(elf.getBuffer());
+  auto it = m_map.find(hash);
+  if (it != m_map.end() && it->second->second->getElf() == elf.getBuffer()) {
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    return it->second->second;
+  }
+
+  std::shared_ptr<const LinkableShader> shader = LinkableShader::create(elf);
+  if (LinkableShaderCacheSize == 0)
+    return shader;
+  if (it != m_map.end()) {
+    // A different ELF with the same hash; replace it.
+    m_lru.erase(it->second);
+    m_map.erase(it);
+  }
+  while (m_lru.size() >= LinkableShaderCacheSize) {
+    m_map.erase(m_lru.back().first);
+    m_lru.pop_back();
+  }
+  m_lru.emplace_front(hash, shader);
+  m_map[hash] = m_lru.begin();
+  return shader;
+}
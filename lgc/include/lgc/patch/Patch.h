@@ -45,9 +45,11 @@ class PassManager;
 } // namespace legacy
 
 void initializeLowerVertexFetchPass(PassRegistry &);
+void initializePatchBufferLoadMergePass(PassRegistry &);
 void initializePatchBufferOpPass(PassRegistry &);
 void initializePatchCheckShaderCachePass(PassRegistry &);
 void initializePatchCopyShaderPass(PassRegistry &);
+void initializePatchDescriptorLoadHoistPass(PassRegistry &);
 void initializePatchEntryPointMutatePass(PassRegistry &);
 void initializePatchInOutImportExportPass(PassRegistry &);
 void initializePatchIntrinsicSimplifyPass(PassRegistry &);
@@ -70,9 +72,11 @@ class PatchCheckShaderCache;
 // @param passRegistry : Pass registry
 inline static void initializePatchPasses(llvm::PassRegistry &passRegistry) {
   initializeLowerVertexFetchPass(passRegistry);
+  initializePatchBufferLoadMergePass(passRegistry);
   initializePatchBufferOpPass(passRegistry);
   initializePatchCheckShaderCachePass(passRegistry);
   initializePatchCopyShaderPass(passRegistry);
+  initializePatchDescriptorLoadHoistPass(passRegistry);
   initializePatchEntryPointMutatePass(passRegistry);
   initializePatchInOutImportExportPass(passRegistry);
   initializePatchIntrinsicSimplifyPass(passRegistry);
@@ -86,9 +90,11 @@ inline static void initializePatchPasses(llvm::PassRegistry &passRegistry) {
 }
 
 llvm::ModulePass *createLowerVertexFetch();
+llvm::FunctionPass *createPatchBufferLoadMerge();
 llvm::FunctionPass *createPatchBufferOp();
 PatchCheckShaderCache *createPatchCheckShaderCache();
 llvm::ModulePass *createPatchCopyShader();
+llvm::FunctionPass *createPatchDescriptorLoadHoist();
 llvm::ModulePass *createPatchEntryPointMutate();
 llvm::ModulePass *createPatchInOutImportExport();
 llvm::FunctionPass *createPatchIntrinsicSimplify();
@@ -31,10 +31,18 @@
 #pragma once
 
 #include "lgc/Pipeline.h"
+#include "llvm/ADT/SmallVector.h"
+
+namespace llvm {
+
+class CallInst;
+
+} // namespace llvm
 
 namespace lgc {
 
 class BuilderBase;
+class PipelineState;
 
 // =====================================================================================================================
 // Public interface to vertex fetch manager.
@@ -52,6 +60,10 @@ public:
   // Generate code to fetch a vertex value
   virtual llvm::Value *fetchVertex(llvm::Type *inputTy, const VertexInputDescription *description, unsigned location,
                                    unsigned compIdx, BuilderBase &builder) = 0;
+
+  // Lower the vertex fetch calls of vertex inputs that can share a combined load, and remove them from the list
+  virtual void coalesceVertexFetches(PipelineState *pipelineState,
+                                     llvm::SmallVectorImpl<llvm::CallInst *> &vertexFetches, BuilderBase &builder) = 0;
 };
 
 } // namespace lgc
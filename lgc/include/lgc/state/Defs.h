@@ -114,6 +114,7 @@ const static char NggCullingFrustum[] = "lgc.ngg.culling.frustum";
 const static char NggCullingBoxFilter[] = "lgc.ngg.culling.boxfilter";
 const static char NggCullingSphere[] = "lgc.ngg.culling.sphere";
 const static char NggCullingSmallPrimFilter[] = "lgc.ngg.culling.smallprimfilter";
+const static char NggCullingSmallPrimFilterUnclamped[] = "lgc.ngg.culling.smallprimfilter.unclamped";
 const static char NggCullingCullDistance[] = "lgc.ngg.culling.culldistance";
 
 const static char EntryPointPrefix[] = "lgc.shader.";
@@ -0,0 +1,139 @@
+/*
+ ***********************************************************************************************************************
+ *
+ *  Copyright (c) 2020 Advanced Micro Devices, Inc. All Rights Reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ **********************************************************************************************************************/
+/**
+ ***********************************************************************************************************************
+ * @file  LinkableShader.h
+ * @brief LGC header file: Pre-indexed unlinked shader ELF for the ELF linker, and a cache of them
+ ***********************************************************************************************************************
+ */
+#pragma once
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+namespace lgc {
+
+// =====================================================================================================================
+// A section of a linkable shader ELF
+struct LinkableSection {
+  unsigned index;           // Section index in the ELF
+  llvm::StringRef name;     // Section name
+  unsigned type;            // Section type (SHT_* value)
+  uint64_t flags;           // Section flags (SHF_* bits)
+  uint64_t alignment;       // Section alignment
+  llvm::StringRef contents; // Section contents
+  uint64_t size;            // Size, after removing s_end_code padding from a text section
+};
+
+// =====================================================================================================================
+// A symbol of a linkable shader ELF
+struct LinkableSymbol {
+  llvm::StringRef name;  // Symbol name
+  unsigned sectionIndex; // Index of the section containing the symbol, or 0 if none
+  unsigned binding;      // Symbol binding (STB_* value)
+  unsigned type;         // Symbol type (object::SymbolRef::Type value)
+  uint64_t value;        // Symbol value (offset within its section)
+  uint64_t size;         // Symbol size
+};
+
+// =====================================================================================================================
+// A reloc of a linkable shader ELF
+struct LinkableReloc {
+  unsigned sectionIndex; // Index of the section that the reloc applies to
+  unsigned type;         // Reloc type (R_AMDGPU_* value)
+  uint64_t offset;       // Offset of the reloc within its section
+  uint64_t addend;       // Addend, read from the relocated section for an SHT_REL reloc
+  unsigned symbolIndex;  // Index of the referenced symbol in getSymbols()
+};
+
+// =====================================================================================================================
+// An unlinked shader or glue shader ELF, parsed once into the sections, symbols, relocs and PAL metadata that the
+// ELF linker needs. It owns a copy of the ELF, and holds no per-link state, so one LinkableShader can be used by
+// any number of links.
+class LinkableShader {
+public:
+  // Create a linkable shader from an ELF, copying the ELF
+  static std::unique_ptr<LinkableShader> create(llvm::MemoryBufferRef elf);
+
+  // Get the ELF header
+  const llvm::ELF::Elf64_Ehdr &getHeader() const {
+    return *reinterpret_cast<const llvm::ELF::Elf64_Ehdr *>(m_buffer->getBufferStart());
+  }
+
+  // Get the name given to the ELF when it was created
+  llvm::StringRef getName() const { return m_buffer->getBufferIdentifier(); }
+
+  // Get the shader's copy of the ELF
+  llvm::StringRef getElf() const { return m_buffer->getBuffer(); }
+
+  // Get the sections, indexed by ELF section index (including the null section 0)
+  llvm::ArrayRef<LinkableSection> getSections() const { return m_sections; }
+
+  // Get the symbols, indexed by ELF symbol table index (including the null symbol 0)
+  llvm::ArrayRef<LinkableSymbol> getSymbols() const { return m_symbols; }
+
+  // Get the relocs of all reloc sections
+  llvm::ArrayRef<LinkableReloc> getRelocs() const { return m_relocs; }
+
+  // Get the PAL metadata blobs from the .note sections
+  llvm::ArrayRef<llvm::StringRef> getPalMetadataBlobs() const { return m_palMetadataBlobs; }
+
+  // Find a symbol by name
+  const LinkableSymbol *findSymbol(llvm::StringRef name) const;
+
+private:
+  LinkableShader(std::unique_ptr<llvm::MemoryBuffer> buffer) : m_buffer(std::move(buffer)) {}
+
+  std::unique_ptr<llvm::MemoryBuffer> m_buffer;             // Copy of the ELF
+  llvm::SmallVector<LinkableSection, 8> m_sections;         // Sections
+  llvm::SmallVector<LinkableSymbol, 8> m_symbols;           // Symbols
+  llvm::SmallVector<LinkableReloc, 8> m_relocs;             // Relocs
+  llvm::SmallVector<llvm::StringRef, 2> m_palMetadataBlobs; // PAL metadata blobs
+  llvm::StringMap<unsigned> m_symbolMap;                    // Map from symbol name to index in m_symbols
+};
+
+// =====================================================================================================================
+// Cache of linkable shaders, keyed on a hash of their ELFs, so that the same unlinked shader ELF linked into many
+// pipelines is only parsed once. It evicts the least recently used shader when full. It is owned by the LgcContext,
+// so needs no locking.
+class LinkableShaderCache {
+public:
+  // Get the linkable shader for an ELF, creating it if it is not cached
+  std::shared_ptr<const LinkableShader> get(llvm::MemoryBufferRef elf);
+
+private:
+  typedef std::pair<uint64_t, std::shared_ptr<const LinkableShader>> Entry;
+
+  std::list<Entry> m_lru;                                         // {ELF hash, shader} pairs, most recently used first
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> m_map; // Map from ELF hash to its entry in m_lru
+};
+
+} // namespace lgc
@@ -375,6 +375,9 @@ public:
   }
 
 private:
+  // Run backend codegen on the patched pipeline module, one hardware shader stage per thread, and link the results
+  void codeGenPerStage(llvm::Module &pipelineModule, llvm::raw_pwrite_stream &outStream);
+
   // Read shaderStageMask from IR
   void readShaderStageMask(llvm::Module *module);
 
@@ -0,0 +1,86 @@
+/*
+ ***********************************************************************************************************************
+ *
+ *  Copyright (c) 2020 Advanced Micro Devices, Inc. All Rights Reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ **********************************************************************************************************************/
+/**
+ ***********************************************************************************************************************
+ * @file  LgcIntrinsics.h
+ * @brief LGC header file: Classification of internal lgc.* calls by callee
+ ***********************************************************************************************************************
+ */
+#pragma once
+
+#include "llvm/ADT/DenseMap.h"
+
+namespace llvm {
+class CallInst;
+class Function;
+} // namespace llvm
+
+namespace lgc {
+
+// =====================================================================================================================
+// Kinds of internal lgc.* call that patch passes handle, each corresponding to a name prefix in lgcName
+enum class LgcIntrinsic : unsigned {
+  None,                   // Not one of the calls below
+  InputImportGeneric,     // lgc.input.import.generic.*
+  InputImportBuiltIn,     // lgc.input.import.builtin.*
+  InputImportInterpolant, // lgc.input.import.interpolant.*
+  InputImportVertex,      // lgc.input.import.vertex.*
+  OutputImportGeneric,    // lgc.output.import.generic.*
+  OutputImportBuiltIn,    // lgc.output.import.builtin.*
+  OutputExportGeneric,    // lgc.output.export.generic.*
+  OutputExportBuiltIn,    // lgc.output.export.builtin.*
+  OutputExportXfb,        // lgc.output.export.xfb.*
+  SpillTable,             // lgc.spill.table
+  PushConst,              // lgc.push.const
+  RootDescriptor,         // lgc.root.descriptor
+  DescriptorSet,          // lgc.descriptor.set
+  SpecialUserData,        // lgc.special.user.data.*
+  ShaderInput,            // lgc.shader.input.*
+};
+
+// =====================================================================================================================
+// Table of the LgcIntrinsic kind of each function in a module. A function's name is only examined the first time it
+// is looked up, so a pass visiting every call does one hash lookup per call rather than a chain of name prefix
+// comparisons. Functions can be deleted and their memory reused between runs, so a pass needs to clear its table at
+// the start of each run.
+class LgcIntrinsicTable {
+public:
+  // Get the kind of a function, classifying it from its name if not already done
+  LgcIntrinsic get(const llvm::Function *func);
+
+  // Get the kind of the callee of a call; None for an indirect call
+  LgcIntrinsic get(const llvm::CallInst &call);
+
+  // Forget all functions
+  void clear() { m_kinds.clear(); }
+
+  // Classify a function from its name, without using a table
+  static LgcIntrinsic classify(const llvm::Function &func);
+
+private:
+  llvm::DenseMap<const llvm::Function *, LgcIntrinsic> m_kinds; // Kind of each function seen so far
+};
+
+} // namespace lgc
@@ -31,10 +31,12 @@
 #pragma once
 
 #include "llvm/ADT/StringRef.h"
+#include <string>
 
 namespace llvm {
 
 class LLVMContext;
+class Module;
 class ModulePass;
 class raw_pwrite_stream;
 class TargetMachine;
@@ -51,9 +53,11 @@ class PassManager;
 namespace lgc {
 
 class Builder;
+class LinkableShaderCache;
 class PassManager;
 class PassManagerCache;
 class Pipeline;
+struct PassProfile;
 class TargetInfo;
 
 // =====================================================================================================================
@@ -107,6 +111,10 @@ public:
   // Adds target passes to pass manager, depending on "-filetype" and "-emit-llvm" options
   void addTargetPasses(lgc::PassManager &passMgr, llvm::Timer *codeGenTimer, llvm::raw_pwrite_stream &outStream);
 
+  // Check whether addTargetPasses sets up codegen to an ELF object, rather than IR or ISA assembly output, with
+  // no LLPC_OUTS dump of the final module
+  static bool isTargetOutputElf();
+
   // Utility method to create a start/stop timer pass
   static llvm::ModulePass *createStartStopTimer(llvm::Timer *timer, bool starting);
 
@@ -121,6 +129,23 @@ public:
   // Get pass manager cache
   PassManagerCache *getPassManagerCache();
 
+  // Get cache of unlinked shader ELFs parsed by the ELF linker
+  LinkableShaderCache *getLinkableShaderCache();
+
+  // Get and set the library of NGG culler functions in this context, which is nullptr until the first NGG compile
+  // that does culling loads it. The LgcContext takes ownership of the library.
+  llvm::Module *getNggCullerLibrary() const { return m_nggCullerLibrary; }
+  void setNggCullerLibrary(llvm::Module *library) { m_nggCullerLibrary = library; }
+
+  // Set and get the profile that pass managers set up by the middle-end for this context record module pass times
+  // into. This is initially nullptr, signifying no pass profiling.
+  void setPassProfile(PassProfile *passProfile) { m_passProfile = passProfile; }
+  PassProfile *getPassProfile() const { return m_passProfile; }
+
+  // Get the total time, in nanoseconds, that LgcContext::Create has saved in this process by taking over target
+  // state cached from LgcContexts destroyed earlier, instead of setting it up again.
+  static uint64_t getTotalSetupTimeSaved();
+
 private:
   LgcContext() = delete;
   LgcContext(const LgcContext &) = delete;
@@ -128,12 +153,16 @@ private:
 
   LgcContext(llvm::LLVMContext &context, unsigned palAbiVersion);
 
-  static llvm::raw_ostream *m_llpcOuts;           // nullptr or stream for LLPC_OUTS
-  llvm::LLVMContext &m_context;                   // LLVM context
-  llvm::TargetMachine *m_targetMachine = nullptr; // Target machine
-  TargetInfo *m_targetInfo = nullptr;             // Target info
-  unsigned m_palAbiVersion = 0xFFFFFFFF;          // PAL pipeline ABI version to compile for
-  PassManagerCache *m_passManagerCache = nullptr; // Pass manager cache and creator
+  static llvm::raw_ostream *m_llpcOuts;                 // nullptr or stream for LLPC_OUTS
+  llvm::LLVMContext &m_context;                         // LLVM context
+  llvm::TargetMachine *m_targetMachine = nullptr;       // Target machine
+  TargetInfo *m_targetInfo = nullptr;                   // Target info
+  unsigned m_palAbiVersion = 0xFFFFFFFF;                // PAL pipeline ABI version to compile for
+  PassManagerCache *m_passManagerCache = nullptr;       // Pass manager cache and creator
+  LinkableShaderCache *m_linkableShaderCache = nullptr; // Unlinked shader ELFs parsed by the ELF linker
+  llvm::Module *m_nggCullerLibrary = nullptr;           // Library of NGG culler functions, if loaded
+  std::string m_targetMachineKey;                       // Key of the target machine configuration in the target cache
+  PassProfile *m_passProfile = nullptr;                 // Profile to record middle-end pass times into, if any
 };
 
 } // namespace lgc
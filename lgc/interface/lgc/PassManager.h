@@ -30,10 +30,19 @@
  */
 #pragma once
 
+#include "llvm/ADT/StringMap.h"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Support/Timer.h"
 
 namespace lgc {
 
+// =====================================================================================================================
+// Per-pass time and memory figures gathered by a PassManager that has been given one with setPassProfile
+struct PassProfile {
+  llvm::StringMap<llvm::TimeRecord> passTimes; // Accumulated time of each module pass, keyed by pass name
+  size_t peakMemory = 0;                       // Highest heap usage seen at a pass boundary, in bytes
+};
+
 // =====================================================================================================================
 // Public interface of LLPC middle-end's legacy::PassManager override
 class PassManager : public llvm::legacy::PassManager {
@@ -42,6 +51,7 @@ public:
   virtual ~PassManager() {}
   virtual void stop() = 0;
   virtual void setPassIndex(unsigned *passIndex) = 0;
+  virtual void setPassProfile(PassProfile *passProfile) = 0;
 };
 
 } // namespace lgc
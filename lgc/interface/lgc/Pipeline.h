@@ -117,6 +117,8 @@ struct Options {
   unsigned shadowDescriptorTable;      // High dword of shadow descriptor table address, or
                                        //   ShadowDescriptorTableDisable to disable shadow descriptor tables
   unsigned allowNullDescriptor;        // Allow and give defined behavior for null descriptor
+  unsigned enableScalarLoadMerge;      // If set, adjacent uniform constant buffer loads are merged into wider
+                                       //   scalar loads.
 };
 
 // Middle-end per-shader options to pass to SetShaderOptions.
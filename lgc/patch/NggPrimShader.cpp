@@ -32,26 +32,61 @@
 #include "Gfx9Chip.h"
 #include "NggLdsManager.h"
 #include "ShaderMerger.h"
+#include "lgc/LgcContext.h"
 #include "lgc/PassManager.h"
 #include "lgc/state/PalMetadata.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IntrinsicsAMDGPU.h"
+#include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/Linker/Linker.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/Mutex.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/IPO.h"
 #include "llvm/Transforms/InstCombine/InstCombine.h"
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Transforms/Utils/Cloning.h"
+#include <mutex>
 
 #define DEBUG_TYPE "lgc-ngg-prim-shader"
 
 using namespace llvm;
 
+// -ngg-culler-library: copy NGG culler functions from a library built once per process
+static cl::opt<bool> NggCullerLibrary("ngg-culler-library",
+                                      cl::desc("Copy NGG culler functions from a library that is built and optimized "
+                                               "once per process, instead of building them in each compile"),
+                                      cl::init(true));
+
+namespace {
+
+// Bitcode of the NGG culler library, shared by all LGC contexts in the process.
+struct CullerLibraryBitcode {
+  sys::Mutex lock;     // Lock for the bitcode
+  std::string bitcode; // Bitcode of the library, or empty if not built yet
+};
+
+} // anonymous namespace
+
+static ManagedStatic<CullerLibraryBitcode> SCullerLibraryBitcode;
+
 namespace lgc {
 
+// Names of the culler functions in the NGG culler library
+static const char *const CullerNames[] = {
+    lgcName::NggCullingBackface,        lgcName::NggCullingFrustum,
+    lgcName::NggCullingBoxFilter,       lgcName::NggCullingSphere,
+    lgcName::NggCullingSmallPrimFilter, lgcName::NggCullingSmallPrimFilterUnclamped,
+    lgcName::NggCullingCullDistance,
+};
+
 // =====================================================================================================================
 //
 // @param pipelineState : Pipeline state
@@ -3609,9 +3644,7 @@ Value *NggPrimShader::doBackfaceCulling(Module *module, Value *cullFlag, Value *
                                         Value *vertex2) {
   assert(m_nggControl->enableBackfaceCulling);
 
-  auto backfaceCuller = module->getFunction(lgcName::NggCullingBackface);
-  if (!backfaceCuller)
-    backfaceCuller = createBackfaceCuller(module);
+  auto backfaceCuller = getCuller(module, lgcName::NggCullingBackface);
 
   // Get register PA_SU_SC_MODE_CNTL
   Value *paSuScModeCntl = nullptr;
@@ -3644,9 +3677,7 @@ Value *NggPrimShader::doFrustumCulling(Module *module, Value *cullFlag, Value *v
                                        Value *vertex2) {
   assert(m_nggControl->enableFrustumCulling);
 
-  auto frustumCuller = module->getFunction(lgcName::NggCullingFrustum);
-  if (!frustumCuller)
-    frustumCuller = createFrustumCuller(module);
+  auto frustumCuller = getCuller(module, lgcName::NggCullingFrustum);
 
   // Get register PA_CL_CLIP_CNTL
   Value *paClClipCntl = nullptr;
@@ -3678,9 +3709,7 @@ Value *NggPrimShader::doBoxFilterCulling(Module *module, Value *cullFlag, Value
                                          Value *vertex2) {
   assert(m_nggControl->enableBoxFilterCulling);
 
-  auto boxFilterCuller = module->getFunction(lgcName::NggCullingBoxFilter);
-  if (!boxFilterCuller)
-    boxFilterCuller = createBoxFilterCuller(module);
+  auto boxFilterCuller = getCuller(module, lgcName::NggCullingBoxFilter);
 
   // Get register PA_CL_VTE_CNTL
   Value *paClVteCntl = m_builder->getInt32(m_nggControl->primShaderTable.pipelineStateCb.paClVteCntl);
@@ -3714,9 +3743,7 @@ Value *NggPrimShader::doBoxFilterCulling(Module *module, Value *cullFlag, Value
 Value *NggPrimShader::doSphereCulling(Module *module, Value *cullFlag, Value *vertex0, Value *vertex1, Value *vertex2) {
   assert(m_nggControl->enableSphereCulling);
 
-  auto sphereCuller = module->getFunction(lgcName::NggCullingSphere);
-  if (!sphereCuller)
-    sphereCuller = createSphereCuller(module);
+  auto sphereCuller = getCuller(module, lgcName::NggCullingSphere);
 
   // Get register PA_CL_VTE_CNTL
   Value *paClVteCntl = m_builder->getInt32(m_nggControl->primShaderTable.pipelineStateCb.paClVteCntl);
@@ -3751,9 +3778,10 @@ Value *NggPrimShader::doSmallPrimFilterCulling(Module *module, Value *cullFlag,
                                                Value *vertex2) {
   assert(m_nggControl->enableSmallPrimFilter);
 
-  auto smallPrimFilterCuller = module->getFunction(lgcName::NggCullingSmallPrimFilter);
-  if (!smallPrimFilterCuller)
-    smallPrimFilterCuller = createSmallPrimFilterCuller(module);
+  // With frustum culling on, the culler does not need to clamp the bounding box to the viewport.
+  auto smallPrimFilterCuller =
+      getCuller(module, m_nggControl->enableFrustumCulling ? lgcName::NggCullingSmallPrimFilterUnclamped
+                                                           : lgcName::NggCullingSmallPrimFilter);
 
   // Get register PA_CL_VTE_CNTL
   Value *paClVteCntl = m_builder->getInt32(m_nggControl->primShaderTable.pipelineStateCb.paClVteCntl);
@@ -3792,9 +3820,7 @@ Value *NggPrimShader::doCullDistanceCulling(Module *module, Value *cullFlag, Val
                                             Value *signMask2) {
   assert(m_nggControl->enableCullDistanceCulling);
 
-  auto cullDistanceCuller = module->getFunction(lgcName::NggCullingCullDistance);
-  if (!cullDistanceCuller)
-    cullDistanceCuller = createCullDistanceCuller(module);
+  auto cullDistanceCuller = getCuller(module, lgcName::NggCullingCullDistance);
 
   // Do cull distance culling
   return m_builder->CreateCall(cullDistanceCuller, {cullFlag, signMask0, signMask1, signMask2});
@@ -3815,6 +3841,109 @@ Value *NggPrimShader::fetchCullingControlRegister(Module *module, unsigned regOf
       {m_nggFactor.primShaderTableAddrLow, m_nggFactor.primShaderTableAddrHigh, m_builder->getInt32(regOffset)});
 }
 
+// =====================================================================================================================
+// Gets the culler function of the given name in the module. Unless -ngg-culler-library is off, it is copied from the
+// culler library of the LGC context, instead of being built with IRBuilder again.
+//
+// @param module : LLVM module
+// @param cullerName : Name of the culler function
+Function *NggPrimShader::getCuller(Module *module, StringRef cullerName) {
+  Function *culler = module->getFunction(cullerName);
+  if (culler)
+    return culler;
+  if (!NggCullerLibrary)
+    return createCuller(module, cullerName);
+
+  Function *libraryCuller = getCullerLibrary()->getFunction(cullerName);
+  assert(libraryCuller && "Culler missing from the NGG culler library");
+  culler = Function::Create(libraryCuller->getFunctionType(), GlobalValue::InternalLinkage, cullerName, module);
+
+  // Map the arguments, and the intrinsics that the culler calls, to their counterparts in the module.
+  ValueToValueMapTy valueMap;
+  auto argIt = culler->arg_begin();
+  for (Argument &libraryArg : libraryCuller->args()) {
+    argIt->setName(libraryArg.getName());
+    valueMap[&libraryArg] = &*argIt++;
+  }
+  for (Instruction &inst : instructions(libraryCuller)) {
+    if (auto call = dyn_cast<CallInst>(&inst)) {
+      Function *callee = call->getCalledFunction();
+      if (callee && !valueMap.count(callee)) {
+        valueMap[callee] =
+            module->getOrInsertFunction(callee->getName(), callee->getFunctionType(), callee->getAttributes())
+                .getCallee();
+      }
+    }
+  }
+
+  SmallVector<ReturnInst *, 4> retInsts;
+  CloneFunctionInto(culler, libraryCuller, valueMap, false, retInsts);
+  return culler;
+}
+
+// =====================================================================================================================
+// Gets the library of culler functions of the LGC context, loading it if this is the first NGG compile with culling
+// in the context. The library is built once per process with IRBuilder and optimized, and kept as bitcode that the
+// other contexts load it from.
+Module *NggPrimShader::getCullerLibrary() {
+  LgcContext *lgcContext = m_pipelineState->getLgcContext();
+  if (Module *library = lgcContext->getNggCullerLibrary())
+    return library;
+
+  std::unique_ptr<Module> library;
+  {
+    std::lock_guard<sys::Mutex> lock(SCullerLibraryBitcode->lock);
+    std::string &bitcode = SCullerLibraryBitcode->bitcode;
+    if (!bitcode.empty()) {
+      library = cantFail(parseBitcodeFile(MemoryBufferRef(bitcode, "lgc.ngg.cullers"), *m_context));
+    } else {
+      library = std::make_unique<Module>("lgc.ngg.cullers", *m_context);
+      for (const char *cullerName : CullerNames)
+        createCuller(&*library, cullerName);
+
+      // Optimize the cullers once here, rather than in every compile that uses them.
+      legacy::FunctionPassManager passMgr(&*library);
+      passMgr.add(createInstructionCombiningPass());
+      passMgr.add(createEarlyCSEPass());
+      passMgr.add(createCFGSimplificationPass());
+      passMgr.doInitialization();
+      for (Function &culler : *library) {
+        if (!culler.isDeclaration())
+          passMgr.run(culler);
+      }
+      passMgr.doFinalization();
+
+      raw_string_ostream bitcodeStream(bitcode);
+      WriteBitcodeToFile(*library, bitcodeStream);
+    }
+  }
+
+  lgcContext->setNggCullerLibrary(library.release());
+  return lgcContext->getNggCullerLibrary();
+}
+
+// =====================================================================================================================
+// Creates the culler function of the given name in the module with IRBuilder.
+//
+// @param module : LLVM module
+// @param cullerName : Name of the culler function
+Function *NggPrimShader::createCuller(Module *module, StringRef cullerName) {
+  if (cullerName == lgcName::NggCullingBackface)
+    return createBackfaceCuller(module);
+  if (cullerName == lgcName::NggCullingFrustum)
+    return createFrustumCuller(module);
+  if (cullerName == lgcName::NggCullingBoxFilter)
+    return createBoxFilterCuller(module);
+  if (cullerName == lgcName::NggCullingSphere)
+    return createSphereCuller(module);
+  if (cullerName == lgcName::NggCullingSmallPrimFilter)
+    return createSmallPrimFilterCuller(module, true);
+  if (cullerName == lgcName::NggCullingSmallPrimFilterUnclamped)
+    return createSmallPrimFilterCuller(module, false);
+  assert(cullerName == lgcName::NggCullingCullDistance);
+  return createCullDistanceCuller(module);
+}
+
 // =====================================================================================================================
 // Creates the function that does backface culling.
 //
@@ -4906,7 +5035,9 @@ Function *NggPrimShader::createSphereCuller(Module *module) {
 // Creates the function that does small primitive filter culling.
 //
 // @param module : LLVM module
-Function *NggPrimShader::createSmallPrimFilterCuller(Module *module) {
+// @param clampToViewport : Whether to clamp the bounding box of the primitive to the viewport, which is not needed
+//                          when frustum culling is done as well
+Function *NggPrimShader::createSmallPrimFilterCuller(Module *module, bool clampToViewport) {
   auto funcTy = FunctionType::get(m_builder->getInt1Ty(),
                                   {
                                       m_builder->getInt1Ty(),                                // %cullFlag
@@ -4921,7 +5052,10 @@ Function *NggPrimShader::createSmallPrimFilterCuller(Module *module) {
                                       m_builder->getInt1Ty()                                 // %conservativeRaster
                                   },
                                   false);
-  auto func = Function::Create(funcTy, GlobalValue::InternalLinkage, lgcName::NggCullingSmallPrimFilter, module);
+  auto func = Function::Create(funcTy, GlobalValue::InternalLinkage,
+                               clampToViewport ? lgcName::NggCullingSmallPrimFilter
+                                               : lgcName::NggCullingSmallPrimFilterUnclamped,
+                               module);
 
   func->setCallingConv(CallingConv::C);
   func->addFnAttr(Attribute::ReadNone);
@@ -5057,7 +5191,7 @@ Function *NggPrimShader::createSmallPrimFilterCuller(Module *module) {
     Value *screenMaxX = nullptr;
     Value *screenMinY = nullptr;
     Value *screenMaxY = nullptr;
-    if (!m_nggControl->enableFrustumCulling) {
+    if (clampToViewport) {
       // screenMinX = -xScale + xOffset - 0.75
       screenMinX = m_builder->CreateFAdd(m_builder->CreateFNeg(xScale), xOffset);
       screenMinX = m_builder->CreateFAdd(screenMinX, ConstantFP::get(m_builder->getFloatTy(), -0.75));
@@ -5087,7 +5221,7 @@ Function *NggPrimShader::createSmallPrimFilterCuller(Module *module) {
     // minX = clamp(min(screenX0', screenX1', screenX2'), screenMinX, screenMaxX) - 1/256.0
     Value *minX = m_builder->CreateIntrinsic(Intrinsic::minnum, m_builder->getFloatTy(), {screenX0, screenX1});
     minX = m_builder->CreateIntrinsic(Intrinsic::minnum, m_builder->getFloatTy(), {minX, screenX2});
-    if (!m_nggControl->enableFrustumCulling) {
+    if (clampToViewport) {
       minX =
           m_builder->CreateIntrinsic(Intrinsic::amdgcn_fmed3, m_builder->getFloatTy(), {screenMinX, minX, screenMaxX});
     }
@@ -5099,7 +5233,7 @@ Function *NggPrimShader::createSmallPrimFilterCuller(Module *module) {
     // maxX = clamp(max(screenX0', screenX1', screenX2'), screenMinX, screenMaxX) + 1/256.0
     Value *maxX = m_builder->CreateIntrinsic(Intrinsic::maxnum, m_builder->getFloatTy(), {screenX0, screenX1});
     maxX = m_builder->CreateIntrinsic(Intrinsic::maxnum, m_builder->getFloatTy(), {maxX, screenX2});
-    if (!m_nggControl->enableFrustumCulling) {
+    if (clampToViewport) {
       maxX =
           m_builder->CreateIntrinsic(Intrinsic::amdgcn_fmed3, m_builder->getFloatTy(), {screenMinX, maxX, screenMaxX});
     }
@@ -5120,7 +5254,7 @@ Function *NggPrimShader::createSmallPrimFilterCuller(Module *module) {
     // minY = clamp(min(screenY0', screenY1', screenY2'), screenMinY, screenMaxY) - 1/256.0
     Value *minY = m_builder->CreateIntrinsic(Intrinsic::minnum, m_builder->getFloatTy(), {screenY0, screenY1});
     minY = m_builder->CreateIntrinsic(Intrinsic::minnum, m_builder->getFloatTy(), {minY, screenY2});
-    if (!m_nggControl->enableFrustumCulling) {
+    if (clampToViewport) {
       minY =
           m_builder->CreateIntrinsic(Intrinsic::amdgcn_fmed3, m_builder->getFloatTy(), {screenMinY, minY, screenMaxY});
     }
@@ -5132,7 +5266,7 @@ Function *NggPrimShader::createSmallPrimFilterCuller(Module *module) {
     // maxY = clamp(max(screenX0', screenY1', screenY2'), screenMinY, screenMaxY) + 1/256.0
     Value *maxY = m_builder->CreateIntrinsic(Intrinsic::maxnum, m_builder->getFloatTy(), {screenY0, screenY1});
     maxY = m_builder->CreateIntrinsic(Intrinsic::maxnum, m_builder->getFloatTy(), {maxY, screenY2});
-    if (!m_nggControl->enableFrustumCulling) {
+    if (clampToViewport) {
       maxY =
           m_builder->CreateIntrinsic(Intrinsic::amdgcn_fmed3, m_builder->getFloatTy(), {screenMinY, maxY, screenMaxY});
     }
@@ -178,11 +178,15 @@ private:
 
   llvm::Value *fetchCullingControlRegister(llvm::Module *module, unsigned regOffset);
 
+  llvm::Function *getCuller(llvm::Module *module, llvm::StringRef cullerName);
+  llvm::Module *getCullerLibrary();
+  llvm::Function *createCuller(llvm::Module *module, llvm::StringRef cullerName);
+
   llvm::Function *createBackfaceCuller(llvm::Module *module);
   llvm::Function *createFrustumCuller(llvm::Module *module);
   llvm::Function *createBoxFilterCuller(llvm::Module *module);
   llvm::Function *createSphereCuller(llvm::Module *module);
-  llvm::Function *createSmallPrimFilterCuller(llvm::Module *module);
+  llvm::Function *createSmallPrimFilterCuller(llvm::Module *module, bool clampToViewport);
   llvm::Function *createCullDistanceCuller(llvm::Module *module);
 
   llvm::Function *createFetchCullingRegister(llvm::Module *module);
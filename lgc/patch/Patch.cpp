@@ -76,6 +76,12 @@ opt<bool> DisablePatchOpt("disable-patch-opt", desc("Disable optimization for LL
 opt<bool> UseLlvmOpt("use-llvm-opt",
                      desc("Use LLVM's standard optimization set instead of the curated optimization set"), init(false));
 
+// -hoist-descriptor-loads: hoist and deduplicate uniform descriptor loads
+opt<bool> HoistDescriptorLoads("hoist-descriptor-loads",
+                               desc("Hoist uniform descriptor loads to the entry block of a shader and "
+                                    "deduplicate them"),
+                               init(false));
+
 } // namespace cl
 
 } // namespace llvm
@@ -120,6 +126,10 @@ void Patch::addPasses(PipelineState *pipelineState, legacy::PassManager &passMgr
   // Lower vertex fetch operations.
   passMgr.add(createLowerVertexFetch());
 
+  // Hoist and deduplicate uniform descriptor loads, while the descriptor table pointers are still lgc.* calls
+  if (cl::HoistDescriptorLoads)
+    passMgr.add(createPatchDescriptorLoadHoist());
+
   // Patch entry-point mutation (should be done before external library link)
   passMgr.add(createPatchEntryPointMutate());
 
@@ -166,6 +176,10 @@ void Patch::addPasses(PipelineState *pipelineState, legacy::PassManager &passMgr
   passMgr.add(createPatchBufferOp());
   passMgr.add(createInstructionCombiningPass(2));
 
+  // Merge scalar buffer loads (if enabled by the pipeline option), now that instruction combining has folded the
+  // offsets that PatchBufferOp generated
+  passMgr.add(createPatchBufferLoadMerge());
+
   // Fully prepare the pipeline ABI (must be after optimizations)
   passMgr.add(createPatchPreparePipelineAbi(/* onlySetCallingConvs = */ false));
 
@@ -0,0 +1,219 @@
+/*
+ ***********************************************************************************************************************
+ *
+ *  Copyright (c) 2020 Advanced Micro Devices, Inc. All Rights Reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ **********************************************************************************************************************/
+/**
+ ***********************************************************************************************************************
+ * @file  PatchBufferLoadMerge.cpp
+ * @brief LLPC source file: contains implementation of class lgc::PatchBufferLoadMerge.
+ ***********************************************************************************************************************
+ */
+#include "PatchBufferLoadMerge.h"
+#include "lgc/state/PipelineState.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicsAMDGPU.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/MathExtras.h"
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+#define DEBUG_TYPE "lgc-patch-buffer-load-merge"
+
+using namespace lgc;
+using namespace llvm;
+
+namespace lgc {
+
+// Maximum byte size of a merged load (s_buffer_load_dwordx16)
+static const unsigned MaxMergedLoadByteSize = 64;
+
+// =====================================================================================================================
+// Define static members (no initializer needed as LLVM only cares about the address of ID, never its value).
+char PatchBufferLoadMerge::ID;
+
+// =====================================================================================================================
+// Pass creator, creates the pass of LLVM patching operations for merging scalar buffer loads.
+FunctionPass *createPatchBufferLoadMerge() {
+  return new PatchBufferLoadMerge();
+}
+
+// =====================================================================================================================
+PatchBufferLoadMerge::PatchBufferLoadMerge() : FunctionPass(ID) {
+}
+
+// =====================================================================================================================
+// Get the analysis usage of this pass.
+//
+// @param [out] analysisUsage : The analysis usage.
+void PatchBufferLoadMerge::getAnalysisUsage(AnalysisUsage &analysisUsage) const {
+  analysisUsage.addRequired<PipelineStateWrapper>();
+  analysisUsage.setPreservesCFG();
+}
+
+// =====================================================================================================================
+// Executes this LLVM pass on the specified LLVM function.
+//
+// @param [in,out] function : Function that will run this optimization.
+bool PatchBufferLoadMerge::runOnFunction(Function &function) {
+  LLVM_DEBUG(dbgs() << "Run the pass Patch-Buffer-Load-Merge\n");
+
+  PipelineState *pipelineState = getAnalysis<PipelineStateWrapper>().getPipelineState(function.getParent());
+  if (!pipelineState->getOptions().enableScalarLoadMerge)
+    return false;
+
+  bool changed = false;
+  for (BasicBlock &block : function)
+    changed |= mergeLoadsInBlock(block);
+  return changed;
+}
+
+// =====================================================================================================================
+// Merges the scalar buffer loads in a basic block that read from the same buffer descriptor at nearby offsets.
+//
+// @param [in,out] block : Basic block to process
+bool PatchBufferLoadMerge::mergeLoadsInBlock(BasicBlock &block) {
+  // Gather the s.buffer.load calls with dword elements, grouped by buffer descriptor, non-constant part of the
+  // offset, and cache policy. The offset is either a constant, or a value plus a constant.
+  typedef std::tuple<Value *, Value *, Value *> LoadGroupKey;
+  std::map<LoadGroupKey, unsigned> loadGroupMap;
+  SmallVector<std::pair<Value *, SmallVector<BufferLoad, 8>>, 4> loadGroups;
+  const DataLayout &dataLayout = block.getModule()->getDataLayout();
+  for (Instruction &inst : block) {
+    auto call = dyn_cast<CallInst>(&inst);
+    if (!call || call->getIntrinsicID() != Intrinsic::amdgcn_s_buffer_load ||
+        call->getType()->getScalarSizeInBits() != 32 || !isa<ConstantInt>(call->getArgOperand(2)))
+      continue;
+
+    Value *baseOffset = call->getArgOperand(1);
+    ConstantInt *constOffset = dyn_cast<ConstantInt>(baseOffset);
+    if (constOffset)
+      baseOffset = nullptr;
+    else if (auto add = dyn_cast<BinaryOperator>(baseOffset)) {
+      if (add->getOpcode() == Instruction::Add) {
+        constOffset = dyn_cast<ConstantInt>(add->getOperand(1));
+        if (constOffset)
+          baseOffset = add->getOperand(0);
+      }
+    }
+    unsigned offset = 0;
+    if (constOffset) {
+      if (constOffset->isNegative() || constOffset->getZExtValue() % 4 != 0)
+        continue;
+      offset = constOffset->getZExtValue();
+    }
+
+    LoadGroupKey key(call->getArgOperand(0), baseOffset, call->getArgOperand(2));
+    auto it = loadGroupMap.insert({key, loadGroups.size()});
+    if (it.second)
+      loadGroups.push_back({baseOffset, {}});
+    loadGroups[it.first->second].second.push_back(
+        {call, offset, static_cast<unsigned>(dataLayout.getTypeStoreSize(call->getType()))});
+  }
+
+  // In each group, merge each run of loads that overlap or follow on from each other, for as long as the run fits in
+  // one load of up to 16 dwords.
+  bool changed = false;
+  for (auto &loadGroup : loadGroups) {
+    SmallVectorImpl<BufferLoad> &loads = loadGroup.second;
+    if (loads.size() < 2)
+      continue;
+    std::stable_sort(loads.begin(), loads.end(),
+                     [](const BufferLoad &lhs, const BufferLoad &rhs) { return lhs.offset < rhs.offset; });
+
+    for (unsigned first = 0; first != loads.size();) {
+      unsigned startOffset = loads[first].offset;
+      unsigned endOffset = startOffset + loads[first].byteSize;
+      unsigned last = first;
+      while (last + 1 != loads.size() && loads[last + 1].offset <= endOffset &&
+             std::max(endOffset, loads[last + 1].offset + loads[last + 1].byteSize) - startOffset <=
+                 MaxMergedLoadByteSize) {
+        ++last;
+        endOffset = std::max(endOffset, loads[last].offset + loads[last].byteSize);
+      }
+
+      if (last != first) {
+        // The merged load is rounded up to a dword count that s_buffer_load supports.
+        unsigned dwordCount = PowerOf2Ceil((endOffset - startOffset) / 4);
+        mergeLoads(makeArrayRef(loads).slice(first, last + 1 - first), loadGroup.first, startOffset, dwordCount);
+        changed = true;
+      }
+      first = last + 1;
+    }
+  }
+  return changed;
+}
+
+// =====================================================================================================================
+// Replaces a run of scalar buffer loads with a single wider load, inserted before the first of them, and extracts
+// the value of each original load from it.
+//
+// @param loads : Loads to merge, all with the same buffer descriptor, base offset and cache policy
+// @param baseOffset : Non-constant part of the offset, or nullptr if the offsets are constant
+// @param startOffset : Constant byte offset of the merged load
+// @param dwordCount : Dword count of the merged load
+void PatchBufferLoadMerge::mergeLoads(ArrayRef<BufferLoad> loads, Value *baseOffset, unsigned startOffset,
+                                      unsigned dwordCount) {
+  CallInst *firstCall = loads.front().call;
+  for (const BufferLoad &load : loads) {
+    if (load.call->comesBefore(firstCall))
+      firstCall = load.call;
+  }
+
+  IRBuilder<> builder(firstCall);
+  Value *offset = builder.getInt32(startOffset);
+  if (baseOffset)
+    offset = builder.CreateAdd(baseOffset, offset);
+  Type *mergedTy = builder.getInt32Ty();
+  if (dwordCount > 1)
+    mergedTy = FixedVectorType::get(mergedTy, dwordCount);
+  Value *mergedLoad = builder.CreateIntrinsic(Intrinsic::amdgcn_s_buffer_load, mergedTy,
+                                              {firstCall->getArgOperand(0), offset, firstCall->getArgOperand(2)});
+
+  for (const BufferLoad &load : loads) {
+    unsigned compIdx = (load.offset - startOffset) / 4;
+    unsigned compCount = load.byteSize / 4;
+    Value *value = mergedLoad;
+    if (compCount != dwordCount) {
+      if (compCount == 1)
+        value = builder.CreateExtractElement(mergedLoad, compIdx);
+      else {
+        SmallVector<int, 16> shuffleMask;
+        for (unsigned i = 0; i != compCount; ++i)
+          shuffleMask.push_back(compIdx + i);
+        value = builder.CreateShuffleVector(mergedLoad, mergedLoad, shuffleMask);
+      }
+    }
+    load.call->replaceAllUsesWith(builder.CreateBitCast(value, load.call->getType()));
+  }
+
+  for (const BufferLoad &load : loads)
+    load.call->eraseFromParent();
+}
+
+} // namespace lgc
+
+// =====================================================================================================================
+// Initializes the pass of LLVM patching operations for merging scalar buffer loads.
+INITIALIZE_PASS(PatchBufferLoadMerge, DEBUG_TYPE, "Patch LLVM for merging scalar buffer loads", false, false)
@@ -0,0 +1,77 @@
+/*
+ ***********************************************************************************************************************
+ *
+ *  Copyright (c) 2020 Advanced Micro Devices, Inc. All Rights Reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ **********************************************************************************************************************/
+/**
+ ***********************************************************************************************************************
+ * @file  PatchBufferLoadMerge.h
+ * @brief LLPC header file: contains declaration of class lgc::PatchBufferLoadMerge.
+ ***********************************************************************************************************************
+ */
+#pragma once
+
+#include "lgc/patch/Patch.h"
+#include "llvm/ADT/ArrayRef.h"
+
+namespace llvm {
+
+class BasicBlock;
+class CallInst;
+class Value;
+
+} // namespace llvm
+
+namespace lgc {
+
+// =====================================================================================================================
+// Represents the pass of LLVM patching operations for merging scalar buffer loads.
+//
+// PatchBufferOp turns each uniform constant buffer load into its own s.buffer.load, so a shader that reads a large
+// uniform block field by field gets a long run of narrow loads. This pass merges s.buffer.load calls in the same
+// block that read from the same buffer descriptor at constant offsets near each other into wider loads (up to
+// 16 dwords), then extracts the original values from the wide result.
+class PatchBufferLoadMerge final : public llvm::FunctionPass {
+public:
+  PatchBufferLoadMerge();
+
+  void getAnalysisUsage(llvm::AnalysisUsage &analysisUsage) const override;
+  bool runOnFunction(llvm::Function &function) override;
+
+  static char ID; // ID of this pass
+
+private:
+  PatchBufferLoadMerge(const PatchBufferLoadMerge &) = delete;
+  PatchBufferLoadMerge &operator=(const PatchBufferLoadMerge &) = delete;
+
+  // A scalar buffer load that is a candidate for merging.
+  struct BufferLoad {
+    llvm::CallInst *call; // The s.buffer.load call
+    unsigned offset;      // Constant byte offset added to the base offset
+    unsigned byteSize;    // Byte size of the loaded value
+  };
+
+  bool mergeLoadsInBlock(llvm::BasicBlock &block);
+  void mergeLoads(llvm::ArrayRef<BufferLoad> loads, llvm::Value *baseOffset, unsigned startOffset, unsigned dwordCount);
+};
+
+} // namespace lgc
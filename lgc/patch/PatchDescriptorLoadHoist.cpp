@@ -0,0 +1,280 @@
+/*
+ ***********************************************************************************************************************
+ *
+ *  Copyright (c) 2020 Advanced Micro Devices, Inc. All Rights Reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ **********************************************************************************************************************/
+/**
+ ***********************************************************************************************************************
+ * @file  PatchDescriptorLoadHoist.cpp
+ * @brief LLPC source file: contains implementation of class lgc::PatchDescriptorLoadHoist.
+ ***********************************************************************************************************************
+ */
+#include "PatchDescriptorLoadHoist.h"
+#include "lgc/state/IntrinsDefs.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include <algorithm>
+
+#define DEBUG_TYPE "lgc-patch-descriptor-load-hoist"
+
+using namespace lgc;
+using namespace llvm;
+
+// -descriptor-hoist-sgpr-limit: maximum number of descriptor dwords to hoist to the entry block of a shader
+static cl::opt<unsigned> DescriptorHoistSgprLimit("descriptor-hoist-sgpr-limit",
+                                                  cl::desc("Maximum number of descriptor dwords (SGPRs) to hoist to "
+                                                           "the entry block of a shader (0 disables hoisting)"),
+                                                  cl::init(32));
+
+namespace lgc {
+
+// =====================================================================================================================
+// Define static members (no initializer needed as LLVM only cares about the address of ID, never its value).
+char PatchDescriptorLoadHoist::ID;
+
+// =====================================================================================================================
+// Pass creator, creates the pass of LLVM patching operations for hoisting uniform descriptor loads.
+FunctionPass *createPatchDescriptorLoadHoist() {
+  return new PatchDescriptorLoadHoist();
+}
+
+// =====================================================================================================================
+PatchDescriptorLoadHoist::PatchDescriptorLoadHoist() : FunctionPass(ID) {
+}
+
+// =====================================================================================================================
+// Get the analysis usage of this pass.
+//
+// @param [out] analysisUsage : The analysis usage.
+void PatchDescriptorLoadHoist::getAnalysisUsage(AnalysisUsage &analysisUsage) const {
+  analysisUsage.addRequired<LoopInfoWrapperPass>();
+  analysisUsage.setPreservesCFG();
+}
+
+// =====================================================================================================================
+// Executes this LLVM pass on the specified LLVM function.
+//
+// @param [in,out] function : Function that will run this optimization.
+bool PatchDescriptorLoadHoist::runOnFunction(Function &function) {
+  LLVM_DEBUG(dbgs() << "Run the pass Patch-Descriptor-Load-Hoist\n");
+
+  m_intrinsics.clear();
+  m_loopInfo = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+
+  bool changed = hoistDescriptorTables(function);
+  if (DescriptorHoistSgprLimit == 0)
+    return changed;
+
+  gatherDescriptorLoads(function);
+
+  // Only a descriptor that is loaded more than once, or in a loop, gains anything from being hoisted. Hoist those in
+  // order of decreasing weight for as long as they fit in the SGPR budget.
+  SmallVector<DescriptorLoads *, 8> candidates;
+  for (DescriptorLoads &descLoads : m_descLoads) {
+    if (descLoads.weight > 1)
+      candidates.push_back(&descLoads);
+  }
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [](const DescriptorLoads *lhs, const DescriptorLoads *rhs) { return lhs->weight > rhs->weight; });
+
+  const DataLayout &dataLayout = function.getParent()->getDataLayout();
+  unsigned sgprCount = 0;
+  for (DescriptorLoads *descLoads : candidates) {
+    unsigned dwordSize = alignTo(dataLayout.getTypeStoreSize(descLoads->loads.front()->getType()), 4) / 4;
+    if (sgprCount + dwordSize > DescriptorHoistSgprLimit)
+      continue;
+    sgprCount += dwordSize;
+    hoistDescriptorLoads(*descLoads);
+    changed = true;
+  }
+
+  m_descLoadsMap.clear();
+  m_descLoads.clear();
+  return changed;
+}
+
+// =====================================================================================================================
+// Moves the calls that get a descriptor table pointer (lgc.descriptor.set and lgc.spill.table) to the start of the
+// entry block, keeping one call for each distinct set of args. These calls have no side effects and only constant
+// args, so this is always safe, and it means that descriptor loads from the same table can be recognized by their
+// table pointer being the same value.
+//
+// @param [in,out] function : Function to process
+bool PatchDescriptorLoadHoist::hoistDescriptorTables(Function &function) {
+  SmallVector<CallInst *, 8> tableCalls;
+  for (Instruction &inst : instructions(function)) {
+    if (auto call = dyn_cast<CallInst>(&inst)) {
+      LgcIntrinsic kind = m_intrinsics.get(*call);
+      if ((kind == LgcIntrinsic::DescriptorSet || kind == LgcIntrinsic::SpillTable) &&
+          std::all_of(call->arg_begin(), call->arg_end(), [](const Use &arg) { return isa<Constant>(arg); }))
+        tableCalls.push_back(call);
+    }
+  }
+
+  bool changed = false;
+  std::map<std::vector<Value *>, CallInst *> canonicalCalls;
+  Instruction *insertPos = &*function.getEntryBlock().getFirstInsertionPt();
+  for (CallInst *call : tableCalls) {
+    std::vector<Value *> key(call->arg_begin(), call->arg_end());
+    key.push_back(call->getCalledFunction());
+    CallInst *&canonicalCall = canonicalCalls[key];
+    if (canonicalCall) {
+      call->replaceAllUsesWith(canonicalCall);
+      call->eraseFromParent();
+      changed = true;
+    } else {
+      canonicalCall = call;
+      if (call == insertPos)
+        insertPos = call->getNextNode();
+      else {
+        call->moveBefore(insertPos);
+        changed = true;
+      }
+    }
+  }
+  return changed;
+}
+
+// =====================================================================================================================
+// Gathers the loads of each descriptor in the function, weighting each load by the depth of the loop it is in.
+//
+// @param function : Function to process
+void PatchDescriptorLoadHoist::gatherDescriptorLoads(Function &function) {
+  for (BasicBlock &block : function) {
+    unsigned loopDepth = m_loopInfo->getLoopDepth(&block);
+    unsigned weight = 1u << std::min(3 * loopDepth, 15u);
+    for (Instruction &inst : block) {
+      DescriptorKey key;
+      if (!getDescriptorKey(&inst, key))
+        continue;
+      auto it = m_descLoadsMap.insert({key, m_descLoads.size()});
+      if (it.second)
+        m_descLoads.push_back({{}, 0});
+      DescriptorLoads &descLoads = m_descLoads[it.first->second];
+      descLoads.loads.push_back(&inst);
+      descLoads.weight += weight;
+    }
+  }
+}
+
+// =====================================================================================================================
+// Determines whether an instruction loads a descriptor at a constant offset from a descriptor table, or is an
+// lgc.root.descriptor call, and if so, gets the key that identifies the descriptor.
+//
+// @param inst : Instruction to check
+// @param [out] key : Key of the descriptor
+bool PatchDescriptorLoadHoist::getDescriptorKey(Instruction *inst, DescriptorKey &key) {
+  if (auto call = dyn_cast<CallInst>(inst)) {
+    if (m_intrinsics.get(*call) != LgcIntrinsic::RootDescriptor)
+      return false;
+    key = DescriptorKey(call->getCalledFunction(), cast<ConstantInt>(call->getArgOperand(0))->getZExtValue(),
+                        call->getType());
+    return true;
+  }
+
+  auto load = dyn_cast<LoadInst>(inst);
+  if (!load || !load->isSimple() || load->getPointerAddressSpace() != ADDR_SPACE_CONST)
+    return false;
+
+  // Walk back from the pointer to the descriptor table pointer, accumulating the constant offset. Look through
+  // the struct of descriptor pointer and stride that DescBuilder uses for image, sampler and texel buffer
+  // descriptors.
+  const DataLayout &dataLayout = load->getModule()->getDataLayout();
+  Value *pointer = load->getPointerOperand();
+  APInt offset(dataLayout.getIndexTypeSizeInBits(pointer->getType()), 0);
+  for (;;) {
+    pointer = pointer->stripAndAccumulateConstantOffsets(dataLayout, offset, /*AllowNonInbounds=*/true);
+    auto extract = dyn_cast<ExtractValueInst>(pointer);
+    if (!extract)
+      break;
+    pointer = FindInsertedValue(extract->getAggregateOperand(), extract->getIndices());
+    if (!pointer)
+      return false;
+  }
+
+  auto call = dyn_cast<CallInst>(pointer);
+  if (!call)
+    return false;
+  LgcIntrinsic kind = m_intrinsics.get(*call);
+  if (kind != LgcIntrinsic::DescriptorSet && kind != LgcIntrinsic::SpillTable)
+    return false;
+  key = DescriptorKey(call, offset.getZExtValue(), load->getType());
+  return true;
+}
+
+// =====================================================================================================================
+// Replaces all the loads of a descriptor with a single load at the end of the entry block, or with the first of them
+// if that is already in the entry block.
+//
+// @param descLoads : Loads of the descriptor
+void PatchDescriptorLoadHoist::hoistDescriptorLoads(DescriptorLoads &descLoads) {
+  Instruction *hoisted = descLoads.loads.front();
+  BasicBlock &entryBlock = hoisted->getFunction()->getEntryBlock();
+  if (hoisted->getParent() != &entryBlock) {
+    Instruction *insertPos = entryBlock.getTerminator();
+    if (auto load = dyn_cast<LoadInst>(hoisted)) {
+      // Re-derive the pointer in the entry block from the descriptor table pointer, which is already there.
+      DescriptorKey key;
+      getDescriptorKey(load, key);
+      IRBuilder<> builder(insertPos);
+      Value *pointer = builder.CreateBitCast(std::get<0>(key), builder.getInt8Ty()->getPointerTo(ADDR_SPACE_CONST));
+      pointer = builder.CreateConstGEP1_64(builder.getInt8Ty(), pointer, std::get<1>(key));
+      pointer = builder.CreateBitCast(pointer, load->getPointerOperandType());
+      Value *oldPointer = load->getPointerOperand();
+      load->moveBefore(insertPos);
+      load->setOperand(load->getPointerOperandIndex(), pointer);
+      RecursivelyDeleteTriviallyDeadInstructions(oldPointer);
+    } else
+      hoisted->moveBefore(insertPos);
+  }
+
+  for (Instruction *inst : makeArrayRef(descLoads.loads).drop_front()) {
+    Value *oldPointer = nullptr;
+    if (auto load = dyn_cast<LoadInst>(inst)) {
+      auto hoistedLoad = cast<LoadInst>(hoisted);
+      hoistedLoad->setAlignment(std::min(hoistedLoad->getAlign(), load->getAlign()));
+      combineMetadataForCSE(hoistedLoad, load, /*DoesKMove=*/true);
+      oldPointer = load->getPointerOperand();
+    }
+    inst->replaceAllUsesWith(hoisted);
+    inst->eraseFromParent();
+    if (oldPointer)
+      RecursivelyDeleteTriviallyDeadInstructions(oldPointer);
+  }
+}
+
+} // namespace lgc
+
+// =====================================================================================================================
+// Initializes the pass of LLVM patching operations for hoisting uniform descriptor loads.
+INITIALIZE_PASS_BEGIN(PatchDescriptorLoadHoist, DEBUG_TYPE, "Patch LLVM for hoisting uniform descriptor loads", false,
+                      false)
+INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
+INITIALIZE_PASS_END(PatchDescriptorLoadHoist, DEBUG_TYPE, "Patch LLVM for hoisting uniform descriptor loads", false,
+                    false)
@@ -0,0 +1,95 @@
+/*
+ ***********************************************************************************************************************
+ *
+ *  Copyright (c) 2020 Advanced Micro Devices, Inc. All Rights Reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ **********************************************************************************************************************/
+/**
+ ***********************************************************************************************************************
+ * @file  PatchDescriptorLoadHoist.h
+ * @brief LLPC header file: contains declaration of class lgc::PatchDescriptorLoadHoist.
+ ***********************************************************************************************************************
+ */
+#pragma once
+
+#include "lgc/patch/Patch.h"
+#include "lgc/util/LgcIntrinsics.h"
+#include "llvm/ADT/SmallVector.h"
+#include <map>
+#include <tuple>
+#include <vector>
+
+namespace llvm {
+
+class CallInst;
+class Instruction;
+class LoopInfo;
+class Type;
+class Value;
+
+} // namespace llvm
+
+namespace lgc {
+
+// =====================================================================================================================
+// Represents the pass of LLVM patching operations for hoisting uniform descriptor loads.
+//
+// The Builder materializes a descriptor load, and the descriptor table pointer it loads from, at each use site, so
+// the same descriptor is often reloaded in different basic blocks and loop bodies. This pass moves the descriptor
+// table pointers to the entry block with one call per table, then gives each descriptor loaded at a constant offset
+// from one of them a single load in the entry block, replacing all the others. Hoisted descriptors stay live in
+// SGPRs for the whole shader, so descriptors are hoisted in order of their loop-weighted use count only until an
+// SGPR budget is used up.
+class PatchDescriptorLoadHoist final : public llvm::FunctionPass {
+public:
+  PatchDescriptorLoadHoist();
+
+  void getAnalysisUsage(llvm::AnalysisUsage &analysisUsage) const override;
+  bool runOnFunction(llvm::Function &function) override;
+
+  static char ID; // ID of this pass
+
+private:
+  PatchDescriptorLoadHoist(const PatchDescriptorLoadHoist &) = delete;
+  PatchDescriptorLoadHoist &operator=(const PatchDescriptorLoadHoist &) = delete;
+
+  // Identifies a descriptor: the descriptor table pointer call (or the lgc.root.descriptor function) it is loaded
+  // from, the byte offset (or root dword offset) and the descriptor type.
+  typedef std::tuple<llvm::Value *, uint64_t, llvm::Type *> DescriptorKey;
+
+  // Represents all the loads of one descriptor in the function.
+  struct DescriptorLoads {
+    llvm::SmallVector<llvm::Instruction *, 4> loads; // Loads of the descriptor, in instruction order
+    unsigned weight;                                 // Sum of the loop-weighted use counts of the loads
+  };
+
+  bool hoistDescriptorTables(llvm::Function &function);
+  void gatherDescriptorLoads(llvm::Function &function);
+  bool getDescriptorKey(llvm::Instruction *inst, DescriptorKey &key);
+  void hoistDescriptorLoads(DescriptorLoads &descLoads);
+
+  LgcIntrinsicTable m_intrinsics;                   // Kinds of lgc.* functions
+  llvm::LoopInfo *m_loopInfo = nullptr;             // Loop info of the function
+  std::map<DescriptorKey, unsigned> m_descLoadsMap; // Map from descriptor to index in m_descLoads
+  std::vector<DescriptorLoads> m_descLoads;         // Loads of each descriptor, in order of first load
+};
+
+} // namespace lgc
@@ -41,7 +41,12 @@
 #include "lgc/state/PipelineState.h"
 #include "lgc/state/TargetInfo.h"
 #include "lgc/util/AddressExtender.h"
+#include "lgc/util/LgcIntrinsics.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/InstVisitor.h"
 #include "llvm/IR/IntrinsicsAMDGPU.h"
@@ -63,6 +68,11 @@ namespace cl {
 // GS on-chip behavior. In the future, if PAL allows hardcoded ES-GS LDS size, this option could be deprecated.
 opt<bool> InRegEsGsLdsSize("inreg-esgs-lds-size", desc("For GS on-chip, add esGsLdsSize in user data"), init(true));
 
+// -user-data-spill-weighting: When not all user data nodes fit in SGPRs in a graphics shader, keep the most heavily
+// used ones in SGPRs rather than the ones that come first in the user data layout.
+static opt<bool> UserDataSpillWeighting("user-data-spill-weighting",
+                                        desc("Choose user data nodes to spill by weighted usage"), init(true));
+
 } // namespace cl
 } // namespace llvm
 
@@ -91,7 +101,8 @@ private:
   struct UserDataArg {
     UserDataArg(Type *argTy, unsigned userDataValue = static_cast<unsigned>(UserDataMapping::Invalid),
                 unsigned *argIndex = nullptr, bool isPadding = false)
-        : argTy(argTy), userDataValue(userDataValue), argIndex(argIndex), isPadding(isPadding), mustSpill(false) {
+        : argTy(argTy), userDataValue(userDataValue), argIndex(argIndex), isPadding(isPadding), mustSpill(false),
+          weight(UINT_MAX) {
       if (isa<PointerType>(argTy))
         argDwordSize = argTy->getPointerAddressSpace() == ADDR_SPACE_CONST_32BIT ? 1 : 2;
       else
@@ -107,6 +118,7 @@ private:
     unsigned *argIndex;     // Where to store arg index once it is allocated, nullptr for none
     bool isPadding;         // Whether this is a padding arg to maintain fixed layout
     bool mustSpill;         // Whether this is an arg that must be spilled
+    unsigned weight;        // Usage weight when choosing args to spill, UINT_MAX for an arg to keep if at all possible
   };
 
   // User data usage for one user data node
@@ -162,6 +174,8 @@ private:
   unsigned addUserDataArg(SmallVectorImpl<UserDataArg> &userDataArgs, unsigned userDataValue, unsigned sizeInDwords,
                           unsigned *argIndex, bool useFixedLayout, unsigned userDataSize, IRBuilder<> &builder);
 
+  unsigned getUsageWeight(ArrayRef<Instruction *> users);
+
   void determineUnspilledUserDataArgs(ArrayRef<UserDataArg> userDataArgs, ArrayRef<UserDataArg> specialUserDataArgs,
                                       IRBuilder<> &builder, SmallVectorImpl<UserDataArg> &unspilledArgs);
 
@@ -178,6 +192,8 @@ private:
   PipelineState *m_pipelineState = nullptr; // Pipeline state from PipelineStateWrapper pass
   // Per-HW-shader-stage gathered user data usage information.
   SmallVector<std::unique_ptr<UserDataUsage>, ShaderStageCount> m_userDataUsage;
+  // Per-function loop info, built on demand while weighting user data args of the current shader.
+  DenseMap<Function *, std::unique_ptr<LoopInfo>> m_loopInfos;
 };
 
 } // anonymous namespace
@@ -252,9 +268,10 @@ void PatchEntryPointMutate::gatherUserDataUsage(Module *module) {
   // Also find lgc.output.export.xfb calls anywhere, indicating that the streamout table is needed in the
   // last vertex-processing stage.
   for (Function &func : *module) {
-    if (!func.isDeclaration())
+    LgcIntrinsic kind = LgcIntrinsicTable::classify(func);
+    if (kind == LgcIntrinsic::None)
       continue;
-    if (func.getName().startswith(lgcName::SpillTable)) {
+    if (kind == LgcIntrinsic::SpillTable) {
       for (User *user : func.users()) {
         CallInst *call = cast<CallInst>(user);
         ShaderStage stage = getShaderStage(call->getFunction());
@@ -264,7 +281,7 @@ void PatchEntryPointMutate::gatherUserDataUsage(Module *module) {
       continue;
     }
 
-    if (func.getName().startswith(lgcName::PushConst)) {
+    if (kind == LgcIntrinsic::PushConst) {
       for (User *user : func.users()) {
         // For this call to lgc.push.const, attempt to find all loads with a constant dword-aligned offset and
         // push into userDataUsage->pushConstOffsets. If we fail, set userDataUsage->pushConstSpill to indicate that
@@ -328,7 +345,7 @@ void PatchEntryPointMutate::gatherUserDataUsage(Module *module) {
       continue;
     }
 
-    if (func.getName().startswith(lgcName::RootDescriptor)) {
+    if (kind == LgcIntrinsic::RootDescriptor) {
       for (User *user : func.users()) {
         CallInst *call = cast<CallInst>(user);
         unsigned dwordOffset = cast<ConstantInt>(call->getArgOperand(0))->getZExtValue();
@@ -341,7 +358,7 @@ void PatchEntryPointMutate::gatherUserDataUsage(Module *module) {
       continue;
     }
 
-    if (func.getName().startswith(lgcName::SpecialUserData)) {
+    if (kind == LgcIntrinsic::SpecialUserData) {
       for (User *user : func.users()) {
         CallInst *call = cast<CallInst>(user);
         ShaderStage stage = getShaderStage(call->getFunction());
@@ -355,7 +372,7 @@ void PatchEntryPointMutate::gatherUserDataUsage(Module *module) {
       continue;
     }
 
-    if (func.getName().startswith(lgcName::DescriptorSet)) {
+    if (kind == LgcIntrinsic::DescriptorSet) {
       for (User *user : func.users()) {
         CallInst *call = cast<CallInst>(user);
         unsigned set = cast<ConstantInt>(call->getArgOperand(0))->getZExtValue();
@@ -365,7 +382,7 @@ void PatchEntryPointMutate::gatherUserDataUsage(Module *module) {
         descriptorSets.resize(std::max(descriptorSets.size(), size_t(set + 1)));
         descriptorSets[set].users.push_back(call);
       }
-    } else if (func.getName().startswith(lgcName::OutputExportXfb) && !func.use_empty()) {
+    } else if (kind == LgcIntrinsic::OutputExportXfb && !func.use_empty()) {
       auto lastVertexStage = m_pipelineState->getLastVertexProcessingStage();
       lastVertexStage = lastVertexStage == ShaderStageCopyShader ? ShaderStageGeometry : lastVertexStage;
       getUserDataUsage(lastVertexStage)->usesStreamOutTable = true;
@@ -764,6 +781,7 @@ uint64_t PatchEntryPointMutate::generateEntryPointArgTys(ShaderInputs *shaderInp
   addSpecialUserDataArgs(userDataArgs, specialUserDataArgs, builder);
 
   addUserDataArgs(userDataArgs, builder);
+  m_loopInfos.clear();
 
   // Determine which user data args are going to be "unspilled", and put them in unspilledArgs.
   SmallVector<UserDataArg, 8> unspilledArgs;
@@ -1048,6 +1066,7 @@ void PatchEntryPointMutate::addUserDataArgs(SmallVectorImpl<UserDataArg> &userDa
       // Add the arg (descriptor set pointer) that we can potentially unspill.
       userDataSize = addUserDataArg(userDataArgs, userDataValue, node.sizeInDwords, &descSetUsage.entryArgIdx,
                                     useFixedLayout, userDataSize, builder);
+      userDataArgs.back().weight = getUsageWeight(descSetUsage.users);
       break;
     }
 
@@ -1094,6 +1113,7 @@ void PatchEntryPointMutate::addUserDataArgs(SmallVectorImpl<UserDataArg> &userDa
         // Add the arg (part of the push const) that we can potentially unspill.
         userDataSize = addUserDataArg(userDataArgs, node.offsetInDwords + dwordOffset, pushConstOffset.dwordSize,
                                       &pushConstOffset.entryArgIdx, useFixedLayout, userDataSize, builder);
+        userDataArgs.back().weight = getUsageWeight(pushConstOffset.users);
       }
 
       // Ensure we mark the push constant's part of the spill table as used.
@@ -1131,6 +1151,7 @@ void PatchEntryPointMutate::addUserDataArgs(SmallVectorImpl<UserDataArg> &userDa
         // Add the arg (root descriptor) that we can potentially unspill.
         userDataSize = addUserDataArg(userDataArgs, dwordOffset, dwordSize, &rootDescUsage.entryArgIdx, useFixedLayout,
                                       userDataSize, builder);
+        userDataArgs.back().weight = getUsageWeight(rootDescUsage.users);
       }
       break;
     }
@@ -1168,6 +1189,63 @@ unsigned PatchEntryPointMutate::addUserDataArg(SmallVectorImpl<UserDataArg> &use
   return userDataSize;
 }
 
+// =====================================================================================================================
+// Get a weight estimating how heavily a user data node is used, for choosing which nodes to keep in SGPRs when
+// they do not all fit. The weight counts the memory accesses and calls that consume the node's value, found by
+// following the users of each of the node's own calls through the address and value computations in between. So
+// for a descriptor table or root descriptor it counts the descriptor loads, rather than the lgc.descriptor.set or
+// lgc.root.descriptor calls, which descriptor load hoisting merges into one call in the entry block however much
+// the table is used. Each access counts 8 times more per level of loop nesting, taking the deepest of the access
+// and its direct users, as a descriptor load may itself have been hoisted out of the loop that uses the descriptor.
+// The walk visits each instruction once, so it is linear in the size of the node's def-use graph.
+//
+// @param users : Instructions that read the user data node
+// @return : Usage weight, always less than UINT_MAX
+unsigned PatchEntryPointMutate::getUsageWeight(ArrayRef<Instruction *> users) {
+  auto getLoopDepth = [this](Instruction *inst) {
+    Function *func = inst->getFunction();
+    std::unique_ptr<LoopInfo> &loopInfo = m_loopInfos[func];
+    if (!loopInfo) {
+      DominatorTree domTree(*func);
+      loopInfo = std::make_unique<LoopInfo>(domTree);
+    }
+    return loopInfo->getLoopDepth(inst->getParent());
+  };
+
+  uint64_t weight = 0;
+  SmallPtrSet<Instruction *, 16> visited;
+  SmallVector<Instruction *, 8> worklist;
+  for (Instruction *user : users) {
+    // A push constant user is already the load of the dword; other users are the calls that produce the node's
+    // value, which are followed like any other computation.
+    if (isa<LoadInst>(user))
+      worklist.push_back(user);
+    else if (visited.insert(user).second) {
+      for (User *valueUser : user->users())
+        worklist.push_back(cast<Instruction>(valueUser));
+    }
+  }
+
+  while (!worklist.empty()) {
+    Instruction *inst = worklist.pop_back_val();
+    if (!visited.insert(inst).second)
+      continue;
+    if (!isa<LoadInst>(inst) && !isa<StoreInst>(inst) && !isa<AtomicRMWInst>(inst) &&
+        !isa<AtomicCmpXchgInst>(inst) && !isa<CallInst>(inst)) {
+      // An address or value computation: follow its users.
+      for (User *instUser : inst->users())
+        worklist.push_back(cast<Instruction>(instUser));
+      continue;
+    }
+
+    unsigned loopDepth = getLoopDepth(inst);
+    for (User *accessUser : inst->users())
+      loopDepth = std::max(loopDepth, getLoopDepth(cast<Instruction>(accessUser)));
+    weight += uint64_t(1) << std::min(3 * loopDepth, 15U);
+  }
+  return std::min(weight, uint64_t(UINT_MAX - 1));
+}
+
 // =====================================================================================================================
 // Determine which user data args are going to be "unspilled" (passed in shader entry SGPRs rather than loaded
 // from spill table)
@@ -1242,47 +1320,76 @@ void PatchEntryPointMutate::determineUnspilledUserDataArgs(ArrayRef<UserDataArg>
   bool useFixedLayout = m_shaderStage == ShaderStageCompute;
   unsigned userDataIdx = 0;
 
-  for (const UserDataArg &userDataArg : userDataArgs) {
-    unsigned afterUserDataIdx = userDataIdx + userDataArg.argDwordSize;
-    if (userDataArg.mustSpill || afterUserDataIdx > userDataEnd) {
-      // Spill this node. Allocate the spill table arg.
-      if (spillTableArg.empty()) {
-        spillTableArg.push_back(
-            UserDataArg(builder.getInt32Ty(), UserDataMapping::SpillTable, &userDataUsage->spillTable.entryArgIdx));
-        // Only decrement the number of available sgprs in a graphics shader. In a compute shader,
-        // the spill table arg goes in s12, beyond the s2-s11 range allowed for user data.
-        if (m_shaderStage != ShaderStageCompute)
-          --userDataEnd;
-
-        if (userDataIdx > userDataEnd) {
-          // We over-ran the available SGPRs by filling them up and then realizing we needed a spill table pointer.
-          // Remove the last unspilled node (and any padding arg before that), and ensure that spill usage is
-          // set correctly so that PAL metadata spill threshold is correct.
-          userDataIdx -= unspilledArgs.back().argDwordSize;
-          userDataUsage->spillUsage = std::min(userDataUsage->spillUsage, unspilledArgs.back().userDataValue);
-          unspilledArgs.pop_back();
-          if (!unspilledArgs.empty() && unspilledArgs.back().isPadding) {
-            userDataIdx -= unspilledArgs.back().argDwordSize;
-            unspilledArgs.pop_back();
-          }
-        }
+  if (!useFixedLayout) {
+    // For graphics shader, user data SGPRs can be in any order. If not everything fits, allocate the spill table
+    // pointer, then keep the args with the highest usage weight, in their original order, and spill the rest.
+    unsigned userDataSize = 0;
+    bool needSpill = false;
+    for (const UserDataArg &userDataArg : userDataArgs) {
+      userDataSize += userDataArg.argDwordSize;
+      needSpill |= userDataArg.mustSpill;
+    }
+    if ((needSpill || userDataSize > userDataEnd) && spillTableArg.empty()) {
+      spillTableArg.push_back(
+          UserDataArg(builder.getInt32Ty(), UserDataMapping::SpillTable, &userDataUsage->spillTable.entryArgIdx));
+      --userDataEnd;
+    }
+
+    SmallVector<unsigned, 8> argOrder;
+    for (unsigned argIdx = 0; argIdx != userDataArgs.size(); ++argIdx)
+      argOrder.push_back(argIdx);
+    if (cl::UserDataSpillWeighting) {
+      std::stable_sort(argOrder.begin(), argOrder.end(), [userDataArgs](unsigned lhs, unsigned rhs) {
+        return userDataArgs[lhs].weight > userDataArgs[rhs].weight;
+      });
+    }
+
+    SmallVector<bool, 8> isUnspilled(userDataArgs.size(), false);
+    for (unsigned argIdx : argOrder) {
+      const UserDataArg &userDataArg = userDataArgs[argIdx];
+      if (!userDataArg.mustSpill && userDataIdx + userDataArg.argDwordSize <= userDataEnd) {
+        isUnspilled[argIdx] = true;
+        userDataIdx += userDataArg.argDwordSize;
       }
-      // Ensure that spillUsage includes this offset. (We might be on a compute shader padding node, in which
-      // case userDataArg.userDataValue is Invalid, and this call has no effect.)
-      userDataUsage->spillUsage = std::min(userDataUsage->spillUsage, userDataArg.userDataValue);
-
-      if (useFixedLayout) {
-        // On a compute shader, on spilling, stop trying to allocate nodes to SGPRs. If we didn't do this, a
-        // later node that is smaller than the current one might succeed in not spilling, but that would be wrong
-        // because it would not have the right padding before it for fixed layout.
-        break;
+    }
+
+    for (unsigned argIdx = 0; argIdx != userDataArgs.size(); ++argIdx) {
+      const UserDataArg &userDataArg = userDataArgs[argIdx];
+      if (userDataArg.userDataValue != static_cast<unsigned>(UserDataMapping::Invalid)) {
+        LLVM_DEBUG(dbgs() << getShaderStageAbbreviation(m_shaderStage) << " user data 0x"
+                          << Twine::utohexstr(userDataArg.userDataValue) << " (" << userDataArg.argDwordSize
+                          << " dwords, weight " << userDataArg.weight
+                          << "): " << (isUnspilled[argIdx] ? "SGPR" : "spilled") << "\n");
       }
+      if (isUnspilled[argIdx])
+        unspilledArgs.push_back(userDataArg);
+      else
+        userDataUsage->spillUsage = std::min(userDataUsage->spillUsage, userDataArg.userDataValue);
+    }
+  } else {
+    // For compute shader fixed layout, keep args in order until we reach one that needs to be spilled.
+    for (const UserDataArg &userDataArg : userDataArgs) {
+      unsigned afterUserDataIdx = userDataIdx + userDataArg.argDwordSize;
+      if (userDataArg.mustSpill || afterUserDataIdx > userDataEnd) {
+        // Spill this node. Allocate the spill table arg. It goes in s12, beyond the s2-s11 range allowed for
+        // user data, so it does not reduce the number of available sgprs.
+        if (spillTableArg.empty()) {
+          spillTableArg.push_back(
+              UserDataArg(builder.getInt32Ty(), UserDataMapping::SpillTable, &userDataUsage->spillTable.entryArgIdx));
+        }
+        // Ensure that spillUsage includes this offset. (We might be on a padding node, in which case
+        // userDataArg.userDataValue is Invalid, and this call has no effect.)
+        userDataUsage->spillUsage = std::min(userDataUsage->spillUsage, userDataArg.userDataValue);
 
-      continue;
+        // On spilling, stop trying to allocate nodes to SGPRs. If we didn't do this, a later node that is smaller
+        // than the current one might succeed in not spilling, but that would be wrong because it would not have
+        // the right padding before it for fixed layout.
+        break;
+      }
+      // Keep this node on the unspilled list.
+      userDataIdx = afterUserDataIdx;
+      unspilledArgs.push_back(userDataArg);
     }
-    // Keep this node on the unspilled list.
-    userDataIdx = afterUserDataIdx;
-    unspilledArgs.push_back(userDataArg);
   }
 
   // Remove trailing padding nodes (compute shader).
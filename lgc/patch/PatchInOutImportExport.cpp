@@ -36,6 +36,7 @@
 #include "lgc/state/AbiUnlinked.h"
 #include "lgc/state/PipelineShaders.h"
 #include "lgc/util/Debug.h"
+#include "lgc/util/LgcIntrinsics.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/IntrinsicsAMDGPU.h"
 #include "llvm/Support/Debug.h"
@@ -98,6 +99,7 @@ bool PatchInOutImportExport::runOnModule(Module &module) {
   m_pipelineState = getAnalysis<PipelineStateWrapper>().getPipelineState(&module);
   m_gfxIp = m_pipelineState->getTargetInfo().getGfxIpVersion();
   m_pipelineSysValues.initialize(m_pipelineState);
+  m_intrinsics.clear();
 
   const unsigned stageMask = m_pipelineState->getShaderStageMask();
   m_hasTs = (stageMask & (shaderStageToMask(ShaderStageTessControl) | shaderStageToMask(ShaderStageTessEval))) != 0;
@@ -313,30 +315,20 @@ void PatchInOutImportExport::visitCallInst(CallInst &callInst) {
   IRBuilder<> builder(*m_context);
   auto resUsage = m_pipelineState->getShaderResourceUsage(m_shaderStage);
 
-  auto mangledName = callee->getName();
+  LgcIntrinsic kind = m_intrinsics.get(callee);
 
-  auto importGenericInput = lgcName::InputImportGeneric;
-  auto importBuiltInInput = lgcName::InputImportBuiltIn;
-  auto importInterpolantInput = lgcName::InputImportInterpolant;
-  auto importGenericOutput = lgcName::OutputImportGeneric;
-  auto importBuiltInOutput = lgcName::OutputImportBuiltIn;
-
-  const bool isGenericInputImport = mangledName.startswith(importGenericInput);
-  const bool isBuiltInInputImport = mangledName.startswith(importBuiltInInput);
-  const bool isInterpolantInputImport = mangledName.startswith(importInterpolantInput);
-  const bool isGenericOutputImport = mangledName.startswith(importGenericOutput);
-  const bool isBuiltInOutputImport = mangledName.startswith(importBuiltInOutput);
+  const bool isGenericInputImport = kind == LgcIntrinsic::InputImportGeneric;
+  const bool isBuiltInInputImport = kind == LgcIntrinsic::InputImportBuiltIn;
+  const bool isInterpolantInputImport = kind == LgcIntrinsic::InputImportInterpolant;
+  const bool isGenericOutputImport = kind == LgcIntrinsic::OutputImportGeneric;
+  const bool isBuiltInOutputImport = kind == LgcIntrinsic::OutputImportBuiltIn;
 
   const bool isImport = (isGenericInputImport || isBuiltInInputImport || isInterpolantInputImport ||
                          isGenericOutputImport || isBuiltInOutputImport);
 
-  auto exportGenericOutput = lgcName::OutputExportGeneric;
-  auto exportBuiltInOutput = lgcName::OutputExportBuiltIn;
-  auto exportXfbOutput = lgcName::OutputExportXfb;
-
-  const bool isGenericOutputExport = mangledName.startswith(exportGenericOutput);
-  const bool isBuiltInOutputExport = mangledName.startswith(exportBuiltInOutput);
-  const bool isXfbOutputExport = mangledName.startswith(exportXfbOutput);
+  const bool isGenericOutputExport = kind == LgcIntrinsic::OutputExportGeneric;
+  const bool isBuiltInOutputExport = kind == LgcIntrinsic::OutputExportBuiltIn;
+  const bool isXfbOutputExport = kind == LgcIntrinsic::OutputExportXfb;
 
   const bool isExport = (isGenericOutputExport || isBuiltInOutputExport || isXfbOutputExport);
 
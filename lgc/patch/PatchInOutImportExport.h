@@ -36,6 +36,7 @@
 #include "lgc/state/PipelineShaders.h"
 #include "lgc/state/PipelineState.h"
 #include "lgc/state/TargetInfo.h"
+#include "lgc/util/LgcIntrinsics.h"
 #include "llvm/IR/InstVisitor.h"
 #include <set>
 
@@ -201,6 +202,7 @@ private:
 
   GfxIpVersion m_gfxIp;                     // Graphics IP version info
   PipelineSystemValues m_pipelineSysValues; // Cache of ShaderSystemValues objects, one per shader stage
+  LgcIntrinsicTable m_intrinsics;           // Kinds of called lgc.* functions
 
   FragColorExport *m_fragColorExport; // Fragment color export manager
 
@@ -39,6 +39,7 @@
 #include "lgc/state/PipelineState.h"
 #include "lgc/state/TargetInfo.h"
 #include "lgc/util/Debug.h"
+#include "lgc/util/LgcIntrinsics.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
@@ -87,6 +88,7 @@ bool PatchResourceCollect::runOnModule(Module &module) {
     scalarizeForInOutPacking(&module);
 
   // Process each shader stage, in reverse order.
+  m_intrinsics.clear();
   for (int shaderStage = ShaderStageCountInternal - 1; shaderStage >= 0; --shaderStage) {
     m_entryPoint = m_pipelineShaders->getEntryPoint(static_cast<ShaderStage>(shaderStage));
     if (m_entryPoint) {
@@ -1088,11 +1090,13 @@ void PatchResourceCollect::visitCallInst(CallInst &callInst) {
   if (!callee)
     return;
 
-  bool isDeadCall = callInst.user_empty();
+  LgcIntrinsic kind = m_intrinsics.get(callee);
+  if (kind == LgcIntrinsic::None)
+    return;
 
-  auto mangledName = callee->getName();
+  bool isDeadCall = callInst.user_empty();
 
-  if (mangledName.startswith(lgcName::InputImportGeneric)) {
+  if (kind == LgcIntrinsic::InputImportGeneric) {
     // Generic input import
     if (isDeadCall)
       m_deadCalls.push_back(&callInst);
@@ -1142,7 +1146,7 @@ void PatchResourceCollect::visitCallInst(CallInst &callInst) {
         }
       }
     }
-  } else if (mangledName.startswith(lgcName::InputImportInterpolant)) {
+  } else if (kind == LgcIntrinsic::InputImportInterpolant) {
     // Interpolant input import
     assert(m_shaderStage == ShaderStageFragment);
 
@@ -1164,7 +1168,7 @@ void PatchResourceCollect::visitCallInst(CallInst &callInst) {
         m_hasDynIndexedInput = true;
       }
     }
-  } else if (mangledName.startswith(lgcName::InputImportBuiltIn)) {
+  } else if (kind == LgcIntrinsic::InputImportBuiltIn) {
     // Built-in input import
     if (isDeadCall)
       m_deadCalls.push_back(&callInst);
@@ -1172,7 +1176,7 @@ void PatchResourceCollect::visitCallInst(CallInst &callInst) {
       unsigned builtInId = cast<ConstantInt>(callInst.getOperand(0))->getZExtValue();
       m_activeInputBuiltIns.insert(builtInId);
     }
-  } else if (mangledName.startswith(lgcName::OutputImportGeneric)) {
+  } else if (kind == LgcIntrinsic::OutputImportGeneric) {
     // Generic output import
     assert(m_shaderStage == ShaderStageTessControl);
 
@@ -1210,13 +1214,13 @@ void PatchResourceCollect::visitCallInst(CallInst &callInst) {
       // NOTE: If location offset is not constant, we treat this as dynamic indexing.
       m_hasDynIndexedOutput = true;
     }
-  } else if (mangledName.startswith(lgcName::OutputImportBuiltIn)) {
+  } else if (kind == LgcIntrinsic::OutputImportBuiltIn) {
     // Built-in output import
     assert(m_shaderStage == ShaderStageTessControl);
 
     unsigned builtInId = cast<ConstantInt>(callInst.getOperand(0))->getZExtValue();
     m_importedOutputBuiltIns.insert(builtInId);
-  } else if (mangledName.startswith(lgcName::OutputExportGeneric)) {
+  } else if (kind == LgcIntrinsic::OutputExportGeneric) {
     // Generic output export
     if (m_shaderStage == ShaderStageTessControl) {
       auto output = callInst.getOperand(callInst.getNumArgOperands() - 1);
@@ -1239,7 +1243,7 @@ void PatchResourceCollect::visitCallInst(CallInst &callInst) {
         m_hasDynIndexedOutput = true;
       }
     }
-  } else if (mangledName.startswith(lgcName::OutputExportBuiltIn)) {
+  } else if (kind == LgcIntrinsic::OutputExportBuiltIn) {
     // NOTE: If output value is undefined one, we can safely drop it and remove the output export call.
     // Currently, do this for geometry shader.
     if (m_shaderStage == ShaderStageGeometry) {
@@ -1255,12 +1259,12 @@ void PatchResourceCollect::visitCallInst(CallInst &callInst) {
 
   if (m_pipelineState->isPackInOut()) {
     if (m_shaderStage == ShaderStageFragment && !isDeadCall &&
-        (mangledName.startswith(lgcName::InputImportGeneric) ||
-         mangledName.startswith(lgcName::InputImportInterpolant))) {
+        (kind == LgcIntrinsic::InputImportGeneric ||
+         kind == LgcIntrinsic::InputImportInterpolant)) {
       // Collect LocationSpans according to each FS' input call
       m_locationMapManager->addSpan(&callInst);
       m_inOutCalls.push_back(&callInst);
-    } else if (m_shaderStage == ShaderStageVertex && mangledName.startswith(lgcName::OutputExportGeneric)) {
+    } else if (m_shaderStage == ShaderStageVertex && kind == LgcIntrinsic::OutputExportGeneric) {
       m_inOutCalls.push_back(&callInst);
       m_deadCalls.push_back(&callInst);
     }
@@ -2710,8 +2714,8 @@ void PatchResourceCollect::scalarizeForInOutPacking(Module *module) {
   SmallVector<CallInst *, 4> vsOutputCalls;
   SmallVector<CallInst *, 4> fsInputCalls;
   for (Function &func : *module) {
-    if (func.getName().startswith(lgcName::InputImportGeneric) ||
-        func.getName().startswith(lgcName::InputImportInterpolant)) {
+    LgcIntrinsic kind = LgcIntrinsicTable::classify(func);
+    if (kind == LgcIntrinsic::InputImportGeneric || kind == LgcIntrinsic::InputImportInterpolant) {
       // This is a generic (possibly interpolated) input. Find its uses in FS.
       for (User *user : func.users()) {
         auto call = cast<CallInst>(user);
@@ -2721,7 +2725,7 @@ void PatchResourceCollect::scalarizeForInOutPacking(Module *module) {
         if (isa<VectorType>(call->getType()) || call->getType()->getPrimitiveSizeInBits() == 64)
           fsInputCalls.push_back(call);
       }
-    } else if (func.getName().startswith(lgcName::OutputExportGeneric)) {
+    } else if (kind == LgcIntrinsic::OutputExportGeneric) {
       // This is a generic output. Find its uses in the last vertex processing stage.
       for (User *user : func.users()) {
         auto call = cast<CallInst>(user);
@@ -33,6 +33,7 @@
 #include "lgc/patch/Patch.h"
 #include "lgc/state/PipelineShaders.h"
 #include "lgc/state/PipelineState.h"
+#include "lgc/util/LgcIntrinsics.h"
 #include "llvm/IR/InstVisitor.h"
 #include <unordered_set>
 
@@ -98,6 +99,7 @@ private:
   PipelineState *m_pipelineState;     // Pipeline state
 
   std::vector<llvm::CallInst *> m_deadCalls; // Dead calls
+  LgcIntrinsicTable m_intrinsics;            // Kinds of called lgc.* functions
 
   std::unordered_set<unsigned> m_activeInputLocs;      // Locations of active generic inputs
   std::unordered_set<unsigned> m_activeInputBuiltIns;  // IDs of active built-in inputs
@@ -38,15 +38,25 @@
 #include "lgc/state/PipelineState.h"
 #include "lgc/state/TargetInfo.h"
 #include "lgc/util/Internal.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include <map>
+#include <tuple>
 
 #define DEBUG_TYPE "lgc-vertex-fetch"
 
 using namespace lgc;
 using namespace llvm;
 
+// -coalesce-vertex-fetches: fetch vertex inputs that are contiguous in the same binding with combined loads
+static cl::opt<bool> CoalesceVertexFetches("coalesce-vertex-fetches",
+                                           cl::desc("Fetch vertex inputs that are contiguous in the same binding with "
+                                                    "combined loads"),
+                                           cl::init(false));
+
 namespace lgc {
 class BuilderBase;
 class PipelineState;
@@ -102,9 +112,29 @@ public:
   Value *fetchVertex(Type *inputTy, const VertexInputDescription *description, unsigned location, unsigned compIdx,
                      BuilderBase &builder) override;
 
+  // Lower the vertex fetch calls of vertex inputs that can share a combined load
+  void coalesceVertexFetches(PipelineState *pipelineState, SmallVectorImpl<CallInst *> &vertexFetches,
+                             BuilderBase &builder) override;
+
 private:
+  // Represents a vertex input that may be fetched as part of a combined load, with the calls that fetch it.
+  struct CoalescableInput {
+    const VertexInputDescription *description; // Vertex input description
+    const VertexCompFormatInfo *formatInfo;    // Component info of the vertex input data format
+    SmallVector<CallInst *, 2> calls;          // Vertex fetch calls of this input
+  };
+
   void initialize(PipelineState *pipelineState);
 
+  Value *getVertexBufferIndex(const VertexInputDescription *description, BuilderBase &builder);
+
+  Value *convertVertexFetch(Type *inputTy, Value *vertexFetch, unsigned location, unsigned compIdx,
+                            Instruction *insertPos) const;
+
+  static unsigned getCombinedFormat(unsigned compDfmt, unsigned compCount);
+
+  void fetchCombined(ArrayRef<CoalescableInput *> inputs, unsigned dfmt, BuilderBase &builder);
+
   static VertexFormatInfo getVertexFormatInfo(const VertexInputDescription *description);
 
   // Gets variable corresponding to vertex index
@@ -379,7 +409,11 @@ bool LowerVertexFetch::runOnModule(Module &module) {
 
   if (!pipelineState->isUnlinked() || !pipelineState->getVertexInputDescriptions().empty()) {
     // Whole-pipeline compilation (or shader compilation where we were given the vertex input descriptions).
-    // Lower each vertex fetch.
+    // First lower the vertex fetches of vertex inputs that can share a combined load, then lower each remaining
+    // vertex fetch.
+    if (CoalesceVertexFetches)
+      vertexFetch->coalesceVertexFetches(pipelineState, vertexFetches, builder);
+
     for (CallInst *call : vertexFetches) {
       Value *vertex = nullptr;
 
@@ -544,46 +578,15 @@ VertexFetchImpl::VertexFetchImpl(LgcContext *lgcContext)
 // @param builder : Builder to use to insert vertex fetch instructions
 Value *VertexFetchImpl::fetchVertex(Type *inputTy, const VertexInputDescription *description, unsigned location,
                                     unsigned compIdx, BuilderBase &builder) {
-  Value *vertex = nullptr;
   Instruction *insertPos = &*builder.GetInsertPoint();
   auto vbDesc = loadVertexBufferDescriptor(description->binding, builder);
-
-  Value *vbIndex = nullptr;
-  if (description->inputRate == VertexInputRateVertex) {
-    // Use vertex index
-    if (!m_vertexIndex) {
-      auto savedInsertPoint = builder.saveIP();
-      builder.SetInsertPoint(&*insertPos->getFunction()->front().getFirstInsertionPt());
-      m_vertexIndex = ShaderInputs::getVertexIndex(builder);
-      builder.restoreIP(savedInsertPoint);
-    }
-    vbIndex = m_vertexIndex;
-  } else {
-    if (description->inputRate == VertexInputRateNone) {
-      vbIndex = ShaderInputs::getSpecialUserData(UserDataMapping::BaseInstance, builder);
-    } else if (description->inputRate == VertexInputRateInstance) {
-      // Use instance index
-      if (!m_instanceIndex) {
-        auto savedInsertPoint = builder.saveIP();
-        builder.SetInsertPoint(&*insertPos->getFunction()->front().getFirstInsertionPt());
-        m_instanceIndex = ShaderInputs::getInstanceIndex(builder);
-        builder.restoreIP(savedInsertPoint);
-      }
-      vbIndex = m_instanceIndex;
-    } else {
-      // There is a divisor.
-      vbIndex = builder.CreateUDiv(ShaderInputs::getInput(ShaderInput::InstanceId, builder),
-                                   builder.getInt32(description->inputRate));
-      vbIndex = builder.CreateAdd(vbIndex, ShaderInputs::getSpecialUserData(UserDataMapping::BaseInstance, builder));
-    }
-  }
+  Value *vbIndex = getVertexBufferIndex(description, builder);
 
   Value *vertexFetches[2] = {}; // Two vertex fetch operations might be required
   Value *vertexFetch = nullptr; // Coalesced vector by combining the results of two vertex fetch operations
 
   VertexFormatInfo formatInfo = getVertexFormatInfo(description);
 
-  const bool is8bitFetch = (inputTy->getScalarSizeInBits() == 8);
   const bool is16bitFetch = (inputTy->getScalarSizeInBits() == 16);
 
   // Do the first vertex fetch operation
@@ -718,7 +721,24 @@ Value *VertexFetchImpl::fetchVertex(Type *inputTy, const VertexInputDescription
   } else
     vertexFetch = vertexFetches[0];
 
-  // Finalize vertex fetch
+  return convertVertexFetch(inputTy, vertexFetch, location, compIdx, insertPos);
+}
+
+// =====================================================================================================================
+// Converts the result of a vertex fetch, as <n x i32> or i32, to the type of a vertex input, taking the components
+// starting at the given index and filling missing components with default values.
+//
+// @param inputTy : Type of vertex input
+// @param vertexFetch : Result of the vertex fetch
+// @param location : Vertex input location (only used for an IR name, not for functionality)
+// @param compIdx : Index used for vector element indexing
+// @param insertPos : Where to insert instructions
+Value *VertexFetchImpl::convertVertexFetch(Type *inputTy, Value *vertexFetch, unsigned location, unsigned compIdx,
+                                           Instruction *insertPos) const {
+  Value *vertex = nullptr;
+  const bool is8bitFetch = (inputTy->getScalarSizeInBits() == 8);
+  const bool is16bitFetch = (inputTy->getScalarSizeInBits() == 16);
+
   Type *basicTy = inputTy->isVectorTy() ? cast<VectorType>(inputTy)->getElementType() : inputTy;
   const unsigned bitWidth = basicTy->getScalarSizeInBits();
   assert(bitWidth == 8 || bitWidth == 16 || bitWidth == 32 || bitWidth == 64);
@@ -833,6 +853,212 @@ Value *VertexFetchImpl::fetchVertex(Type *inputTy, const VertexInputDescription
   return vertex;
 }
 
+// =====================================================================================================================
+// Lowers the vertex fetches of vertex inputs that lie next to each other in the same vertex buffer binding with
+// combined vertex fetch operations, so that each such run of vertex inputs costs a single load rather than one load
+// per vertex input. The lowered calls are erased and removed from the list; the remaining calls are left for
+// fetchVertex.
+//
+// @param pipelineState : Pipeline state
+// @param [in/out] vertexFetches : Vertex fetch calls
+// @param builder : Builder to use to insert vertex fetch instructions
+void VertexFetchImpl::coalesceVertexFetches(PipelineState *pipelineState, SmallVectorImpl<CallInst *> &vertexFetches,
+                                            BuilderBase &builder) {
+  // Gather the vertex inputs whose data format has 16-bit or 32-bit components, along with their vertex fetch
+  // calls. Only calls in the entry block are considered, so that the combined fetch dominates all of them. A vertex
+  // input that is read as a 16-bit type is excluded as it uses a different kind of vertex fetch.
+  std::map<unsigned, CoalescableInput> inputs;
+  SmallVector<unsigned, 4> excludedLocations;
+  for (CallInst *call : vertexFetches) {
+    unsigned location = cast<ConstantInt>(call->getArgOperand(0))->getZExtValue();
+    const VertexInputDescription *description = pipelineState->findVertexInputDescription(location);
+    if (!description || description->dfmt > BufDataFormat32_32_32_32)
+      continue;
+    const VertexCompFormatInfo *formatInfo = getVertexComponentFormatInfo(description->dfmt);
+    if ((formatInfo->compDfmt != BUF_DATA_FORMAT_16 && formatInfo->compDfmt != BUF_DATA_FORMAT_32) ||
+        call->getType()->getScalarSizeInBits() == 16 || call->getParent() != &call->getFunction()->front()) {
+      excludedLocations.push_back(location);
+      continue;
+    }
+    CoalescableInput &input = inputs[location];
+    input.description = description;
+    input.formatInfo = formatInfo;
+    input.calls.push_back(call);
+  }
+  for (unsigned location : excludedLocations)
+    inputs.erase(location);
+
+  // Group the vertex inputs by everything other than offset that affects the vertex fetch.
+  std::map<std::tuple<unsigned, unsigned, unsigned, unsigned, unsigned>, SmallVector<CoalescableInput *, 4>> groups;
+  for (auto &entry : inputs) {
+    const VertexInputDescription *description = entry.second.description;
+    groups[std::make_tuple(description->binding, description->stride, description->inputRate, description->nfmt,
+                           entry.second.formatInfo->compDfmt)]
+        .push_back(&entry.second);
+  }
+
+  SmallPtrSet<CallInst *, 8> loweredCalls;
+  for (auto &group : groups) {
+    SmallVectorImpl<CoalescableInput *> &groupInputs = group.second;
+    if (groupInputs.size() < 2)
+      continue;
+    llvm::sort(groupInputs, [](const CoalescableInput *lhs, const CoalescableInput *rhs) {
+      return lhs->description->offset < rhs->description->offset;
+    });
+
+    for (unsigned first = 0; first != groupInputs.size();) {
+      // Extend the run of vertex inputs while the next one starts where the previous one ends and all of them
+      // still fit in a single vertex fetch.
+      unsigned compCount = groupInputs[first]->formatInfo->compCount;
+      unsigned last = first;
+      while (last + 1 != groupInputs.size()) {
+        const CoalescableInput *prev = groupInputs[last];
+        const CoalescableInput *next = groupInputs[last + 1];
+        if (next->description->offset != prev->description->offset + prev->formatInfo->vertexByteSize ||
+            compCount + next->formatInfo->compCount > 4)
+          break;
+        compCount += next->formatInfo->compCount;
+        ++last;
+      }
+
+      // Shrink the run until the combined data format exists and the combined vertex fetch does not have to be
+      // split into per-component fetches.
+      unsigned dfmt = BUF_DATA_FORMAT_INVALID;
+      for (; last != first; compCount -= groupInputs[last--]->formatInfo->compCount) {
+        dfmt = getCombinedFormat(groupInputs[first]->formatInfo->compDfmt, compCount);
+        if (dfmt == BUF_DATA_FORMAT_INVALID)
+          continue;
+        unsigned vertexByteSize = getVertexComponentFormatInfo(dfmt)->vertexByteSize;
+        if (groupInputs[first]->description->offset % vertexByteSize == 0 &&
+            groupInputs[first]->description->stride % vertexByteSize == 0)
+          break;
+      }
+
+      if (last == first) {
+        ++first;
+        continue;
+      }
+
+      ArrayRef<CoalescableInput *> run = makeArrayRef(groupInputs).slice(first, last + 1 - first);
+      fetchCombined(run, dfmt, builder);
+      for (const CoalescableInput *input : run)
+        loweredCalls.insert(input->calls.begin(), input->calls.end());
+      first = last + 1;
+    }
+  }
+
+  vertexFetches.erase(
+      std::remove_if(vertexFetches.begin(), vertexFetches.end(),
+                     [&loweredCalls](CallInst *call) { return loweredCalls.count(call) != 0; }),
+      vertexFetches.end());
+}
+
+// =====================================================================================================================
+// Gets the data format whose components have the specified data format, or BUF_DATA_FORMAT_INVALID if there is no
+// such data format.
+//
+// @param compDfmt : Data format of each component
+// @param compCount : Component count
+unsigned VertexFetchImpl::getCombinedFormat(unsigned compDfmt, unsigned compCount) {
+  for (unsigned dfmt = 0; dfmt != sizeof(MVertexCompFormatInfo) / sizeof(MVertexCompFormatInfo[0]); ++dfmt) {
+    if (MVertexCompFormatInfo[dfmt].compDfmt == compDfmt && MVertexCompFormatInfo[dfmt].compCount == compCount)
+      return dfmt;
+  }
+  return BUF_DATA_FORMAT_INVALID;
+}
+
+// =====================================================================================================================
+// Fetches a run of contiguous vertex inputs with a single vertex fetch operation, then replaces the vertex fetch
+// calls of each vertex input with its components of the combined result.
+//
+// @param inputs : Vertex inputs in order of offset
+// @param dfmt : Combined data format of vertex buffer
+// @param builder : Builder to use to insert vertex fetch instructions
+void VertexFetchImpl::fetchCombined(ArrayRef<CoalescableInput *> inputs, unsigned dfmt, BuilderBase &builder) {
+  // Insert the combined vertex fetch before the first of the calls.
+  CallInst *firstCall = nullptr;
+  for (const CoalescableInput *input : inputs) {
+    for (CallInst *call : input->calls) {
+      if (!firstCall || call->comesBefore(firstCall))
+        firstCall = call;
+    }
+  }
+  builder.SetInsertPoint(firstCall);
+
+  const VertexInputDescription *description = inputs.front()->description;
+  auto vbDesc = loadVertexBufferDescriptor(description->binding, builder);
+  Value *vbIndex = getVertexBufferIndex(description, builder);
+
+  Value *combinedFetch = nullptr;
+  addVertexFetchInst(vbDesc, getVertexComponentFormatInfo(dfmt)->compCount, false, vbIndex, description->offset,
+                     description->stride, dfmt, description->nfmt, firstCall, &combinedFetch);
+
+  unsigned compIdx = 0;
+  for (const CoalescableInput *input : inputs) {
+    // Take the components of this vertex input out of the combined result.
+    unsigned compCount = input->formatInfo->compCount;
+    Value *vertexFetch = nullptr;
+    if (compCount == 1) {
+      vertexFetch = ExtractElementInst::Create(combinedFetch, ConstantInt::get(Type::getInt32Ty(*m_context), compIdx),
+                                               "", firstCall);
+    } else {
+      SmallVector<Constant *, 4> shuffleMask;
+      for (unsigned i = 0; i != compCount; ++i)
+        shuffleMask.push_back(ConstantInt::get(Type::getInt32Ty(*m_context), compIdx + i));
+      vertexFetch =
+          new ShuffleVectorInst(combinedFetch, combinedFetch, ConstantVector::get(shuffleMask), "", firstCall);
+    }
+    compIdx += compCount;
+
+    for (CallInst *call : input->calls) {
+      unsigned location = cast<ConstantInt>(call->getArgOperand(0))->getZExtValue();
+      unsigned component = cast<ConstantInt>(call->getArgOperand(1))->getZExtValue();
+      Value *vertex = convertVertexFetch(call->getType(), vertexFetch, location, component, call);
+      call->replaceAllUsesWith(vertex);
+      call->eraseFromParent();
+    }
+  }
+}
+
+// =====================================================================================================================
+// Gets the index of the vertex buffer element to fetch a vertex input from.
+//
+// @param description : Vertex input description
+// @param builder : Builder with insert point set
+Value *VertexFetchImpl::getVertexBufferIndex(const VertexInputDescription *description, BuilderBase &builder) {
+  Instruction *insertPos = &*builder.GetInsertPoint();
+  Value *vbIndex = nullptr;
+  if (description->inputRate == VertexInputRateVertex) {
+    // Use vertex index
+    if (!m_vertexIndex) {
+      auto savedInsertPoint = builder.saveIP();
+      builder.SetInsertPoint(&*insertPos->getFunction()->front().getFirstInsertionPt());
+      m_vertexIndex = ShaderInputs::getVertexIndex(builder);
+      builder.restoreIP(savedInsertPoint);
+    }
+    vbIndex = m_vertexIndex;
+  } else {
+    if (description->inputRate == VertexInputRateNone) {
+      vbIndex = ShaderInputs::getSpecialUserData(UserDataMapping::BaseInstance, builder);
+    } else if (description->inputRate == VertexInputRateInstance) {
+      // Use instance index
+      if (!m_instanceIndex) {
+        auto savedInsertPoint = builder.saveIP();
+        builder.SetInsertPoint(&*insertPos->getFunction()->front().getFirstInsertionPt());
+        m_instanceIndex = ShaderInputs::getInstanceIndex(builder);
+        builder.restoreIP(savedInsertPoint);
+      }
+      vbIndex = m_instanceIndex;
+    } else {
+      // There is a divisor.
+      vbIndex = builder.CreateUDiv(ShaderInputs::getInput(ShaderInput::InstanceId, builder),
+                                   builder.getInt32(description->inputRate));
+      vbIndex = builder.CreateAdd(vbIndex, ShaderInputs::getSpecialUserData(UserDataMapping::BaseInstance, builder));
+    }
+  }
+  return vbIndex;
+}
+
 // =====================================================================================================================
 // Gets info from table according to vertex attribute format.
 //
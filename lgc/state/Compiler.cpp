@@ -28,26 +28,44 @@
  * @brief LLPC source file: PipelineState methods that do IR linking and compilation
  ***********************************************************************************************************************
  */
+#include "lgc/ElfLinker.h"
 #include "lgc/LgcContext.h"
 #include "lgc/PassManager.h"
 #include "lgc/patch/Patch.h"
 #include "lgc/state/PipelineState.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/IR/IRPrintingPasses.h"
 #include "llvm/Linker/Linker.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Timer.h"
 #include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include <thread>
 
 #define DEBUG_TYPE "lgc-compiler"
 
 using namespace lgc;
 using namespace llvm;
 
+STATISTIC(NumPerStageCodeGen, "Number of pipelines whose hardware stages were code generated separately and linked");
+STATISTIC(NumPerStageFallbacks, "Number of pipelines where linking the stage ELFs failed and the whole module was "
+                                "code generated instead");
+
+// -parallel-codegen: split a graphics pipeline per hardware shader stage for backend codegen
+static cl::opt<bool> ParallelCodeGen("parallel-codegen",
+                                     cl::desc("Split a graphics pipeline per hardware shader stage after patching, "
+                                              "and run backend codegen for each stage on its own thread"),
+                                     cl::init(false));
+
 namespace lgc {
 // Create BuilderReplayer pass
 ModulePass *createBuilderReplayer(Pipeline *pipeline);
-ElfLinker *createElfLinkerImpl(PipelineState *pipelineState, llvm::ArrayRef<llvm::MemoryBufferRef> elfs);
+ElfLinker *createElfLinkerImpl(PipelineState *pipelineState, llvm::ArrayRef<llvm::MemoryBufferRef> elfs,
+                               bool stageElfs);
 
 } // namespace lgc
 
@@ -165,6 +183,7 @@ bool PipelineState::generate(std::unique_ptr<Module> pipelineModule, raw_pwrite_
   // Set up "whole pipeline" passes, where we have a single module representing the whole pipeline.
   std::unique_ptr<PassManager> passMgr(PassManager::Create());
   passMgr->setPassIndex(&passIndex);
+  passMgr->setPassProfile(getLgcContext()->getPassProfile());
   passMgr->add(createTargetTransformInfoWrapperPass(getLgcContext()->getTargetMachine()->getTargetIRAnalysis()));
 
   // Manually add a target-aware TLI pass, so optimizations do not think that we have library functions.
@@ -196,8 +215,11 @@ bool PipelineState::generate(std::unique_ptr<Module> pipelineModule, raw_pwrite_
   // Add pass to clear pipeline state from IR
   passMgr->add(createPipelineStateClearer());
 
-  // Code generation.
-  getLgcContext()->addTargetPasses(*passMgr, codeGenTimer, outStream);
+  // Code generation. For -parallel-codegen, that is instead done after running the patch passes, once the module
+  // can be split per hardware shader stage.
+  bool perStageCodeGen = ParallelCodeGen && !m_emitLgc && !m_unlinked && LgcContext::isTargetOutputElf();
+  if (!perStageCodeGen)
+    getLgcContext()->addTargetPasses(*passMgr, codeGenTimer, outStream);
 
   // Run the "whole pipeline" passes.
   passMgr->run(*pipelineModule);
@@ -206,14 +228,151 @@ bool PipelineState::generate(std::unique_ptr<Module> pipelineModule, raw_pwrite_
   if (getLastError() != "")
     return false;
 
+  if (perStageCodeGen) {
+    if (codeGenTimer)
+      codeGenTimer->startTimer();
+    codeGenPerStage(*pipelineModule, outStream);
+    if (codeGenTimer)
+      codeGenTimer->stopTimer();
+  }
+
   return true;
 }
 
+// =====================================================================================================================
+// Run backend codegen passes on a module that has already been through the patch passes, writing an ELF.
+//
+// @param module : Patched module
+// @param lgcContext : LgcContext for the LLVM context that the module is in
+// @param [out] outStream : Stream to write the ELF to
+static void runCodeGen(Module &module, LgcContext *lgcContext, raw_pwrite_stream &outStream) {
+  std::unique_ptr<lgc::PassManager> passMgr(lgc::PassManager::Create());
+  passMgr->add(createTargetTransformInfoWrapperPass(lgcContext->getTargetMachine()->getTargetIRAnalysis()));
+  lgcContext->preparePassManager(&*passMgr);
+  lgcContext->addTargetPasses(*passMgr, nullptr, outStream);
+  passMgr->run(module);
+}
+
+// =====================================================================================================================
+// Check whether a function is the entry-point of a hardware shader stage.
+//
+// @param func : Function to check
+static bool isHwStageEntryPoint(const Function &func) {
+  if (func.isDeclaration() || func.hasLocalLinkage())
+    return false;
+  switch (func.getCallingConv()) {
+  case CallingConv::AMDGPU_LS:
+  case CallingConv::AMDGPU_HS:
+  case CallingConv::AMDGPU_ES:
+  case CallingConv::AMDGPU_GS:
+  case CallingConv::AMDGPU_VS:
+  case CallingConv::AMDGPU_PS:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// =====================================================================================================================
+// Run backend codegen on the patched pipeline module, one hardware shader stage per thread, and link the resulting
+// ELFs into the pipeline ELF.
+//
+// Each hardware stage is cloned into its own module, with the other stages' entry-points and anything only they use
+// removed, and passed as bitcode to a worker thread that has its own LLVMContext and LgcContext (and thus its own
+// TargetMachine). The ELF linker then merges the stage ELFs, including their PAL metadata. Each stage module carries
+// the whole pipeline's PAL metadata as recorded by the patch passes, so the merge gives the same metadata as codegen
+// of the whole module would.
+//
+// If there is only one hardware stage, or the stage ELFs cannot be linked, this falls back to codegen of the whole
+// module on this thread. The error left by a failed link is cleared, as codegen still succeeds.
+//
+// @param pipelineModule : Patched pipeline module
+// @param [out] outStream : Stream to write the pipeline ELF to
+void PipelineState::codeGenPerStage(Module &pipelineModule, raw_pwrite_stream &outStream) {
+  SmallVector<const Function *, 4> entryPoints;
+  for (const Function &func : pipelineModule) {
+    if (isHwStageEntryPoint(func))
+      entryPoints.push_back(&func);
+  }
+  if (entryPoints.size() < 2) {
+    LLVM_DEBUG(dbgs() << "Per-stage codegen: single hardware stage, using whole-module codegen\n");
+    runCodeGen(pipelineModule, getLgcContext(), outStream);
+    return;
+  }
+
+  // Split the module. The bitcode writes happen on this thread, as they read the pipeline module's LLVMContext.
+  std::vector<SmallString<0>> bitcodes(entryPoints.size());
+  for (unsigned stageIdx = 0; stageIdx != entryPoints.size(); ++stageIdx) {
+    ValueToValueMapTy valueMap;
+    std::unique_ptr<Module> stageModule = CloneModule(pipelineModule, valueMap, [&](const GlobalValue *global) {
+      return !is_contained(entryPoints, global) || global == entryPoints[stageIdx];
+    });
+    for (const Function *entryPoint : entryPoints) {
+      if (entryPoint != entryPoints[stageIdx])
+        cast<Function>(valueMap.lookup(entryPoint))->eraseFromParent();
+    }
+
+    // Remove internal functions and globals that only the other stages used.
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (GlobalValue &global : make_early_inc_range(stageModule->global_values())) {
+        global.removeDeadConstantUsers();
+        if (global.hasLocalLinkage() && global.use_empty()) {
+          global.eraseFromParent();
+          changed = true;
+        }
+      }
+    }
+
+    raw_svector_ostream bitcodeStream(bitcodes[stageIdx]);
+    WriteBitcodeToFile(*stageModule, bitcodeStream);
+  }
+
+  // Run codegen for all but the last stage on worker threads, and the last one on this thread.
+  std::string gpuName = getLgcContext()->getTargetMachine()->getTargetCPU().str();
+  unsigned palAbiVersion = getLgcContext()->getPalAbiVersion();
+  std::vector<SmallString<0>> elfs(entryPoints.size());
+  auto codeGenStage = [&](unsigned stageIdx) {
+    LLVMContext context;
+    std::unique_ptr<Module> stageModule =
+        cantFail(parseBitcodeFile(MemoryBufferRef(bitcodes[stageIdx], ""), context), "Failed to parse stage bitcode");
+    std::unique_ptr<LgcContext> lgcContext(LgcContext::Create(context, gpuName, palAbiVersion));
+    raw_svector_ostream elfStream(elfs[stageIdx]);
+    runCodeGen(*stageModule, &*lgcContext, elfStream);
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned stageIdx = 0; stageIdx + 1 < entryPoints.size(); ++stageIdx)
+    workers.emplace_back(codeGenStage, stageIdx);
+  codeGenStage(entryPoints.size() - 1);
+  for (std::thread &worker : workers)
+    worker.join();
+
+  // Link the stage ELFs. That goes via a separate buffer, so the whole-module fallback can still write to outStream.
+  SmallVector<MemoryBufferRef, 4> elfRefs;
+  for (const SmallString<0> &elf : elfs)
+    elfRefs.push_back(MemoryBufferRef(elf, ""));
+  SmallString<0> pipelineElf;
+  raw_svector_ostream pipelineElfStream(pipelineElf);
+  std::unique_ptr<ElfLinker> elfLinker(createElfLinkerImpl(this, elfRefs, /*stageElfs=*/true));
+  if (elfLinker->link(pipelineElfStream)) {
+    LLVM_DEBUG(dbgs() << "Per-stage codegen: linked " << entryPoints.size() << " hardware stages\n");
+    ++NumPerStageCodeGen;
+    outStream << pipelineElf;
+    return;
+  }
+
+  LLVM_DEBUG(dbgs() << "Per-stage codegen: link failed, using whole-module codegen: " << getLastError() << "\n");
+  ++NumPerStageFallbacks;
+  m_lastError.clear();
+  runCodeGen(pipelineModule, getLgcContext(), outStream);
+}
+
 // =====================================================================================================================
 // Create an ELF linker object for linking unlinked half-pipeline ELFs into a pipeline ELF using the pipeline state.
 // This needs to be deleted after use.
 ElfLinker *PipelineState::createElfLinker(llvm::ArrayRef<llvm::MemoryBufferRef> elfs) {
-  return createElfLinkerImpl(this, elfs);
+  return createElfLinkerImpl(this, elfs, /*stageElfs=*/false);
 }
 
 // =====================================================================================================================
@@ -32,21 +32,30 @@
 #include "lgc/Builder.h"
 #include "lgc/PassManager.h"
 #include "lgc/patch/Patch.h"
+#include "lgc/state/LinkableShader.h"
 #include "lgc/state/PassManagerCache.h"
 #include "lgc/state/PipelineState.h"
 #include "lgc/state/TargetInfo.h"
 #include "lgc/util/Internal.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Bitcode/BitcodeWriterPass.h"
 #include "llvm/CodeGen/CommandFlags.h"
 #include "llvm/IR/IRPrintingPasses.h"
+#include "llvm/IR/Module.h"
 #include "llvm/InitializePasses.h"
 #include "llvm/Support/CodeGen.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/Mutex.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
 
 #define DEBUG_TYPE "lgc-context"
 
@@ -78,6 +87,30 @@ static cl::opt<bool> EmitLgc("emit-lgc", cl::desc("Emit LLVM assembly suitable f
 // -show-encoding: show the instruction encoding when emitting assembler. This mirrors llvm-mc behaviour
 static cl::opt<bool> ShowEncoding("show-encoding", cl::desc("Show instruction encodings"), cl::init(false));
 
+namespace {
+
+// Process-wide cache of target state, so that an LgcContext created after another was destroyed (for example when
+// the front-end recycles its contexts) does not have to set it all up again. TargetInfo is immutable once set up, so
+// each new LgcContext takes a copy. A TargetMachine must not be used by two compiles at once, so each one is owned
+// by a single LgcContext, and is parked here when that LgcContext is destroyed, for the next LgcContext with the same
+// configuration to take over.
+struct TargetCache {
+  sys::Mutex lock;                                                     // Lock for the maps below
+  StringMap<TargetInfo> targetInfos;                                   // Set-up TargetInfo for each GPU name
+  StringMap<std::vector<std::unique_ptr<TargetMachine>>> freeMachines; // Parked target machines per configuration
+  StringMap<uint64_t> setupTimes; // Time taken by Create when it had to set up the target, per configuration, in ns
+};
+
+// Maximum number of target machines parked for each configuration
+constexpr unsigned MaxFreeTargetMachines = 8;
+
+} // anonymous namespace
+
+static ManagedStatic<TargetCache> STargetCache;
+
+// Total time that Create saved by using the target cache, in nanoseconds
+static std::atomic<uint64_t> TotalSetupTimeSaved(0);
+
 // =====================================================================================================================
 // Set default for a command-line option, but only if command-line processing has not happened yet, or did not see
 // an occurrence of this option.
@@ -158,16 +191,52 @@ void LgcContext::initialize() {
 LgcContext *LgcContext::Create(LLVMContext &context, StringRef gpuName, unsigned palAbiVersion) {
   assert(Initialized && "Must call LgcContext::Initialize before LgcContext::Create");
 
+  auto startTime = std::chrono::steady_clock::now();
   LgcContext *builderContext = new LgcContext(context, palAbiVersion);
 
   std::string mcpuName = codegen::getMCPU(); // -mcpu setting from llvm/CodeGen/CommandFlags.h
   if (gpuName == "")
     gpuName = mcpuName;
 
-  builderContext->m_targetInfo = new TargetInfo;
-  if (!builderContext->m_targetInfo->setTargetInfo(gpuName)) {
-    delete builderContext;
-    return nullptr;
+  // Take the TargetInfo and a parked target machine from the target cache if possible.
+  std::string targetMachineKey = gpuName.str();
+  if (ShowEncoding)
+    targetMachineKey += ",show-encoding";
+  builderContext->m_targetMachineKey = targetMachineKey;
+
+  uint64_t setupTime = 0;
+  {
+    std::lock_guard<sys::Mutex> lock(STargetCache->lock);
+    auto targetInfoIt = STargetCache->targetInfos.find(gpuName);
+    if (targetInfoIt != STargetCache->targetInfos.end())
+      builderContext->m_targetInfo = new TargetInfo(targetInfoIt->second);
+
+    auto &freeMachines = STargetCache->freeMachines[targetMachineKey];
+    if (!freeMachines.empty()) {
+      builderContext->m_targetMachine = freeMachines.back().release();
+      freeMachines.pop_back();
+      setupTime = STargetCache->setupTimes.lookup(targetMachineKey);
+    }
+  }
+
+  if (!builderContext->m_targetInfo) {
+    builderContext->m_targetInfo = new TargetInfo;
+    if (!builderContext->m_targetInfo->setTargetInfo(gpuName)) {
+      delete builderContext;
+      return nullptr;
+    }
+    std::lock_guard<sys::Mutex> lock(STargetCache->lock);
+    STargetCache->targetInfos.try_emplace(gpuName, *builderContext->m_targetInfo);
+  }
+
+  if (builderContext->m_targetMachine) {
+    // Report the time saved compared with the last time the target had to be set up.
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - startTime;
+    uint64_t timeSaved = setupTime > uint64_t(elapsed.count()) ? setupTime - elapsed.count() : 0;
+    TotalSetupTimeSaved += timeSaved;
+    LLVM_DEBUG(dbgs() << "Reused cached target machine for " << targetMachineKey << ", saved " << timeSaved / 1000
+                      << " us\n");
+    return builderContext;
   }
 
   // Get the LLVM target and create the target machine. This should not fail, as we determined above
@@ -189,6 +258,12 @@ LgcContext *LgcContext::Create(LLVMContext &context, StringRef gpuName, unsigned
   builderContext->m_targetMachine =
       target->createTargetMachine(triple, gpuName, "", targetOpts, Optional<Reloc::Model>());
   assert(builderContext->m_targetMachine);
+
+  std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - startTime;
+  {
+    std::lock_guard<sys::Mutex> lock(STargetCache->lock);
+    STargetCache->setupTimes[targetMachineKey] = elapsed.count();
+  }
   return builderContext;
 }
 
@@ -201,9 +276,29 @@ LgcContext::LgcContext(LLVMContext &context, unsigned palAbiVersion) : m_context
 
 // =====================================================================================================================
 LgcContext::~LgcContext() {
+  // Cached pass managers contain passes that use the target machine, so delete them first.
+  delete m_passManagerCache;
+  m_passManagerCache = nullptr;
+  delete m_linkableShaderCache;
+  delete m_nggCullerLibrary;
+
+  // Park the target machine in the target cache for a later LgcContext with the same configuration.
+  if (m_targetMachine && !m_targetMachineKey.empty()) {
+    std::lock_guard<sys::Mutex> lock(STargetCache->lock);
+    auto &freeMachines = STargetCache->freeMachines[m_targetMachineKey];
+    if (freeMachines.size() < MaxFreeTargetMachines) {
+      freeMachines.emplace_back(m_targetMachine);
+      m_targetMachine = nullptr;
+    }
+  }
   delete m_targetMachine;
   delete m_targetInfo;
-  delete m_passManagerCache;
+}
+
+// =====================================================================================================================
+// Get the total time, in nanoseconds, that Create has saved in this process by using the target cache.
+uint64_t LgcContext::getTotalSetupTimeSaved() {
+  return TotalSetupTimeSaved;
 }
 
 // =====================================================================================================================
@@ -296,6 +391,13 @@ void LgcContext::addTargetPasses(lgc::PassManager &passMgr, Timer *codeGenTimer,
     passMgr.add(createStartStopTimer(codeGenTimer, false));
 }
 
+// =====================================================================================================================
+// Check whether addTargetPasses sets up codegen to an ELF object, rather than IR or ISA assembly output, with
+// no LLPC_OUTS dump of the final module. A client can then split codegen up and link the resulting ELFs.
+bool LgcContext::isTargetOutputElf() {
+  return !EmitLlvm && !EmitLlvmBc && !getLgcOuts() && codegen::getFileType() == CGFT_ObjectFile;
+}
+
 // =====================================================================================================================
 // Get pass manager cache
 PassManagerCache *LgcContext::getPassManagerCache() {
@@ -303,3 +405,11 @@ PassManagerCache *LgcContext::getPassManagerCache() {
     m_passManagerCache = new PassManagerCache(this);
   return m_passManagerCache;
 }
+
+// =====================================================================================================================
+// Get cache of unlinked shader ELFs parsed by the ELF linker
+LinkableShaderCache *LgcContext::getLinkableShaderCache() {
+  if (!m_linkableShaderCache)
+    m_linkableShaderCache = new LinkableShaderCache;
+  return m_linkableShaderCache;
+}
@@ -198,9 +198,13 @@ void ShaderModes::readModesFromShader(Module *module, ShaderStage stage) {
   // Then the specific shader modes.
   switch (stage) {
   case ShaderStageTessControl:
-  case ShaderStageTessEval:
-    PipelineState::readNamedMetadataArrayOfInt32(module, TessellationModeMetadataName, m_tessellationMode);
+  case ShaderStageTessEval: {
+    // TCS and TES each have their own partial tessellation mode, so merge rather than overwrite.
+    TessellationMode tessellationMode = {};
+    PipelineState::readNamedMetadataArrayOfInt32(module, TessellationModeMetadataName, tessellationMode);
+    setTessellationMode(tessellationMode);
     break;
+  }
   case ShaderStageGeometry:
     PipelineState::readNamedMetadataArrayOfInt32(module, GeometryShaderModeMetadataName, m_geometryShaderMode);
     break;
@@ -0,0 +1,96 @@
+/*
+ ***********************************************************************************************************************
+ *
+ *  Copyright (c) 2020 Advanced Micro Devices, Inc. All Rights Reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ **********************************************************************************************************************/
+/**
+ ***********************************************************************************************************************
+ * @file  LgcIntrinsics.cpp
+ * @brief LGC source file: Classification of internal lgc.* calls by callee
+ ***********************************************************************************************************************
+ */
+#include "lgc/util/LgcIntrinsics.h"
+#include "lgc/state/Defs.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+
+using namespace lgc;
+using namespace llvm;
+
+// =====================================================================================================================
+// Get the kind of a function, classifying it from its name if not already done
+//
+// @param func : Function to look up
+LgcIntrinsic LgcIntrinsicTable::get(const Function *func) {
+  auto it = m_kinds.find(func);
+  if (it != m_kinds.end())
+    return it->second;
+  LgcIntrinsic kind = classify(*func);
+  m_kinds[func] = kind;
+  return kind;
+}
+
+// =====================================================================================================================
+// Get the kind of the callee of a call; None for an indirect call
+//
+// @param call : Call to look up
+LgcIntrinsic LgcIntrinsicTable::get(const CallInst &call) {
+  const Function *callee = call.getCalledFunction();
+  if (!callee)
+    return LgcIntrinsic::None;
+  return get(callee);
+}
+
+// =====================================================================================================================
+// Classify a function from its name, without using a table
+//
+// @param func : Function to classify
+LgcIntrinsic LgcIntrinsicTable::classify(const Function &func) {
+  static const std::pair<const char *, LgcIntrinsic> Prefixes[] = {
+      {lgcName::InputImportGeneric, LgcIntrinsic::InputImportGeneric},
+      {lgcName::InputImportBuiltIn, LgcIntrinsic::InputImportBuiltIn},
+      {lgcName::InputImportInterpolant, LgcIntrinsic::InputImportInterpolant},
+      {lgcName::InputImportVertex, LgcIntrinsic::InputImportVertex},
+      {lgcName::OutputImportGeneric, LgcIntrinsic::OutputImportGeneric},
+      {lgcName::OutputImportBuiltIn, LgcIntrinsic::OutputImportBuiltIn},
+      {lgcName::OutputExportGeneric, LgcIntrinsic::OutputExportGeneric},
+      {lgcName::OutputExportBuiltIn, LgcIntrinsic::OutputExportBuiltIn},
+      {lgcName::OutputExportXfb, LgcIntrinsic::OutputExportXfb},
+      {lgcName::SpillTable, LgcIntrinsic::SpillTable},
+      {lgcName::PushConst, LgcIntrinsic::PushConst},
+      {lgcName::RootDescriptor, LgcIntrinsic::RootDescriptor},
+      {lgcName::DescriptorSet, LgcIntrinsic::DescriptorSet},
+      {lgcName::SpecialUserData, LgcIntrinsic::SpecialUserData},
+      {lgcName::ShaderInput, LgcIntrinsic::ShaderInput},
+  };
+
+  if (!func.isDeclaration())
+    return LgcIntrinsic::None;
+  StringRef name = func.getName();
+  if (!name.startswith("lgc."))
+    return LgcIntrinsic::None;
+  for (const auto &prefix : Prefixes) {
+    if (name.startswith(prefix.first))
+      return prefix.second;
+  }
+  return LgcIntrinsic::None;
+}
@@ -60,6 +60,34 @@ using namespace llvm;
 
 namespace {
 
+// =====================================================================================================================
+// Pass to record the time taken by a module pass into a PassProfile. One is added before the profiled pass to take
+// the start time, and one after it to accumulate the elapsed time.
+class PassProfileRecorder final : public ModulePass {
+public:
+  static char ID;
+  PassProfileRecorder() : ModulePass(ID) {}
+  PassProfileRecorder(PassProfile *passProfile, PassProfileRecorder *startRecorder, StringRef passName)
+      : ModulePass(ID), m_passProfile(passProfile), m_startRecorder(startRecorder), m_passName(passName) {}
+
+  bool runOnModule(Module &module) override;
+
+  void getAnalysisUsage(AnalysisUsage &analysisUsage) const override { analysisUsage.setPreservesAll(); }
+
+  StringRef getPassName() const override { return "LGC pass profile recorder"; }
+
+private:
+  PassProfileRecorder(const PassProfileRecorder &) = delete;
+  PassProfileRecorder &operator=(const PassProfileRecorder &) = delete;
+
+  PassProfile *m_passProfile = nullptr;           // Profile to record into
+  PassProfileRecorder *m_startRecorder = nullptr; // Recorder holding the start time; nullptr if this is that one
+  std::string m_passName;                         // Name of the profiled pass
+  TimeRecord m_startTime;                         // Start time, when this is the start recorder
+};
+
+char PassProfileRecorder::ID = 0;
+
 // =====================================================================================================================
 // LLPC's legacy::PassManager override.
 // This is the implementation subclass of the PassManager class declared in PassManager.h
@@ -69,6 +97,7 @@ public:
   ~PassManagerImpl() override {}
 
   void setPassIndex(unsigned *passIndex) override { m_passIndex = passIndex; }
+  void setPassProfile(PassProfile *passProfile) override { m_passProfile = passProfile; }
   void add(Pass *pass) override;
   void stop() override;
 
@@ -78,6 +107,7 @@ private:
   AnalysisID m_printModule = nullptr;   // Pass id of dump pass "Print Module IR"
   AnalysisID m_jumpThreading = nullptr; // Pass id of opt pass "Jump Threading"
   unsigned *m_passIndex = nullptr;      // Pass Index
+  PassProfile *m_passProfile = nullptr; // Profile to record module pass times into, if any
 };
 
 } // namespace
@@ -151,9 +181,20 @@ void PassManagerImpl::add(Pass *pass) {
       LLPC_OUTS("Pass[" << passIndex << "] = " << pass->getPassName() << "\n");
   }
 
+  // If profiling, bracket a module pass with recorders of its time. Only module passes are done, as a module pass
+  // between function passes would split the function pass manager that runs them.
+  PassProfileRecorder *startRecorder = nullptr;
+  if (m_passProfile && pass->getPassKind() == PT_Module && !pass->getAsImmutablePass()) {
+    startRecorder = new PassProfileRecorder(m_passProfile, nullptr, pass->getPassName());
+    legacy::PassManager::add(startRecorder);
+  }
+
   // Add the pass to the superclass pass manager.
   legacy::PassManager::add(pass);
 
+  if (startRecorder)
+    legacy::PassManager::add(new PassProfileRecorder(m_passProfile, startRecorder, pass->getPassName()));
+
   if (cl::VerifyIr) {
     // Add a verify pass after it.
     legacy::PassManager::add(createVerifierPass(true)); // FatalErrors=true
@@ -170,3 +211,21 @@ void PassManagerImpl::add(Pass *pass) {
 void PassManagerImpl::stop() {
   m_stopped = true;
 }
+
+// =====================================================================================================================
+// Run the pass on the specified LLVM module.
+//
+// @param [in,out] module : LLVM module to be run on
+bool PassProfileRecorder::runOnModule(Module &module) {
+  TimeRecord time = TimeRecord::getCurrentTime(/*Start=*/!m_startRecorder);
+  if (time.getMemUsed() > 0)
+    m_passProfile->peakMemory = std::max(m_passProfile->peakMemory, static_cast<size_t>(time.getMemUsed()));
+
+  if (!m_startRecorder)
+    m_startTime = time;
+  else {
+    time -= m_startRecorder->m_startTime;
+    m_passProfile->passTimes[m_passName] += time;
+  }
+  return false;
+}
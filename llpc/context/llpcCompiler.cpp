@@ -49,20 +49,25 @@
 #include "lgc/ElfLinker.h"
 #include "lgc/PassManager.h"
 #include "llvm/BinaryFormat/MsgPackDocument.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/Bitcode/BitcodeWriterPass.h"
 #include "llvm/IR/DiagnosticInfo.h"
 #include "llvm/IR/DiagnosticPrinter.h"
 #include "llvm/IR/IRPrintingPasses.h"
 #include "llvm/Linker/Linker.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
 #include "llvm/Support/Format.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/Mutex.h"
 #include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/IPO/AlwaysInliner.h"
+#include <algorithm>
+#include <chrono>
 #include <mutex>
 #include <set>
+#include <thread>
 #include <unordered_set>
 
 #ifdef LLPC_ENABLE_SPIRV_OPT
@@ -159,6 +164,30 @@ opt<int> ForceLoopUnrollCount("force-loop-unroll-count", cl::desc("Force loop un
 opt<bool> EnableShaderModuleOpt("enable-shader-module-opt",
                                 cl::desc("Enable translate & lower phase in shader module build."), init(false));
 
+// -cache-specialized-modules: Cache translated and lowered shader stages that use specialization constants
+opt<bool> CacheSpecializedModules("cache-specialized-modules",
+                                  cl::desc("Cache the translated and lowered module of each shader stage that uses "
+                                           "specialization constants, per specialization"),
+                                  init(false));
+
+// -specialized-module-cache-max-insts: bound on the size of the modules that -cache-specialized-modules serializes
+opt<unsigned> SpecializedModuleCacheMaxInsts("specialized-module-cache-max-insts",
+                                             cl::desc("Largest lowered shader stage, in IR instructions, that "
+                                                      "-cache-specialized-modules writes to the cache (0: no limit)"),
+                                             init(20000));
+
+// -cache-glue-shaders: keep glue shaders compiled for relocatable shader links in the shader cache
+opt<bool> CacheGlueShaders("cache-glue-shaders",
+                           cl::desc("Keep glue shaders compiled when linking relocatable shader ELFs in the shader "
+                                    "cache"),
+                           init(true));
+
+// -lazy-load-shader-bitcode: only load the functions of pre-lowered shader bitcode that the entry-point reaches
+opt<bool> LazyLoadShaderBitcode("lazy-load-shader-bitcode",
+                                cl::desc("Only load the functions of pre-lowered shader bitcode that are reachable "
+                                         "from the entry-point"),
+                                init(true));
+
 // -disable-licm: annotate loops with metadata to disable the LLVM LICM pass
 opt<bool> DisableLicm("disable-licm", desc("Disable LLVM LICM pass"), init(false));
 
@@ -175,6 +204,18 @@ opt<int> ContextReuseLimit("context-reuse-limit",
 // -fatal-llvm-errors: Make all LLVM errors fatal
 opt<bool> FatalLlvmErrors("fatal-llvm-errors", cl::desc("Make all LLVM errors fatal"), init(false));
 
+// -enable-parallel-relocatable-build: Build the relocatable shader ELFs of a graphics pipeline in parallel
+opt<bool> EnableParallelRelocatableBuild("enable-parallel-relocatable-build",
+                                         cl::desc("Build the relocatable shader ELFs of the stages of a graphics "
+                                                  "pipeline in parallel, each in its own LLVM context"),
+                                         init(false));
+
+// -enable-parallel-front-end: Translate and lower the shader stages of a pipeline in parallel
+opt<bool> EnableParallelFrontEnd("enable-parallel-front-end",
+                                 cl::desc("Translate and lower the shader stages of a pipeline in parallel, each in "
+                                          "its own LLVM context"),
+                                 init(false));
+
 extern opt<bool> EnableOuts;
 
 extern opt<bool> EnableErrs;
@@ -194,8 +235,13 @@ static cl::opt<bool> UseBuilderRecorder("use-builder-recorder",
 
 namespace Llpc {
 
-sys::Mutex Compiler::m_contextPoolMutex;
+sys::RWMutex Compiler::m_contextPoolMutex;
 std::vector<Context *> *Compiler::m_contextPool = nullptr;
+std::atomic<uint64_t> Compiler::m_contextAcquireCount(0);
+std::atomic<uint64_t> Compiler::m_contextAffinityHits(0);
+std::atomic<uint64_t> Compiler::m_contextCreateCount(0);
+std::atomic<uint64_t> Compiler::m_contextRecycleCount(0);
+std::atomic<uint64_t> Compiler::m_contextPoolWaitTime(0);
 
 // Enumerates modes used in shader replacement
 enum ShaderReplaceMode {
@@ -346,7 +392,8 @@ bool VKAPI_CALL ICompiler::IsVertexFormatSupported(VkFormat format) {
 // @param cache : Pointer to ICache implemented in client
 Compiler::Compiler(GfxIpVersion gfxIp, unsigned optionCount, const char *const *options, MetroHash::Hash optionHash,
                    ICache *cache)
-    : m_optionHash(optionHash), m_gfxIp(gfxIp), m_cache(cache), m_relocatablePipelineCompilations(0) {
+    : m_optionHash(optionHash), m_gfxIp(gfxIp), m_cache(cache), m_relocatablePipelineCompilations(0),
+      m_telemetryCallback(nullptr), m_telemetryUserData(nullptr) {
   for (unsigned i = 0; i < optionCount; ++i)
     m_options.push_back(options[i]);
 
@@ -359,7 +406,7 @@ Compiler::Compiler(GfxIpVersion gfxIp, unsigned optionCount, const char *const *
 
     // Initiailze m_pContextPool.
     {
-      std::lock_guard<sys::Mutex> lock(m_contextPoolMutex);
+      sys::ScopedWriter lock(m_contextPoolMutex);
 
       m_contextPool = new std::vector<Context *>();
     }
@@ -401,7 +448,13 @@ Compiler::~Compiler() {
   bool shutdown = false;
   {
     // Free context pool
-    std::lock_guard<sys::Mutex> lock(m_contextPoolMutex);
+    sys::ScopedWriter lock(m_contextPoolMutex);
+
+    LLVM_DEBUG(dbgs() << "Context pool: size " << m_contextPool->size() << ", acquires " << m_contextAcquireCount
+                      << ", affinity hits " << m_contextAffinityHits << ", created " << m_contextCreateCount
+                      << ", recycled " << m_contextRecycleCount << ", lock wait "
+                      << format("%.3f", m_contextPoolWaitTime / 1000000.0) << " ms, setup time saved "
+                      << format("%.3f", LgcContext::getTotalSetupTimeSaved() / 1000000.0) << " ms\n");
 
     // Keep the max allowed count of contexts that reside in the pool so that we can speed up the creatoin of
     // compiler next time.
@@ -492,8 +545,10 @@ Result Compiler::BuildShaderModule(const ShaderModuleBuildInfo *shaderInfo, Shad
 
   memcpy(moduleDataEx.common.hash, &hash, sizeof(hash));
 
+  CompileTelemetryRecorder telemetry(m_telemetryCallback, m_telemetryUserData, CompileTelemetryKind::ShaderModule,
+                                     MetroHash::compact64(&hash));
   TimerProfiler timerProfiler(MetroHash::compact64(&hash), "LLPC ShaderModule",
-                              TimerProfiler::ShaderModuleTimerEnableMask);
+                              TimerProfiler::ShaderModuleTimerEnableMask, &telemetry);
 
   // Check the type of input shader binary
   if (ShaderModuleHelper::isSpirvBinary(&shaderInfo->shaderBin)) {
@@ -566,9 +621,22 @@ Result Compiler::BuildShaderModule(const ShaderModuleBuildInfo *shaderInfo, Shad
         }
       } else {
         cacheEntryState = m_shaderCache->findShader(cacheHash, allocateOnMiss, &hEntry);
-        if (cacheEntryState == ShaderEntryState::Ready)
-          result = m_shaderCache->retrieveShader(hEntry, &cacheData, &allocSize);
+        if (cacheEntryState == ShaderEntryState::Ready &&
+            m_shaderCache->retrieveShader(hEntry, &cacheData, &allocSize) != Result::Success) {
+          // The cached data failed its CRC check and has been dropped, so treat this as a miss: look the entry up
+          // again so that it is compiled and re-inserted below, unless another thread has re-inserted it meanwhile.
+          m_shaderCache->releaseShader(hEntry);
+          hEntry = nullptr;
+          cacheEntryState = m_shaderCache->findShader(cacheHash, allocateOnMiss, &hEntry);
+          if (cacheEntryState == ShaderEntryState::Ready &&
+              m_shaderCache->retrieveShader(hEntry, &cacheData, &allocSize) != Result::Success) {
+            cacheEntryState = ShaderEntryState::Unavailable;
+            m_shaderCache->releaseShader(hEntry);
+            hEntry = nullptr;
+          }
+        }
       }
+      telemetry.addCacheLookup(cacheResult == Result::Success || cacheEntryState == ShaderEntryState::Ready);
       if (cacheResult != Result::Success && cacheEntryState != ShaderEntryState::Ready) {
         Context *context = acquireContext();
 
@@ -597,6 +665,7 @@ Result Compiler::BuildShaderModule(const ShaderModuleBuildInfo *shaderInfo, Shad
           unsigned passIndex = 0;
           std::unique_ptr<lgc::PassManager> lowerPassMgr(lgc::PassManager::Create());
           lowerPassMgr->setPassIndex(&passIndex);
+          lowerPassMgr->setPassProfile(telemetry.getPassProfile());
 
           // Set the shader stage in the Builder.
           context->getBuilder()->setShaderStage(getLgcShaderStage(static_cast<ShaderStage>(entryNames[i].stage)));
@@ -777,11 +846,14 @@ Result Compiler::BuildShaderModule(const ShaderModuleBuildInfo *shaderInfo, Shad
     moduleDataExCopy->extra.pFsOutInfos = fsOutInfo;
     shaderOut->pModuleData = &moduleDataExCopy->common;
   } else {
-    if (hEntry)
+    if (hEntry && cacheEntryState == ShaderEntryState::Compiling)
       m_shaderCache->resetShader(hEntry);
   }
+  // The module data has been copied out of the cache, or into it.
+  m_shaderCache->releaseShader(hEntry);
   delete[] allocData;
 
+  telemetry.setResult(result);
   return result;
 }
 
@@ -802,14 +874,25 @@ Result Compiler::buildPipelineWithRelocatableElf(Context *context, ArrayRef<cons
   context->getPipelineContext()->doUserDataNodeMerge();
   unsigned originalShaderStageMask = context->getPipelineContext()->getShaderStageMask();
   context->getPipelineContext()->setUnlinked(true);
+  CompileTelemetryRecorder *telemetry = context->getPipelineContext()->getTelemetry();
+
+  // Cache entries of a stage that missed in the caches, held until its relocatable shader has been built.
+  struct StageCacheEntry {
+    EntryHandle cacheEntry;
+    ShaderCache *shaderCache = nullptr;
+    CacheEntryHandle hEntry = nullptr;
+    BinaryData elfBin = {};
+  };
 
+  // Look up the relocatable shader of each stage in the caches first. Every build takes the entries in stage order,
+  // and stage hashes differ between stages, so holding the entries of several stages at once cannot deadlock.
   ElfPackage elf[ShaderStageNativeStageCount];
-  for (unsigned stage = 0; stage < shaderInfo.size() && result == Result::Success; ++stage) {
+  StageCacheEntry stageCacheEntries[ShaderStageNativeStageCount];
+  SmallVector<unsigned, ShaderStageNativeStageCount> missedStages;
+  for (unsigned stage = 0; stage < shaderInfo.size(); ++stage) {
     if (!shaderInfo[stage] || !shaderInfo[stage]->pModuleData)
       continue;
 
-    context->getPipelineContext()->setShaderStageMask(shaderStageToMask(static_cast<ShaderStage>(stage)));
-
     // Check the cache for the relocatable shader for this stage.
     MetroHash::Hash cacheHash = {};
     IShaderCache *userShaderCache = nullptr;
@@ -831,51 +914,88 @@ Result Compiler::buildPipelineWithRelocatableElf(Context *context, ArrayRef<cons
     }
 
     ShaderEntryState cacheEntryState = ShaderEntryState::New;
-    BinaryData elfBin = {};
+    StageCacheEntry &stageCacheEntry = stageCacheEntries[stage];
+    BinaryData &elfBin = stageCacheEntry.elfBin;
 
-    EntryHandle cacheEntry;
     HashId hashId = {};
     memcpy(&hashId.bytes, &cacheHash.bytes, sizeof(cacheHash));
-    Result cacheResult = lookUpCaches(userCache, &hashId, &elfBin, &cacheEntry);
+    Result cacheResult = lookUpCaches(userCache, &hashId, &elfBin, &stageCacheEntry.cacheEntry);
     if (cacheResult == Result::Success) {
+      if (telemetry)
+        telemetry->addCacheLookup(true);
       auto data = reinterpret_cast<const char *>(elfBin.pCode);
       elf[stage].assign(data, data + elfBin.codeSize);
       // Release Entry
-      ReleaseCacheEntry(false, nullptr, &cacheEntry);
+      ReleaseCacheEntry(false, nullptr, &stageCacheEntry.cacheEntry);
       continue;
     }
 
-    ShaderCache *shaderCache;
-    CacheEntryHandle hEntry;
-    cacheEntryState = lookUpShaderCaches(userShaderCache, &cacheHash, &elfBin, &shaderCache, &hEntry);
+    cacheEntryState = lookUpShaderCaches(userShaderCache, &cacheHash, &elfBin, &stageCacheEntry.shaderCache,
+                                         &stageCacheEntry.hEntry);
 
+    if (telemetry)
+      telemetry->addCacheLookup(cacheEntryState == ShaderEntryState::Ready);
     if (cacheEntryState == ShaderEntryState::Ready) {
       auto data = reinterpret_cast<const char *>(elfBin.pCode);
       elf[stage].assign(data, data + elfBin.codeSize);
+      releaseShaderCacheEntry(stageCacheEntry.shaderCache, stageCacheEntry.hEntry);
       LLPC_OUTS("Cache hit for shader stage " << stage << "\n");
       continue;
     }
     LLPC_OUTS("Cache miss for shader stage " << stage << "\n");
+    missedStages.push_back(stage);
+  }
 
-    // There was a cache miss, so we need to build the relocatable shader for
-    // this stage.
-    const PipelineShaderInfo *singleStageShaderInfo[ShaderStageNativeStageCount] = {nullptr, nullptr, nullptr,
-                                                                                    nullptr, nullptr, nullptr};
-    singleStageShaderInfo[stage] = shaderInfo[stage];
+  // There were cache misses, so we need to build the relocatable shaders for those stages. The stages of a graphics
+  // pipeline are built in parallel, each in a context of its own. As for the parallel front-end, the module dumps and
+  // the timer report assume that stages are built one at a time, so those keep to building them in sequence.
+  std::vector<Result> stageResults(shaderInfo.size(), Result::Success);
+  if (cl::EnableParallelRelocatableBuild && context->isGraphics() && missedStages.size() > 1 && !EnableOuts() &&
+      !TimerProfiler::isReportEnabled()) {
+    // Build all but the last stage on worker threads, and the last one on this thread.
+    auto buildStage = [&, forceLoopUnrollCount](unsigned stage) {
+      stageResults[stage] = buildRelocatableStage(context, shaderInfo, stage, forceLoopUnrollCount, &elf[stage]);
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i + 1 < missedStages.size(); ++i)
+      workers.emplace_back(buildStage, missedStages[i]);
+    buildStage(missedStages.back());
+    for (std::thread &worker : workers)
+      worker.join();
+  } else {
+    for (unsigned stage : missedStages) {
+      if (result != Result::Success) {
+        stageResults[stage] = result;
+        continue;
+      }
+      context->getPipelineContext()->setShaderStageMask(shaderStageToMask(static_cast<ShaderStage>(stage)));
 
-    result =
-        buildPipelineInternal(context, singleStageShaderInfo, forceLoopUnrollCount, /*unlinked=*/true, &elf[stage]);
+      const PipelineShaderInfo *singleStageShaderInfo[ShaderStageNativeStageCount] = {nullptr, nullptr, nullptr,
+                                                                                      nullptr, nullptr, nullptr};
+      singleStageShaderInfo[stage] = shaderInfo[stage];
 
-    // Add the result to the cache.
-    if (result == Result::Success) {
-      elfBin.codeSize = elf[stage].size();
-      elfBin.pCode = elf[stage].data();
+      result =
+          buildPipelineInternal(context, singleStageShaderInfo, forceLoopUnrollCount, /*unlinked=*/true, &elf[stage]);
+      stageResults[stage] = result;
+    }
+    context->getPipelineContext()->setShaderStageMask(originalShaderStageMask);
+  }
+
+  // Add the results to the cache, and release the entries of stages that failed.
+  for (unsigned stage : missedStages) {
+    StageCacheEntry &stageCacheEntry = stageCacheEntries[stage];
+    bool success = stageResults[stage] == Result::Success;
+    if (success) {
+      stageCacheEntry.elfBin.codeSize = elf[stage].size();
+      stageCacheEntry.elfBin.pCode = elf[stage].data();
+    } else if (result == Result::Success) {
+      result = stageResults[stage];
     }
-    updateShaderCache((result == Result::Success), &elfBin, shaderCache, hEntry);
+    updateShaderCache(success, &stageCacheEntry.elfBin, stageCacheEntry.shaderCache, stageCacheEntry.hEntry);
     LLPC_OUTS("Updating the cache for shader stage " << stage << "\n");
-    ReleaseCacheEntry((result == Result::Success), &elfBin, &cacheEntry);
+    ReleaseCacheEntry(success, &stageCacheEntry.elfBin, &stageCacheEntry.cacheEntry);
   }
-  context->getPipelineContext()->setShaderStageMask(originalShaderStageMask);
 
   if (!cl::BuildShaderCache) {
     // Link the relocatable shaders into a single pipeline elf file.
@@ -985,6 +1105,24 @@ bool Compiler::canUseRelocatableComputeShaderElf(const PipelineShaderInfo *shade
   return true;
 }
 
+// =====================================================================================================================
+// Loads the bitcode of a pre-lowered shader stage into the pipeline's context. Unless -lazy-load-shader-bitcode is
+// off, functions that the entry-point does not reach are not loaded, and are counted in the compile telemetry.
+//
+// @param context : Acquired context of the pipeline
+// @param bitcode : Bitcode of the pre-lowered shader stage
+// @returns : The loaded module, or nullptr on failure
+static Module *loadLoweredModule(Context *context, const BinaryData *bitcode) {
+  if (!cl::LazyLoadShaderBitcode)
+    return context->loadLibary(bitcode).release();
+
+  unsigned skippedFunctionCount = 0;
+  Module *module = context->loadShaderBitcode(bitcode, &skippedFunctionCount).release();
+  if (CompileTelemetryRecorder *telemetry = context->getPipelineContext()->getTelemetry())
+    telemetry->addSkippedBitcodeFunctions(skippedFunctionCount);
+  return module;
+}
+
 // =====================================================================================================================
 // Build pipeline internally -- common code for graphics and compute
 //
@@ -998,7 +1136,9 @@ Result Compiler::buildPipelineInternal(Context *context, ArrayRef<const Pipeline
   Result result = Result::Success;
   unsigned passIndex = 0;
   const PipelineShaderInfo *fragmentShaderInfo = nullptr;
-  TimerProfiler timerProfiler(context->getPiplineHashCode(), "LLPC", TimerProfiler::PipelineTimerEnableMask);
+  CompileTelemetryRecorder *telemetry = context->getPipelineContext()->getTelemetry();
+  TimerProfiler timerProfiler(context->getPiplineHashCode(), "LLPC", TimerProfiler::PipelineTimerEnableMask,
+                              telemetry);
   bool buildingRelocatableElf = context->getPipelineContext()->isUnlinked();
 
   context->setDiagnosticHandler(std::make_unique<LlpcDiagnosticHandler>());
@@ -1015,6 +1155,7 @@ Result Compiler::buildPipelineInternal(Context *context, ArrayRef<const Pipeline
 
   // Set up middle-end objects.
   LgcContext *builderContext = context->getLgcContext();
+  builderContext->setPassProfile(telemetry ? telemetry->getPassProfile() : nullptr);
   std::unique_ptr<Pipeline> pipeline(builderContext->createPipeline());
   context->getPipelineContext()->setPipelineState(&*pipeline, unlinked);
   context->setBuilder(builderContext->createBuilder(&*pipeline, UseBuilderRecorder));
@@ -1027,7 +1168,7 @@ Result Compiler::buildPipelineInternal(Context *context, ArrayRef<const Pipeline
   if (shaderInfoEntry) {
     const ShaderModuleData *moduleData = reinterpret_cast<const ShaderModuleData *>(shaderInfoEntry->pModuleData);
     if (moduleData && moduleData->binType == BinaryType::LlvmBc)
-      pipelineModule.reset(context->loadLibary(&moduleData->binCode).release());
+      pipelineModule.reset(loadLoweredModule(context, &moduleData->binCode));
   }
 
   // If not IR input, run the per-shader passes, including SPIR-V translation, and then link the modules
@@ -1035,6 +1176,7 @@ Result Compiler::buildPipelineInternal(Context *context, ArrayRef<const Pipeline
   if (pipelineModule == nullptr) {
     // Create empty modules and set target machine in each.
     std::vector<Module *> modules(shaderInfo.size());
+    std::vector<SpecializedModuleCacheEntry> specializedModules(shaderInfo.size());
     unsigned stageSkipMask = 0;
     for (unsigned shaderIndex = 0; shaderIndex < shaderInfo.size() && result == Result::Success; ++shaderIndex) {
       const PipelineShaderInfo *shaderInfoEntry = shaderInfo[shaderIndex];
@@ -1068,22 +1210,49 @@ Result Compiler::buildPipelineInternal(Context *context, ArrayRef<const Pipeline
         }
 
         if (binCode.codeSize > 0) {
-          module = context->loadLibary(&binCode).release();
+          module = loadLoweredModule(context, &binCode);
           stageSkipMask |= (1 << shaderIndex);
         } else
           result = Result::ErrorInvalidShader;
 
         timerProfiler.startStopTimer(TimerLoadBc, false);
       } else {
-        module = new Module((Twine("llpc") + getShaderStageName(shaderInfoEntry->entryStage)).str() +
-                                std::to_string(getModuleIdByIndex(shaderIndex)),
-                            *context);
+        // A stage that uses specialization constants cannot be lowered when its shader module is built, so its
+        // lowered module is cached per specialization instead. Use the one from an earlier pipeline if there is one.
+        BinaryData bitcode = {};
+        if (isSpecializedModuleCacheable(shaderInfoEntry) &&
+            lookUpSpecializedModule(context, shaderInfoEntry, forceLoopUnrollCount, &specializedModules[shaderIndex],
+                                    &bitcode)) {
+          timerProfiler.startStopTimer(TimerLoadBc, true);
+          module = loadLoweredModule(context, &bitcode);
+          if (module)
+            stageSkipMask |= (1 << shaderIndex);
+          timerProfiler.startStopTimer(TimerLoadBc, false);
+        }
+
+        if (!module) {
+          module = new Module((Twine("llpc") + getShaderStageName(shaderInfoEntry->entryStage)).str() +
+                                  std::to_string(getModuleIdByIndex(shaderIndex)),
+                              *context);
+        }
       }
 
       modules[shaderIndex] = module;
       context->setModuleTargetMachine(module);
     }
 
+    // Optionally translate and lower the SPIR-V stages in parallel. The module dumps and the timer report assume
+    // that stages are processed one at a time, so those keep to the sequential path below. For telemetry, the
+    // parallel section as a whole is accounted as translation, as translation and lowering overlap there. The stages
+    // are lowered without the pipeline state, with Builder calls recorded, so with -use-builder-recorder=false the
+    // sequential path is used.
+    if (cl::EnableParallelFrontEnd && UseBuilderRecorder && result == Result::Success && !EnableOuts() &&
+        !TimerProfiler::isReportEnabled()) {
+      timerProfiler.startStopTimer(TimerTranslate, true);
+      result = translateAndLowerInParallel(context, shaderInfo, forceLoopUnrollCount, modules, &stageSkipMask);
+      timerProfiler.startStopTimer(TimerTranslate, false);
+    }
+
     for (unsigned shaderIndex = 0; shaderIndex < shaderInfo.size() && result == Result::Success; ++shaderIndex) {
       const PipelineShaderInfo *shaderInfoEntry = shaderInfo[shaderIndex];
       ShaderStage entryStage = shaderInfoEntry ? shaderInfoEntry->entryStage : ShaderStageInvalid;
@@ -1095,6 +1264,7 @@ Result Compiler::buildPipelineInternal(Context *context, ArrayRef<const Pipeline
 
       std::unique_ptr<lgc::PassManager> lowerPassMgr(lgc::PassManager::Create());
       lowerPassMgr->setPassIndex(&passIndex);
+      lowerPassMgr->setPassProfile(builderContext->getPassProfile());
 
       // Set the shader stage in the Builder.
       context->getBuilder()->setShaderStage(getLgcShaderStage(entryStage));
@@ -1130,6 +1300,7 @@ Result Compiler::buildPipelineInternal(Context *context, ArrayRef<const Pipeline
       if (stageSkipMask & shaderStageToMask(entryStage)) {
         // Do not run SPIR-V translator and lowering passes on this shader; we were given it as IR ready
         // to link into pipeline module.
+        updateSpecializedModule(modules[shaderIndex], &specializedModules[shaderIndex]);
         modulesToLink.push_back({modules[shaderIndex], getLgcShaderStage(static_cast<ShaderStage>(shaderIndex))});
         continue;
       }
@@ -1137,6 +1308,7 @@ Result Compiler::buildPipelineInternal(Context *context, ArrayRef<const Pipeline
       context->getBuilder()->setShaderStage(getLgcShaderStage(entryStage));
       std::unique_ptr<lgc::PassManager> lowerPassMgr(lgc::PassManager::Create());
       lowerPassMgr->setPassIndex(&passIndex);
+      lowerPassMgr->setPassProfile(builderContext->getPassProfile());
 
       SpirvLower::addPasses(context, entryStage, *lowerPassMgr, timerProfiler.getTimer(TimerLower),
                             forceLoopUnrollCount);
@@ -1146,9 +1318,14 @@ Result Compiler::buildPipelineInternal(Context *context, ArrayRef<const Pipeline
         LLPC_ERRS("Failed to translate SPIR-V or run per-shader passes\n");
         result = Result::ErrorInvalidShader;
       }
+      updateSpecializedModule(success ? modules[shaderIndex] : nullptr, &specializedModules[shaderIndex]);
       modulesToLink.push_back({modules[shaderIndex], getLgcShaderStage(static_cast<ShaderStage>(shaderIndex))});
     }
 
+    // Release any specialized module cache entry not populated above, so that other threads stop waiting for it.
+    for (SpecializedModuleCacheEntry &specializedModule : specializedModules)
+      updateSpecializedModule(nullptr, &specializedModule);
+
     // Link the shader modules into a single pipeline module.
     pipelineModule.reset(pipeline->irLink(modulesToLink, context->getPipelineContext()->isUnlinked()));
     if (pipelineModule == nullptr) {
@@ -1209,11 +1386,268 @@ Result Compiler::buildPipelineInternal(Context *context, ArrayRef<const Pipeline
       (context->getShaderStageMask() & shaderStageToMask(ShaderStageFragment)))
     graphicsShaderCacheChecker.updateRootUserDateOffset(pipelineElf);
 
+  builderContext->setPassProfile(nullptr);
   context->setDiagnosticHandlerCallBack(nullptr);
 
   return result;
 }
 
+// =====================================================================================================================
+// Translate and lower each SPIR-V shader stage of a pipeline in parallel, each stage in an LLPC context of its own.
+// The lowered modules come back as bitcode, and are loaded into the pipeline's context in place of the empty
+// modules that were created for those stages.
+//
+// @param context : Acquired context of the pipeline
+// @param shaderInfo : Shader info of this pipeline
+// @param forceLoopUnrollCount : Force loop unroll count (0 means disable)
+// @param [in/out] modules : Per-stage modules; entries for the stages handled here are replaced
+// @param [in/out] stageSkipMask : Mask of stages that need no translation; the stages handled here are added
+Result Compiler::translateAndLowerInParallel(Context *context, ArrayRef<const PipelineShaderInfo *> shaderInfo,
+                                             unsigned forceLoopUnrollCount, MutableArrayRef<Module *> modules,
+                                             unsigned *stageSkipMask) {
+  SmallVector<unsigned, ShaderStageNativeStageCount> stageIndices;
+  for (unsigned shaderIndex = 0; shaderIndex < shaderInfo.size(); ++shaderIndex) {
+    const PipelineShaderInfo *shaderInfoEntry = shaderInfo[shaderIndex];
+    if (shaderInfoEntry && shaderInfoEntry->pModuleData && (*stageSkipMask & (1 << shaderIndex)) == 0)
+      stageIndices.push_back(shaderIndex);
+  }
+
+  // Run all but the last stage on worker threads, and the last one on this thread.
+  std::vector<ElfPackage> bitcodes(shaderInfo.size());
+  std::vector<Result> results(shaderInfo.size(), Result::Success);
+  auto translateStage = [&, forceLoopUnrollCount](unsigned shaderIndex) {
+    results[shaderIndex] =
+        translateAndLowerShader(context, shaderInfo[shaderIndex], forceLoopUnrollCount, &bitcodes[shaderIndex]);
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i + 1 < stageIndices.size(); ++i)
+    workers.emplace_back(translateStage, stageIndices[i]);
+  if (!stageIndices.empty())
+    translateStage(stageIndices.back());
+  for (std::thread &worker : workers)
+    worker.join();
+
+  Result result = Result::Success;
+  for (unsigned shaderIndex : stageIndices) {
+    if (results[shaderIndex] != Result::Success) {
+      result = results[shaderIndex];
+      continue;
+    }
+
+    BinaryData bitcode = {};
+    bitcode.codeSize = bitcodes[shaderIndex].size();
+    bitcode.pCode = bitcodes[shaderIndex].data();
+    Module *module = context->loadLibary(&bitcode).release();
+    module->setModuleIdentifier(modules[shaderIndex]->getModuleIdentifier());
+    context->setModuleTargetMachine(module);
+
+    delete modules[shaderIndex];
+    modules[shaderIndex] = module;
+    *stageSkipMask |= (1 << shaderIndex);
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+// Translate and lower a single SPIR-V shader stage in an LLPC context of its own, and return the lowered module as
+// bitcode. This may run concurrently for different stages of the same pipeline, as the pipeline context is only read.
+//
+// @param context : Acquired context of the pipeline
+// @param shaderInfo : Shader info of the stage
+// @param forceLoopUnrollCount : Force loop unroll count (0 means disable)
+// @param [out] bitcode : Bitcode of the lowered module
+Result Compiler::translateAndLowerShader(Context *context, const PipelineShaderInfo *shaderInfo,
+                                         unsigned forceLoopUnrollCount, ElfPackage *bitcode) const {
+  Result result = Result::Success;
+  ShaderStage entryStage = shaderInfo->entryStage;
+
+  Context *stageContext = acquireContext();
+  stageContext->attachPipelineContext(context->getPipelineContext());
+  stageContext->setDiagnosticHandler(std::make_unique<LlpcDiagnosticHandler>());
+  stageContext->setScalarBlockLayout(context->getScalarBlockLayout());
+  stageContext->setRobustBufferAccess(context->getRobustBufferAccess());
+
+  // There is no Pipeline in this context, so use a BuilderRecorder for shader compile. That records the shader
+  // modes into IR metadata, from where PipelineState::irLink reads them back.
+  stageContext->setBuilder(stageContext->getLgcContext()->createBuilder(nullptr, true));
+  stageContext->getBuilder()->setShaderStage(getLgcShaderStage(entryStage));
+
+  Module *module = new Module((Twine("llpc") + getShaderStageName(entryStage)).str(), *stageContext);
+  stageContext->setModuleTargetMachine(module);
+
+  unsigned passIndex = 0;
+  std::unique_ptr<lgc::PassManager> lowerPassMgr(lgc::PassManager::Create());
+  lowerPassMgr->setPassIndex(&passIndex);
+
+  // SPIR-V translation, per-shader SPIR-V lowering passes, then write out the result.
+  raw_svector_ostream bitcodeStream(*bitcode);
+  lowerPassMgr->add(createSpirvLowerTranslator(entryStage, shaderInfo));
+  SpirvLower::addPasses(stageContext, entryStage, *lowerPassMgr, nullptr, forceLoopUnrollCount);
+  lowerPassMgr->add(createBitcodeWriterPass(bitcodeStream));
+
+  // Run the passes.
+  bool success = runPasses(&*lowerPassMgr, module);
+  if (!success) {
+    LLPC_ERRS("Failed to translate SPIR-V or run per-shader passes\n");
+    result = Result::ErrorInvalidShader;
+  }
+
+  lowerPassMgr.reset();
+  delete module;
+  stageContext->setDiagnosticHandlerCallBack(nullptr);
+  releaseContext(stageContext);
+  return result;
+}
+
+// =====================================================================================================================
+// Build the relocatable shader ELF of a single stage of a graphics pipeline in an LLPC context of its own. This may
+// run concurrently for different stages of the same pipeline: each stage gets a graphics context of its own, and the
+// pipeline's context is only read.
+//
+// @param context : Acquired context of the pipeline, whose user data has already been merged
+// @param shaderInfo : Shader info of this pipeline
+// @param stage : Shader stage to build
+// @param forceLoopUnrollCount : Force loop unroll count (0 means disable)
+// @param [out] stageElf : Relocatable ELF of the stage
+Result Compiler::buildRelocatableStage(Context *context, ArrayRef<const PipelineShaderInfo *> shaderInfo,
+                                       unsigned stage, unsigned forceLoopUnrollCount, ElfPackage *stageElf) {
+  // The merged user data is already in the shader info, so the stage's graphics context must not merge again. Its
+  // compile telemetry is left out, as the recorder is not thread-safe.
+  auto pipelineInfo = reinterpret_cast<const GraphicsPipelineBuildInfo *>(context->getPipelineBuildInfo());
+  MetroHash::Hash pipelineHash = context->getPipelineContext()->getPipelineHash();
+  MetroHash::Hash cacheHash = context->getPipelineContext()->getCacheHash();
+  GraphicsContext stageGraphicsContext(m_gfxIp, pipelineInfo, &pipelineHash, &cacheHash);
+  stageGraphicsContext.setUnlinked(true);
+  stageGraphicsContext.setShaderStageMask(shaderStageToMask(static_cast<ShaderStage>(stage)));
+
+  const PipelineShaderInfo *singleStageShaderInfo[ShaderStageNativeStageCount] = {nullptr, nullptr, nullptr,
+                                                                                  nullptr, nullptr, nullptr};
+  singleStageShaderInfo[stage] = shaderInfo[stage];
+
+  Context *stageContext = acquireContext();
+  stageContext->attachPipelineContext(&stageGraphicsContext);
+  Result result =
+      buildPipelineInternal(stageContext, singleStageShaderInfo, forceLoopUnrollCount, /*unlinked=*/true, stageElf);
+  releaseContext(stageContext);
+  return result;
+}
+
+// =====================================================================================================================
+// Check whether the lowered module of a shader stage is cached per specialization. That is only done for SPIR-V
+// stages that use specialization constants, as other stages can be lowered when their shader module is built.
+//
+// @param shaderInfo : Shader info of the stage
+bool Compiler::isSpecializedModuleCacheable(const PipelineShaderInfo *shaderInfo) const {
+  if (!cl::CacheSpecializedModules || !UseBuilderRecorder || EnableOuts())
+    return false;
+  const ShaderModuleData *moduleData = reinterpret_cast<const ShaderModuleData *>(shaderInfo->pModuleData);
+  return moduleData->binType == BinaryType::Spirv && moduleData->usage.useSpecConstant;
+}
+
+// =====================================================================================================================
+// Generate the cache hash of the lowered module of a shader stage. That covers the SPIR-V, the entry-point, the
+// specialization info and shader options of the stage, and the pipeline state that translation and lowering read.
+//
+// @param context : Acquired context of the pipeline
+// @param shaderInfo : Shader info of the stage
+// @param forceLoopUnrollCount : Force loop unroll count (0 means disable)
+MetroHash::Hash Compiler::generateHashForSpecializedModule(Context *context, const PipelineShaderInfo *shaderInfo,
+                                                           unsigned forceLoopUnrollCount) const {
+  static const char SpecializedModuleTag[] = "SpecializedModule";
+  auto pipelineOptions = context->getPipelineContext()->getPipelineOptions();
+  MetroHash64 hasher;
+
+  hasher.Update(m_optionHash);
+  hasher.Update(reinterpret_cast<const uint8_t *>(SpecializedModuleTag), sizeof(SpecializedModuleTag));
+  PipelineDumper::updateHashForPipelineShaderInfo(shaderInfo->entryStage, shaderInfo, true, &hasher, false);
+  hasher.Update(forceLoopUnrollCount);
+  hasher.Update(context->getScalarBlockLayout());
+  hasher.Update(context->getRobustBufferAccess());
+  hasher.Update(pipelineOptions->extendedRobustness.robustBufferAccess);
+  hasher.Update(pipelineOptions->extendedRobustness.robustImageAccess);
+  hasher.Update(pipelineOptions->extendedRobustness.nullDescriptor);
+
+  MetroHash::Hash hash = {};
+  hasher.Finalize(hash.bytes);
+  return hash;
+}
+
+// =====================================================================================================================
+// Look up the lowered module of a shader stage in the shader caches. Upon miss, the cache entry is allocated, and
+// the caller must pass it to updateSpecializedModule once the stage has been lowered (or failed to lower).
+//
+// @param context : Acquired context of the pipeline
+// @param shaderInfo : Shader info of the stage
+// @param forceLoopUnrollCount : Force loop unroll count (0 means disable)
+// @param [out] cacheEntry : Cache entry of the stage
+// @param [out] bitcode : Bitcode of the lowered module, upon hit
+// @returns : True upon hit
+bool Compiler::lookUpSpecializedModule(Context *context, const PipelineShaderInfo *shaderInfo,
+                                       unsigned forceLoopUnrollCount, SpecializedModuleCacheEntry *cacheEntry,
+                                       BinaryData *bitcode) {
+  MetroHash::Hash hash = generateHashForSpecializedModule(context, shaderInfo, forceLoopUnrollCount);
+
+  if (m_cache) {
+    HashId hashId = {};
+    static_assert(sizeof(HashId) == sizeof(hash), "Hash size is different!");
+    memcpy(&hashId.bytes, &hash.bytes, sizeof(hash));
+    if (lookUpCaches(nullptr, &hashId, bitcode, &cacheEntry->cacheEntry) == Result::Success)
+      return true;
+    cacheEntry->mustPopulate = !cacheEntry->cacheEntry.IsEmpty();
+    return false;
+  }
+
+  if (lookUpShaderCaches(nullptr, &hash, bitcode, &cacheEntry->shaderCache, &cacheEntry->hEntry) ==
+      ShaderEntryState::Ready)
+    return true;
+  cacheEntry->mustPopulate = cacheEntry->hEntry != nullptr;
+  return false;
+}
+
+// =====================================================================================================================
+// Populate the cache entry allocated by lookUpSpecializedModule with the lowered module of the stage, or reset it if
+// the stage failed to lower, and release the entry. The module is only serialized for an entry that this compile must
+// populate, and not at all if it is larger than -specialized-module-cache-max-insts, as writing the bitcode of a big
+// module can cost more than lowering it again.
+//
+// @param module : Lowered module of the stage, or nullptr if it failed to lower
+// @param [in/out] cacheEntry : Cache entry of the stage
+void Compiler::updateSpecializedModule(const Module *module, SpecializedModuleCacheEntry *cacheEntry) {
+  if (!cacheEntry->mustPopulate) {
+    // Nothing to populate, but the entry may still be held from a hit, whose bitcode has been loaded by now.
+    ReleaseCacheEntry(false, nullptr, &cacheEntry->cacheEntry);
+    releaseShaderCacheEntry(cacheEntry->shaderCache, cacheEntry->hEntry);
+    cacheEntry->hEntry = nullptr;
+    return;
+  }
+  cacheEntry->mustPopulate = false;
+
+  if (module && cl::SpecializedModuleCacheMaxInsts != 0) {
+    unsigned instCount = 0;
+    for (const Function &func : *module)
+      instCount += func.getInstructionCount();
+    if (instCount > cl::SpecializedModuleCacheMaxInsts)
+      module = nullptr;
+  }
+
+  ElfPackage bitcodeData;
+  if (module) {
+    raw_svector_ostream bitcodeStream(bitcodeData);
+    WriteBitcodeToFile(*module, bitcodeStream);
+  }
+  BinaryData bitcode = {};
+  bitcode.codeSize = bitcodeData.size();
+  bitcode.pCode = bitcodeData.data();
+
+  if (m_cache)
+    ReleaseCacheEntry(module != nullptr, &bitcode, &cacheEntry->cacheEntry);
+  else
+    updateShaderCache(module != nullptr, &bitcode, cacheEntry->shaderCache, cacheEntry->hEntry);
+  cacheEntry->hEntry = nullptr;
+}
+
 // =====================================================================================================================
 // Check shader cache for graphics pipeline, returning mask of which shader stages we want to keep in this compile.
 // This is called from the PatchCheckShaderCache pass (via a lambda in BuildPipelineInternal), to remove
@@ -1363,6 +1797,12 @@ void GraphicsShaderCacheChecker::updateAndMerge(Result result, ElfPackage *outpu
     (void(result)); // unused
     writer.mergeElfBinary(m_context, &fragmentElf, outputPipelineElf);
   }
+
+  // Release the shader cache entries the merged ELFs came from.
+  if (m_fragmentCacheEntryState == ShaderEntryState::Ready)
+    m_compiler->releaseShaderCacheEntry(m_fragmentShaderCache, m_hFragmentEntry);
+  if (m_nonFragmentCacheEntryState == ShaderEntryState::Ready)
+    m_compiler->releaseShaderCacheEntry(m_nonFragmentShaderCache, m_hNonFragmentEntry);
 }
 
 // =====================================================================================================================
@@ -1441,6 +1881,8 @@ Result Compiler::BuildGraphicsPipeline(const GraphicsPipelineBuildInfo *pipeline
   MetroHash::Hash pipelineHash = {};
   cacheHash = PipelineDumper::generateHashForGraphicsPipeline(pipelineInfo, true, buildingRelocatableElf);
   pipelineHash = PipelineDumper::generateHashForGraphicsPipeline(pipelineInfo, false, false);
+  CompileTelemetryRecorder telemetry(m_telemetryCallback, m_telemetryUserData, CompileTelemetryKind::GraphicsPipeline,
+                                     MetroHash::compact64(&pipelineHash));
 
   if (result == Result::Success && EnableOuts()) {
     LLPC_OUTS("===============================================================================\n");
@@ -1486,6 +1928,7 @@ Result Compiler::BuildGraphicsPipeline(const GraphicsPipelineBuildInfo *pipeline
       cacheResult = lookUpCaches(userCache, &hashId, &elfBin, &cacheEntry);
     else
       cacheEntryState = lookUpShaderCaches(appCache, &cacheHash, &elfBin, &shaderCache, &hEntry);
+    telemetry.addCacheLookup(m_cache ? cacheResult == Result::Success : cacheEntryState == ShaderEntryState::Ready);
   } else {
     cacheEntryState = ShaderEntryState::Compiling;
   }
@@ -1496,6 +1939,7 @@ Result Compiler::BuildGraphicsPipeline(const GraphicsPipelineBuildInfo *pipeline
     unsigned forceLoopUnrollCount = cl::ForceLoopUnrollCount;
 
     GraphicsContext graphicsContext(m_gfxIp, pipelineInfo, &pipelineHash, &cacheHash);
+    graphicsContext.setTelemetry(&telemetry);
     result = buildGraphicsPipelineInternal(&graphicsContext, shaderInfo, forceLoopUnrollCount, buildingRelocatableElf,
                                            &candidateElf);
 
@@ -1524,11 +1968,16 @@ Result Compiler::BuildGraphicsPipeline(const GraphicsPipelineBuildInfo *pipeline
     }
   }
 
+  // Release the shader cache entry the pipeline ELF was copied from.
+  if (cacheEntryState == ShaderEntryState::Ready)
+    releaseShaderCacheEntry(shaderCache, hEntry);
+
   if (m_cache) {
     bool withValue = (result == Result::Success) && (cacheResult != Result::Success);
     ReleaseCacheEntry(withValue, &elfBin, &cacheEntry);
   }
 
+  telemetry.setResult(result);
   return result;
 }
 
@@ -1578,6 +2027,8 @@ Result Compiler::BuildComputePipeline(const ComputePipelineBuildInfo *pipelineIn
   MetroHash::Hash pipelineHash = {};
   cacheHash = PipelineDumper::generateHashForComputePipeline(pipelineInfo, true, buildingRelocatableElf);
   pipelineHash = PipelineDumper::generateHashForComputePipeline(pipelineInfo, false, buildingRelocatableElf);
+  CompileTelemetryRecorder telemetry(m_telemetryCallback, m_telemetryUserData, CompileTelemetryKind::ComputePipeline,
+                                     MetroHash::compact64(&pipelineHash));
 
   if (result == Result::Success && EnableOuts()) {
     const ShaderModuleData *moduleData = reinterpret_cast<const ShaderModuleData *>(pipelineInfo->cs.pModuleData);
@@ -1619,6 +2070,7 @@ Result Compiler::BuildComputePipeline(const ComputePipelineBuildInfo *pipelineIn
       cacheResult = lookUpCaches(userCache, &hashId, &elfBin, &cacheEntry);
     else
       cacheEntryState = lookUpShaderCaches(appCache, &cacheHash, &elfBin, &shaderCache, &hEntry);
+    telemetry.addCacheLookup(m_cache ? cacheResult == Result::Success : cacheEntryState == ShaderEntryState::Ready);
   } else
     cacheEntryState = ShaderEntryState::Compiling;
 
@@ -1628,6 +2080,7 @@ Result Compiler::BuildComputePipeline(const ComputePipelineBuildInfo *pipelineIn
     unsigned forceLoopUnrollCount = cl::ForceLoopUnrollCount;
 
     ComputeContext computeContext(m_gfxIp, pipelineInfo, &pipelineHash, &cacheHash);
+    computeContext.setTelemetry(&telemetry);
 
     result = buildComputePipelineInternal(&computeContext, pipelineInfo, forceLoopUnrollCount, buildingRelocatableElf,
                                           &candidateElf);
@@ -1658,14 +2111,29 @@ Result Compiler::BuildComputePipeline(const ComputePipelineBuildInfo *pipelineIn
     }
   }
 
+  // Release the shader cache entry the pipeline ELF was copied from.
+  if (cacheEntryState == ShaderEntryState::Ready)
+    releaseShaderCacheEntry(shaderCache, hEntry);
+
   if (m_cache) {
     bool withValue = (result == Result::Success) && (cacheResult != Result::Success);
     ReleaseCacheEntry(withValue, &elfBin, &cacheEntry);
   }
 
+  telemetry.setResult(result);
   return result;
 }
 
+// =====================================================================================================================
+// Sets the callback that compile telemetry is reported to.
+//
+// @param callback : Telemetry callback, or nullptr to stop gathering telemetry
+// @param userData : User data passed to the callback
+void Compiler::SetCompileTelemetryCallback(CompileTelemetryCallback callback, void *userData) {
+  m_telemetryCallback = callback;
+  m_telemetryUserData = userData;
+}
+
 // =====================================================================================================================
 // Builds hash code from compilation-options
 //
@@ -1794,37 +2262,81 @@ Result Compiler::CreateShaderCache(const ShaderCacheCreateInfo *pCreateInfo, ISh
 
 // =====================================================================================================================
 // Acquires a free context from context pool.
+//
+// There is no per-thread free list: every acquire scans the shared pool while holding the pool lock for read, and
+// claims a free context with an atomic compare-and-swap on its in-use flag. Concurrent acquires therefore only contend
+// on the context they both try to claim. The scan first looks for the context this thread used last, so that its
+// warmed-up LgcContext and target machine stay on the same thread. The pool lock is taken for write to add a new
+// context, and to swap a context that reached -context-reuse-limit for a new one with std::replace.
 Context *Compiler::acquireContext() const {
   Context *freeContext = nullptr;
+  std::thread::id thisThread = std::this_thread::get_id();
+  ++m_contextAcquireCount;
 
-  std::lock_guard<sys::Mutex> lock(m_contextPoolMutex);
+  // Adds the time since the given start to the total time spent waiting for the pool lock.
+  auto addWaitTime = [](std::chrono::steady_clock::time_point waitStart) {
+    auto waitTime = std::chrono::steady_clock::now() - waitStart;
+    m_contextPoolWaitTime += std::chrono::duration_cast<std::chrono::nanoseconds>(waitTime).count();
+  };
 
-  // Try to find a free context from pool first
-  for (auto &context : *m_contextPool) {
+  auto isCompatible = [this](const Context *context) {
     GfxIpVersion gfxIpVersion = context->getGfxIpVersion();
+    return gfxIpVersion.major == m_gfxIp.major && gfxIpVersion.minor == m_gfxIp.minor &&
+           gfxIpVersion.stepping == m_gfxIp.stepping;
+  };
 
-    if (!context->isInUse() && gfxIpVersion.major == m_gfxIp.major && gfxIpVersion.minor == m_gfxIp.minor &&
-        gfxIpVersion.stepping == m_gfxIp.stepping) {
-      // Free up context if it is being used too many times to avoid consuming too much memory.
-      int contextReuseLimit = cl::ContextReuseLimit.getValue();
-      if (contextReuseLimit > 0 && context->getUseCount() > contextReuseLimit) {
-        delete context;
-        context = new Context(m_gfxIp);
+  {
+    auto waitStart = std::chrono::steady_clock::now();
+    sys::ScopedReader lock(m_contextPoolMutex);
+    addWaitTime(waitStart);
+
+    // Try the context last used by this thread first, then any free one.
+    for (Context *context : *m_contextPool) {
+      if (!context->isInUse() && context->getOwnerThread() == thisThread && isCompatible(context) &&
+          context->tryAcquire()) {
+        freeContext = context;
+        ++m_contextAffinityHits;
+        break;
       }
-      freeContext = context;
-      break;
+    }
+    for (unsigned i = 0; !freeContext && i < m_contextPool->size(); ++i) {
+      Context *context = (*m_contextPool)[i];
+      if (!context->isInUse() && isCompatible(context) && context->tryAcquire())
+        freeContext = context;
     }
   }
 
+  // Free up context if it is being used too many times to avoid consuming too much memory. The use count includes
+  // the use just claimed.
+  int contextReuseLimit = cl::ContextReuseLimit.getValue();
+  if (freeContext && contextReuseLimit > 0 && freeContext->getUseCount() > unsigned(contextReuseLimit) + 1) {
+    Context *newContext = new Context(m_gfxIp);
+    newContext->setInUse(true);
+    {
+      auto waitStart = std::chrono::steady_clock::now();
+      sys::ScopedWriter lock(m_contextPoolMutex);
+      addWaitTime(waitStart);
+      std::replace(m_contextPool->begin(), m_contextPool->end(), freeContext, newContext);
+    }
+    delete freeContext;
+    freeContext = newContext;
+    ++m_contextRecycleCount;
+  }
+
   if (!freeContext) {
     // Create a new one if we fail to find an available one
     freeContext = new Context(m_gfxIp);
-    m_contextPool->push_back(freeContext);
+    freeContext->setInUse(true);
+    {
+      auto waitStart = std::chrono::steady_clock::now();
+      sys::ScopedWriter lock(m_contextPoolMutex);
+      addWaitTime(waitStart);
+      m_contextPool->push_back(freeContext);
+    }
+    ++m_contextCreateCount;
   }
 
   assert(freeContext);
-  freeContext->setInUse(true);
-
   return freeContext;
 }
 
@@ -1855,18 +2367,36 @@ bool Compiler::runPasses(lgc::PassManager *passMgr, Module *module) const {
 //
 // @param context : LLPC context
 void Compiler::releaseContext(Context *context) const {
-  std::lock_guard<sys::Mutex> lock(m_contextPoolMutex);
+  // The context stays in the pool, so no lock is needed; clearing the in-use flag hands it back.
   context->reset();
   context->setInUse(false);
 }
 
+// =====================================================================================================================
+// Gets statistics of the context pool.
+ContextPoolStatistics Compiler::getContextPoolStatistics() {
+  ContextPoolStatistics statistics = {};
+  {
+    sys::ScopedReader lock(m_contextPoolMutex);
+    statistics.poolSize = m_contextPool ? m_contextPool->size() : 0;
+  }
+  statistics.acquireCount = m_contextAcquireCount;
+  statistics.affinityHits = m_contextAffinityHits;
+  statistics.createCount = m_contextCreateCount;
+  statistics.recycleCount = m_contextRecycleCount;
+  statistics.waitTimeNs = m_contextPoolWaitTime;
+  statistics.setupTimeSavedNs = LgcContext::getTotalSetupTimeSaved();
+  return statistics;
+}
+
 // =====================================================================================================================
 // Lookup in the shader caches with the given pipeline hash code.
 // It will try App's pipelince cache first if that's available.
 // Then try on the internal shader cache next if it misses.
 //
-// Upon hit, Ready is returned and pElfBin is filled in. Upon miss, Compiling is returned and ppShaderCache and
-// phEntry are filled in.
+// Upon hit, Ready is returned and pElfBin, ppShaderCache and phEntry are filled in. The caller must release the entry
+// with releaseShaderCacheEntry once it no longer uses pElfBin. Upon miss, Compiling is returned and ppShaderCache and
+// phEntry are filled in, and the caller must pass the entry to updateShaderCache.
 //
 // @param appPipelineCache : App's pipeline cache
 // @param cacheHash : Hash code of the shader
@@ -1890,17 +2420,25 @@ ShaderEntryState Compiler::lookUpShaderCaches(IShaderCache *appPipelineCache, Me
   for (unsigned i = 0; i < shaderCacheCount; i++) {
     // Lookup the shader. Allocate on miss when we've reached the last cache.
     bool allocateOnMiss = (i + 1) == shaderCacheCount;
-    CacheEntryHandle currentEntry;
+    CacheEntryHandle currentEntry = nullptr;
     ShaderEntryState cacheEntryState = shaderCache[i]->findShader(*cacheHash, allocateOnMiss, &currentEntry);
-    if (cacheEntryState == ShaderEntryState::Ready) {
-      Result result = shaderCache[i]->retrieveShader(currentEntry, &elfBin->pCode, &elfBin->codeSize);
-      if (result == Result::Success)
-        return ShaderEntryState::Ready;
-    } else if (cacheEntryState == ShaderEntryState::Compiling) {
+    if (cacheEntryState == ShaderEntryState::Ready &&
+        shaderCache[i]->retrieveShader(currentEntry, &elfBin->pCode, &elfBin->codeSize) != Result::Success) {
+      // The cached data failed its CRC check and has been dropped, so treat this as a miss: look the entry up again so
+      // that the caller compiles and re-inserts it, unless another thread has re-inserted it meanwhile.
+      shaderCache[i]->releaseShader(currentEntry);
+      currentEntry = nullptr;
+      cacheEntryState = shaderCache[i]->findShader(*cacheHash, allocateOnMiss, &currentEntry);
+      if (cacheEntryState == ShaderEntryState::Ready &&
+          shaderCache[i]->retrieveShader(currentEntry, &elfBin->pCode, &elfBin->codeSize) != Result::Success)
+        cacheEntryState = ShaderEntryState::Unavailable;
+    }
+    if (cacheEntryState == ShaderEntryState::Ready || cacheEntryState == ShaderEntryState::Compiling) {
       *ppShaderCache = shaderCache[i];
       *phEntry = currentEntry;
-      return ShaderEntryState::Compiling;
+      return cacheEntryState;
     }
+    shaderCache[i]->releaseShader(currentEntry);
   }
 
   // Unable to allocate an entry in a cache, but we can compile anyway.
@@ -1911,7 +2449,7 @@ ShaderEntryState Compiler::lookUpShaderCaches(IShaderCache *appPipelineCache, Me
 }
 
 // =====================================================================================================================
-// Update the shader caches with the given entry handle, based on the "insert" flag.
+// Update the shader caches with the given entry handle, based on the "insert" flag, and release the entry.
 //
 // @param insert : To insert data or reset the shader cache
 // @param elfBin : Pointer to shader data
@@ -1930,6 +2468,21 @@ void Compiler::updateShaderCache(bool insert, const BinaryData *elfBin, ShaderCa
     shaderCache->insertShader(hEntry, elfBin->pCode, elfBin->codeSize);
   } else
     shaderCache->resetShader(hEntry);
+  shaderCache->releaseShader(hEntry);
+}
+
+// =====================================================================================================================
+// Release an entry found Ready by lookUpShaderCaches, once the shader data retrieved from it is no longer used.
+//
+// @param shaderCache : Shader cache holding the entry (may be nullptr for default)
+// @param hEntry : Handle to release
+void Compiler::releaseShaderCacheEntry(ShaderCache *shaderCache, CacheEntryHandle hEntry) {
+  if (!hEntry)
+    return;
+
+  if (!shaderCache)
+    shaderCache = m_shaderCache.get();
+  shaderCache->releaseShader(hEntry);
 }
 
 // =====================================================================================================================
@@ -2055,6 +2608,7 @@ void Compiler::buildShaderCacheHash(Context *context, unsigned stageMask, ArrayR
     fragmentHasher.Update(pipelineOptions->extendedRobustness.robustBufferAccess);
     fragmentHasher.Update(pipelineOptions->extendedRobustness.robustImageAccess);
     fragmentHasher.Update(pipelineOptions->extendedRobustness.nullDescriptor);
+    fragmentHasher.Update(pipelineOptions->enableScalarLoadMerge);
     PipelineDumper::updateHashForFragmentState(pipelineInfo, &fragmentHasher);
     fragmentHasher.Finalize(fragmentHash->bytes);
   }
@@ -2091,9 +2645,58 @@ void Compiler::linkRelocatableShaderElf(ElfPackage *shaderElfs, ElfPackage *pipe
   }
   std::unique_ptr<ElfLinker> elfLinker(pipeline->createElfLinker(elfs));
 
+  // Take the glue shaders from the shader cache if we can, or compile them and add them to it. Entries found in the
+  // caches must stay held until the link is done, as the linker uses their blobs without copying them.
+  SmallVector<EntryHandle, 2> glueEntries;
+  SmallVector<std::pair<ShaderCache *, CacheEntryHandle>, 2> glueShaderCacheEntries;
+  ArrayRef<StringRef> glueInfo = cl::CacheGlueShaders ? elfLinker->getGlueInfo() : ArrayRef<StringRef>();
+  for (unsigned glueIndex = 0; glueIndex != glueInfo.size(); ++glueIndex) {
+    static const char GlueShaderTag[] = "GlueShader";
+    MetroHash64 hasher;
+    hasher.Update(m_optionHash);
+    hasher.Update(reinterpret_cast<const uint8_t *>(GlueShaderTag), sizeof(GlueShaderTag));
+    hasher.Update(m_gfxIp);
+    hasher.Update(reinterpret_cast<const uint8_t *>(glueInfo[glueIndex].data()), glueInfo[glueIndex].size());
+    MetroHash::Hash hash = {};
+    hasher.Finalize(hash.bytes);
+
+    BinaryData elfBin = {};
+    if (m_cache) {
+      HashId hashId = {};
+      memcpy(&hashId.bytes, &hash.bytes, sizeof(hash));
+      EntryHandle entry;
+      if (lookUpCaches(nullptr, &hashId, &elfBin, &entry) == Result::Success) {
+        elfLinker->addGlue(glueIndex, StringRef(static_cast<const char *>(elfBin.pCode), elfBin.codeSize));
+        glueEntries.push_back(std::move(entry));
+        continue;
+      }
+      StringRef glueElf = elfLinker->compileGlue(glueIndex);
+      elfBin.pCode = glueElf.data();
+      elfBin.codeSize = glueElf.size();
+      ReleaseCacheEntry(!glueElf.empty(), &elfBin, &entry);
+    } else {
+      ShaderCache *shaderCache = nullptr;
+      CacheEntryHandle hEntry = nullptr;
+      if (lookUpShaderCaches(nullptr, &hash, &elfBin, &shaderCache, &hEntry) == ShaderEntryState::Ready) {
+        elfLinker->addGlue(glueIndex, StringRef(static_cast<const char *>(elfBin.pCode), elfBin.codeSize));
+        glueShaderCacheEntries.push_back({shaderCache, hEntry});
+        continue;
+      }
+      StringRef glueElf = elfLinker->compileGlue(glueIndex);
+      elfBin.pCode = glueElf.data();
+      elfBin.codeSize = glueElf.size();
+      updateShaderCache(!glueElf.empty(), &elfBin, shaderCache, hEntry);
+    }
+  }
+
   // Do the link.
   raw_svector_ostream outStream(*pipelineElf);
-  if (!elfLinker->link(outStream)) {
+  bool linked = elfLinker->link(outStream);
+  for (EntryHandle &entry : glueEntries)
+    ReleaseCacheEntry(false, nullptr, &entry);
+  for (auto &glueShaderCacheEntry : glueShaderCacheEntries)
+    releaseShaderCacheEntry(glueShaderCacheEntry.first, glueShaderCacheEntry.second);
+  if (!linked) {
     // Link failed in a recoverable way.
     // TODO: Action this failure by doing a full pipeline compile.
     report_fatal_error("Link failed; need full pipeline compile instead: " + pipeline->getLastError());
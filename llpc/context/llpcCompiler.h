@@ -36,6 +36,8 @@
 #include "vkgcElfReader.h"
 #include "vkgcMetroHash.h"
 #include "lgc/CommonDefs.h"
+#include "llvm/Support/RWMutex.h"
+#include <atomic>
 
 namespace llvm {
 
@@ -100,6 +102,27 @@ private:
   Vkgc::EntryHandle m_fragmentEntry;
 };
 
+// =====================================================================================================================
+// Cache entry for the translated and lowered module of a shader stage that uses specialization constants.
+struct SpecializedModuleCacheEntry {
+  ShaderCache *shaderCache = nullptr; // Old shader cache holding the entry
+  CacheEntryHandle hEntry = nullptr;  // Entry in the old shader cache
+  Vkgc::EntryHandle cacheEntry;       // Entry in the client's ICache
+  bool mustPopulate = false;          // Whether this compile must populate (or release) the entry
+};
+
+// =====================================================================================================================
+// Statistics of the context pool, which is shared by all compiler instances.
+struct ContextPoolStatistics {
+  unsigned poolSize;         // Number of contexts in the pool
+  uint64_t acquireCount;     // Number of context acquisitions
+  uint64_t affinityHits;     // Number of acquisitions that got back the context last used by the same thread
+  uint64_t createCount;      // Number of contexts created
+  uint64_t recycleCount;     // Number of contexts recreated because they reached -context-reuse-limit
+  uint64_t waitTimeNs;       // Total time spent waiting for the context pool lock, in nanoseconds
+  uint64_t setupTimeSavedNs; // Time saved setting up new contexts by reusing cached target state, in nanoseconds
+};
+
 // =====================================================================================================================
 // Represents LLPC pipeline compiler.
 class Compiler : public ICompiler {
@@ -120,6 +143,9 @@ public:
 
   virtual Result BuildComputePipeline(const ComputePipelineBuildInfo *pipelineInfo,
                                       ComputePipelineBuildOut *pipelineOut, void *pipelineDumpFile = nullptr);
+
+  virtual void SetCompileTelemetryCallback(CompileTelemetryCallback callback, void *userData);
+
   Result buildGraphicsPipelineInternal(GraphicsContext *graphicsContext,
                                        llvm::ArrayRef<const PipelineShaderInfo *> shaderInfo,
                                        unsigned forceLoopUnrollCount, bool buildingRelocatableElf,
@@ -143,6 +169,8 @@ public:
 
   static MetroHash::Hash generateHashForCompileOptions(unsigned optionCount, const char *const *options);
 
+  static ContextPoolStatistics getContextPoolStatistics();
+
 #if LLPC_CLIENT_INTERFACE_MAJOR_VERSION < 38 || LLPC_ENABLE_SHADER_CACHE
   virtual Result CreateShaderCache(const ShaderCacheCreateInfo *pCreateInfo, IShaderCache **ppShaderCache);
 #endif
@@ -152,6 +180,8 @@ public:
 
   void updateShaderCache(bool insert, const BinaryData *elfBin, ShaderCache *shaderCache, CacheEntryHandle phEntry);
 
+  void releaseShaderCacheEntry(ShaderCache *shaderCache, CacheEntryHandle hEntry);
+
   Vkgc::Result lookUpCaches(Vkgc::ICache *appPipelineCache, Vkgc::HashId *cacheHash, BinaryData *elfBin,
                             Vkgc::EntryHandle *entryHandle);
 
@@ -174,20 +204,40 @@ private:
   void releaseContext(Context *context) const;
 
   bool runPasses(lgc::PassManager *passMgr, llvm::Module *module) const;
+  Result translateAndLowerInParallel(Context *context, llvm::ArrayRef<const PipelineShaderInfo *> shaderInfo,
+                                     unsigned forceLoopUnrollCount, llvm::MutableArrayRef<llvm::Module *> modules,
+                                     unsigned *stageSkipMask);
+  Result translateAndLowerShader(Context *context, const PipelineShaderInfo *shaderInfo, unsigned forceLoopUnrollCount,
+                                 ElfPackage *bitcode) const;
+  Result buildRelocatableStage(Context *context, llvm::ArrayRef<const PipelineShaderInfo *> shaderInfo, unsigned stage,
+                               unsigned forceLoopUnrollCount, ElfPackage *stageElf);
+  bool isSpecializedModuleCacheable(const PipelineShaderInfo *shaderInfo) const;
+  MetroHash::Hash generateHashForSpecializedModule(Context *context, const PipelineShaderInfo *shaderInfo,
+                                                   unsigned forceLoopUnrollCount) const;
+  bool lookUpSpecializedModule(Context *context, const PipelineShaderInfo *shaderInfo, unsigned forceLoopUnrollCount,
+                               SpecializedModuleCacheEntry *cacheEntry, BinaryData *bitcode);
+  void updateSpecializedModule(const llvm::Module *module, SpecializedModuleCacheEntry *cacheEntry);
   void linkRelocatableShaderElf(ElfPackage *shaderElfs, ElfPackage *pipelineElf, Context *context);
   bool canUseRelocatableGraphicsShaderElf(const llvm::ArrayRef<const PipelineShaderInfo *> &shaderInfo);
   bool canUseRelocatableComputeShaderElf(const PipelineShaderInfo *shaderInfo);
 
-  std::vector<std::string> m_options;           // Compilation options
-  MetroHash::Hash m_optionHash;                 // Hash code of compilation options
-  GfxIpVersion m_gfxIp;                         // Graphics IP version info
-  Vkgc::ICache *m_cache;                        // Point to ICache implemented in client
-  static unsigned m_instanceCount;              // The count of compiler instance
-  static unsigned m_outRedirectCount;           // The count of output redirect
-  ShaderCachePtr m_shaderCache;                 // Shader cache
-  static llvm::sys::Mutex m_contextPoolMutex;   // Mutex for context pool access
-  static std::vector<Context *> *m_contextPool; // Context pool
-  unsigned m_relocatablePipelineCompilations;   // The number of pipelines compiled using relocatable shader elf
+  std::vector<std::string> m_options;                 // Compilation options
+  MetroHash::Hash m_optionHash;                       // Hash code of compilation options
+  GfxIpVersion m_gfxIp;                               // Graphics IP version info
+  Vkgc::ICache *m_cache;                              // Point to ICache implemented in client
+  static unsigned m_instanceCount;                    // The count of compiler instance
+  static unsigned m_outRedirectCount;                 // The count of output redirect
+  ShaderCachePtr m_shaderCache;                       // Shader cache
+  static llvm::sys::RWMutex m_contextPoolMutex;       // Lock for changes to the context pool list
+  static std::vector<Context *> *m_contextPool;       // Context pool
+  static std::atomic<uint64_t> m_contextAcquireCount; // Number of context acquisitions
+  static std::atomic<uint64_t> m_contextAffinityHits; // Number of acquisitions reusing the thread's last context
+  static std::atomic<uint64_t> m_contextCreateCount;  // Number of contexts created
+  static std::atomic<uint64_t> m_contextRecycleCount; // Number of contexts recreated due to -context-reuse-limit
+  static std::atomic<uint64_t> m_contextPoolWaitTime; // Time spent waiting for the context pool lock, in ns
+  unsigned m_relocatablePipelineCompilations;         // The number of pipelines compiled using relocatable shader elf
+  CompileTelemetryCallback m_telemetryCallback;       // Callback to report compile telemetry to, if any
+  void *m_telemetryUserData;                          // User data passed to the telemetry callback
 };
 
 // Convert front-end LLPC shader stage to middle-end LGC shader stage
@@ -42,6 +42,7 @@
 #include "llvm/Bitstream/BitstreamReader.h"
 #include "llvm/Bitstream/BitstreamWriter.h"
 #include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Metadata.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Linker/Linker.h"
@@ -115,6 +116,92 @@ std::unique_ptr<Module> Context::loadLibary(const BinaryData *lib) {
   return libModule;
 }
 
+// =====================================================================================================================
+// Adds the functions referenced by the operands of a user, looking through constant expressions, to a worklist.
+//
+// @param user : User whose operands are scanned
+// @param [in/out] visited : Functions and constants seen so far
+// @param [in/out] worklist : Functions to materialize and scan
+static void addReferencedFunctions(User *user, SmallPtrSetImpl<Constant *> &visited,
+                                   SmallVectorImpl<Function *> &worklist) {
+  for (Value *operand : user->operands()) {
+    auto constant = dyn_cast<Constant>(operand);
+    if (!constant || isa<GlobalVariable>(constant) || !visited.insert(constant).second)
+      continue;
+    if (auto func = dyn_cast<Function>(constant))
+      worklist.push_back(func);
+    else
+      addReferencedFunctions(constant, visited, worklist);
+  }
+}
+
+// =====================================================================================================================
+// Loads the bitcode of a pre-lowered shader stage. Unlike loadLibary, only the function bodies reachable from the
+// entry-point (or from a global variable initializer) are materialized; the others are never read from the bitcode,
+// and are removed from the module.
+//
+// @param bitcode : Bitcode of the pre-lowered shader stage
+// @param [out] skippedFunctionCount : Count of function bodies that were not materialized
+std::unique_ptr<Module> Context::loadShaderBitcode(const BinaryData *bitcode, unsigned *skippedFunctionCount) {
+  *skippedFunctionCount = 0;
+  auto memBuffer =
+      MemoryBuffer::getMemBuffer(StringRef(static_cast<const char *>(bitcode->pCode), bitcode->codeSize), "", false);
+
+  Expected<std::unique_ptr<Module>> moduleOrErr = getLazyBitcodeModule(memBuffer->getMemBufferRef(), *this);
+  if (!moduleOrErr) {
+    consumeError(moduleOrErr.takeError());
+    LLPC_ERRS("Fails to load LLVM bitcode \n");
+    return nullptr;
+  }
+  std::unique_ptr<Module> module = std::move(*moduleOrErr);
+
+  // The entry-point is the function with a body and external linkage; global variable initializers may reference
+  // further functions.
+  SmallPtrSet<Constant *, 16> visited;
+  SmallVector<Function *, 8> worklist;
+  for (Function &func : *module) {
+    if (func.hasExternalLinkage() && (func.isMaterializable() || !func.empty()) && visited.insert(&func).second)
+      worklist.push_back(&func);
+  }
+  for (GlobalVariable &global : module->globals()) {
+    if (global.hasInitializer())
+      addReferencedFunctions(&global, visited, worklist);
+  }
+
+  while (!worklist.empty()) {
+    Function *func = worklist.pop_back_val();
+    if (Error errCode = func->materialize()) {
+      consumeError(std::move(errCode));
+      LLPC_ERRS("Fails to materialize \n");
+      return nullptr;
+    }
+    for (Instruction &inst : instructions(func))
+      addReferencedFunctions(&inst, visited, worklist);
+  }
+
+  // Turn the unreached functions into declarations, so materializing the rest of the module does not read them,
+  // then remove them.
+  SmallVector<Function *, 8> skippedFuncs;
+  for (Function &func : *module) {
+    if (func.isMaterializable()) {
+      func.deleteBody();
+      skippedFuncs.push_back(&func);
+    }
+  }
+  if (Error errCode = module->materializeAll()) {
+    consumeError(std::move(errCode));
+    LLPC_ERRS("Fails to materialize \n");
+    return nullptr;
+  }
+  for (Function *func : skippedFuncs) {
+    if (func->use_empty())
+      func->eraseFromParent();
+  }
+
+  *skippedFunctionCount = skippedFuncs.size();
+  return module;
+}
+
 // =====================================================================================================================
 // Sets triple and data layout in specified module from the context's target machine.
 //
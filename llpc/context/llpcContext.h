@@ -38,6 +38,8 @@
 #include "llvm/IR/Metadata.h"
 #include "llvm/IR/Type.h"
 #include "llvm/Target/TargetMachine.h"
+#include <atomic>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -57,15 +59,28 @@ public:
 
   // Set context in-use flag.
   void setInUse(bool inUse) {
-    if (!m_isInUse && inUse) {
+    if (!m_isInUse.exchange(inUse) && inUse) {
       ++m_useCount;
+      m_ownerThread = std::this_thread::get_id();
     }
-    m_isInUse = inUse;
+  }
+
+  // Atomically claims this context for the calling thread. Returns false if it is already in use.
+  bool tryAcquire() {
+    bool inUse = false;
+    if (!m_isInUse.compare_exchange_strong(inUse, true))
+      return false;
+    ++m_useCount;
+    m_ownerThread = std::this_thread::get_id();
+    return true;
   }
 
   // Get the number of times this context is used.
   unsigned getUseCount() const { return m_useCount; }
 
+  // Get the thread that most recently acquired this context.
+  std::thread::id getOwnerThread() const { return m_ownerThread; }
+
   // Attaches pipeline context to LLPC context.
   void attachPipelineContext(PipelineContext *pipelineContext) { m_pipelineContext = pipelineContext; }
 
@@ -103,6 +118,7 @@ public:
   bool getRobustBufferAccess() const { return m_robustBufferAccess; }
 
   std::unique_ptr<llvm::Module> loadLibary(const BinaryData *lib);
+  std::unique_ptr<llvm::Module> loadShaderBitcode(const BinaryData *bitcode, unsigned *skippedFunctionCount);
 
   // Wrappers of interfaces of pipeline context
   bool isGraphics() const { return m_pipelineContext->isGraphics(); }
@@ -141,7 +157,8 @@ private:
   GfxIpVersion m_gfxIp;                                  // Graphics IP version info
   PipelineContext *m_pipelineContext;                    // Pipeline-specific context
   EmuLib m_glslEmuLib;                                   // LLVM library for GLSL emulation
-  bool m_isInUse = false;                                // Whether this context is in use
+  std::atomic<bool> m_isInUse{false};                    // Whether this context is in use
+  std::atomic<std::thread::id> m_ownerThread{};          // Thread that most recently acquired this context
   lgc::Builder *m_builder = nullptr;                     // LLPC builder object
   std::unique_ptr<lgc::LgcContext> m_builderContext; // Builder context
 
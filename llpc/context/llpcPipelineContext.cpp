@@ -302,6 +302,7 @@ void PipelineContext::setOptionsInPipeline(Pipeline *pipeline) const {
   }
 
   options.allowNullDescriptor = getPipelineOptions()->extendedRobustness.nullDescriptor;
+  options.enableScalarLoadMerge = getPipelineOptions()->enableScalarLoadMerge;
   pipeline->setOptions(options);
 
   // Give the shader options (including the hash) to the middle-end.
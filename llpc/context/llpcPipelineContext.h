@@ -49,6 +49,8 @@ class Pipeline;
 
 namespace Llpc {
 
+class CompileTelemetryRecorder;
+
 // Enumerates types of descriptor.
 enum class DescriptorType : unsigned {
   UniformBlock = 0,   // Uniform block
@@ -126,6 +128,10 @@ public:
   uint64_t getPiplineHashCode() const { return MetroHash::compact64(&m_pipelineHash); }
   uint64_t getCacheHashCode() const { return MetroHash::compact64(&m_cacheHash); }
 
+  // Gets full pipeline and cache hash codes
+  const MetroHash::Hash &getPipelineHash() const { return m_pipelineHash; }
+  const MetroHash::Hash &getCacheHash() const { return m_cacheHash; }
+
   virtual ShaderHash getShaderHashCode(ShaderStage stage) const;
 
   // Gets per pipeline options
@@ -147,6 +153,12 @@ public:
   // Get whether we are building a relocatable (unlinked) ElF
   bool isUnlinked() const { return m_unlinked; }
 
+  // Set the recorder of the compile telemetry of the build call this pipeline is being compiled for
+  void setTelemetry(CompileTelemetryRecorder *telemetry) { m_telemetry = telemetry; }
+
+  // Get the recorder of the compile telemetry, or nullptr if not set
+  CompileTelemetryRecorder *getTelemetry() const { return m_telemetry; }
+
 protected:
   // Gets dummy vertex input create info
   virtual VkPipelineVertexInputStateCreateInfo *getDummyVertexInputInfo() { return nullptr; }
@@ -188,7 +200,8 @@ private:
   void setColorExportState(lgc::Pipeline *pipeline) const;
 
   ShaderFpMode m_shaderFpModes[ShaderStageCountInternal] = {};
-  bool m_unlinked = false; // Whether we are building an "unlinked" half-pipeline ELF
+  bool m_unlinked = false;                       // Whether we are building an "unlinked" half-pipeline ELF
+  CompileTelemetryRecorder *m_telemetry = nullptr; // Compile telemetry recorder, if any
 };
 
 } // namespace Llpc
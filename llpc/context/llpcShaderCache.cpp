@@ -33,7 +33,10 @@
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/DJB.h"
+#include "llvm/Support/Debug.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include <algorithm>
 #include <string.h>
 
 #define DEBUG_TYPE "llpc-shader-cache"
@@ -43,6 +46,27 @@ using namespace llvm;
 static cl::opt<std::string> ShaderCacheFilename("shader-cache-filename", cl::desc("Filename for the shader cache"),
                                                 cl::value_desc("filename"), cl::init(""));
 
+static cl::opt<bool> ShaderCacheMapFile("shader-cache-map-file",
+                                        cl::desc("Memory-map the on-disk shader cache file and verify each entry on "
+                                                 "first use instead of reading and verifying it at startup"),
+                                        cl::init(false));
+
+static cl::opt<unsigned> ShaderCacheCommitInterval(
+    "shader-cache-commit-interval",
+    cl::desc("Time in milliseconds the on-disk shader cache writer waits to group new shaders into one commit"),
+    cl::value_desc("ms"), cl::init(100));
+
+static cl::opt<unsigned> ShaderCacheMaxSize("shader-cache-max-size",
+                                            cl::desc("Maximum size in MB of the data held by the shader cache; least "
+                                                     "valuable entries are evicted beyond it (0 means unlimited)"),
+                                            cl::value_desc("MB"), cl::init(0));
+
+static cl::opt<Llpc::ShaderCacheEvictionPolicy> ShaderCacheEviction(
+    "shader-cache-eviction", cl::desc("Policy used to evict entries when the shader cache exceeds its maximum size"),
+    cl::init(Llpc::ShaderCacheEvictLru),
+    cl::values(clEnumValN(Llpc::ShaderCacheEvictLru, "lru", "Evict the least recently used entries first"),
+               clEnumValN(Llpc::ShaderCacheEvictLfu, "lfu", "Evict the least frequently used entries first")));
+
 namespace Llpc {
 
 #if defined(__unix__)
@@ -56,6 +80,9 @@ static const char ClientStr[] = "LLPC";
 static constexpr uint64_t CrcWidth = sizeof(uint64_t) * 8;
 static constexpr uint64_t CrcInitialValue = 0xFFFFFFFFFFFFFFFF;
 
+// Number of records appended to the on-disk file after which the writer rewrites the file header.
+static constexpr unsigned CheckpointRecordCount = 256;
+
 static const uint64_t CrcLookup[256] = {
     0x0000000000000000, 0xAD93D23594C935A9, 0xF6B4765EBD5B5EFB, 0x5B27A46B29926B52, 0x40FB3E88EE7F885F,
     0xED68ECBD7AB6BDF6, 0xB64F48D65324D6A4, 0x1BDC9AE3C7EDE30D, 0x81F67D11DCFF10BE, 0x2C65AF2448362517,
@@ -110,10 +137,108 @@ static const uint64_t CrcLookup[256] = {
     0xF989DB4A98BD5062, 0x541A097F0C7465CB, 0x4FC6939CCB9986C6, 0xE25541A95F50B36F, 0xB972E5C276C2D83D,
     0x14E137F7E20BED94};
 
+// =====================================================================================================================
+// Finds the entry with the specified key. Returns nullptr if there is none.
+//
+// @param key : Hash key of the shader
+ShaderIndex *ShaderIndexMap::find(const MetroHash::Hash &key) const {
+  if (m_size == 0)
+    return nullptr;
+
+  const size_t mask = m_slots.size() - 1;
+  for (size_t bucket = getBucket(key);; bucket = (bucket + 1) & mask) {
+    const Slot &slot = m_slots[bucket];
+    if (!slot.index)
+      return nullptr;
+    if (isEqual(slot.key, key))
+      return slot.index;
+  }
+}
+
+// =====================================================================================================================
+// Adds an entry. The key must not already be in the map.
+//
+// @param key : Hash key of the shader
+// @param index : Index data of the shader
+void ShaderIndexMap::insert(const MetroHash::Hash &key, ShaderIndex *index) {
+  assert(index && !find(key));
+
+  // Keep the load factor at or below 3/4 so that probe sequences stay short.
+  if ((m_size + 1) * 4 > m_slots.size() * 3)
+    grow();
+
+  const size_t mask = m_slots.size() - 1;
+  size_t bucket = getBucket(key);
+  while (m_slots[bucket].index)
+    bucket = (bucket + 1) & mask;
+  m_slots[bucket].key = key;
+  m_slots[bucket].index = index;
+  ++m_size;
+}
+
+// =====================================================================================================================
+// Removes the entry with the specified key. Returns false if there is none.
+//
+// @param key : Hash key of the shader
+bool ShaderIndexMap::erase(const MetroHash::Hash &key) {
+  if (m_size == 0)
+    return false;
+
+  const size_t mask = m_slots.size() - 1;
+  size_t hole = getBucket(key);
+  for (;; hole = (hole + 1) & mask) {
+    if (!m_slots[hole].index)
+      return false;
+    if (isEqual(m_slots[hole].key, key))
+      break;
+  }
+
+  // Move back each later entry of the probe sequence that would no longer be found past the hole, that is each one
+  // whose bucket is not cyclically in (hole, next].
+  for (size_t next = (hole + 1) & mask; m_slots[next].index; next = (next + 1) & mask) {
+    const size_t bucket = getBucket(m_slots[next].key);
+    if (((next - bucket) & mask) >= ((next - hole) & mask)) {
+      m_slots[hole] = m_slots[next];
+      hole = next;
+    }
+  }
+  m_slots[hole].index = nullptr;
+  --m_size;
+  return true;
+}
+
+// =====================================================================================================================
+// Removes all entries and releases the table.
+void ShaderIndexMap::clear() {
+  m_slots.clear();
+  m_slots.shrink_to_fit();
+  m_size = 0;
+}
+
+// =====================================================================================================================
+// Doubles the number of slots and rehashes the entries.
+void ShaderIndexMap::grow() {
+  std::vector<Slot> oldSlots(std::max(m_slots.size() * 2, size_t(16)), Slot());
+  oldSlots.swap(m_slots);
+
+  const size_t mask = m_slots.size() - 1;
+  for (const Slot &slot : oldSlots) {
+    if (!slot.index)
+      continue;
+    size_t bucket = getBucket(slot.key);
+    while (m_slots[bucket].index)
+      bucket = (bucket + 1) & mask;
+    m_slots[bucket] = slot;
+  }
+}
+
 // =====================================================================================================================
 ShaderCache::ShaderCache()
     : m_onDiskFile(), m_disableCache(true), m_shaderDataEnd(sizeof(ShaderCacheSerializedHeader)), m_totalShaders(0),
-      m_serializedSize(sizeof(ShaderCacheSerializedHeader)), m_getValueFunc(nullptr), m_storeValueFunc(nullptr) {
+      m_stopWriter(false), m_fileDataEnd(0), m_fileShaderCount(0), m_uncheckpointedRecords(0), m_queuedRecords(0),
+      m_processedRecords(0), m_maxSize(0), m_evictionPolicy(ShaderCacheEvictLru), m_liveBytes(0), m_useClock(0),
+      m_retiredRecordMark(0), m_fileHasEvictedRecords(false), m_missCount(0), m_evictCount(0), m_getValueFunc(nullptr),
+      m_storeValueFunc(nullptr) {
   memset(m_fileFullPath, 0, MaxFilePathLen);
   memset(&m_gfxIp, 0, sizeof(m_gfxIp));
 }
@@ -126,25 +251,46 @@ ShaderCache::~ShaderCache() {
 // =====================================================================================================================
 // Destruction, does clean-up work.
 void ShaderCache::Destroy() {
+  stopFileWriter();
+
+  LLVM_DEBUG(dbgs() << "Shader cache: " << getStatistics().hits << " hits, " << m_missCount << " misses, "
+                    << m_evictCount << " evictions, " << m_liveBytes << " live bytes\n");
+
+  // Rewrite the file without the entries evicted during this run (offline compaction).
+  if (m_onDiskFile.isOpen() && m_fileHasEvictedRecords) {
+    lockCacheFile();
+    compactLocked();
+    unlockCacheFile();
+  }
+
   if (m_onDiskFile.isOpen())
     m_onDiskFile.close();
+  if (m_lockFile.isOpen())
+    m_lockFile.close();
   resetRuntimeCache();
 }
 
 // =====================================================================================================================
 // Resets the runtime shader cache to an empty state. Releases all allocator memory and decommits it back to the OS.
 void ShaderCache::resetRuntimeCache() {
-  for (auto indexMap : m_shaderIndexMap)
-    delete indexMap.second;
-  m_shaderIndexMap.clear();
+  for (auto &shard : m_shards) {
+    for (ShaderIndex *index : shard.map)
+      freeEntry(index);
+    shard.map.clear();
+  }
+  for (ShaderIndex *index : m_retiredEntries)
+    freeEntry(index);
+  m_retiredEntries.clear();
+  m_fileHasEvictedRecords = false;
+  m_liveBytes = 0;
 
   for (auto allocIt : m_allocationList)
     delete[] allocIt.first;
   m_allocationList.clear();
+  m_mappedFile.reset();
 
   m_totalShaders = 0;
   m_shaderDataEnd = sizeof(ShaderCacheSerializedHeader);
-  m_serializedSize = sizeof(ShaderCacheSerializedHeader);
 }
 
 // =====================================================================================================================
@@ -158,47 +304,44 @@ void ShaderCache::resetRuntimeCache() {
 Result ShaderCache::Serialize(void *blob, size_t *size) {
   Result result = Result::Success;
 
+  // Only the data of Ready entries is serialized, so entries that have been evicted (or failed their CRC check) are
+  // left out even though their records may still be in the on-disk file.
+  lockCacheMap(true);
+  const size_t serializedSize = sizeof(ShaderCacheSerializedHeader) + m_liveBytes;
+
   if (*size == 0) {
     // Query shader cache serailzied size
-    (*size) = m_serializedSize;
-  } else {
-    // Do serialize
-    assert(m_shaderDataEnd == m_serializedSize || m_shaderDataEnd == sizeof(ShaderCacheSerializedHeader));
-
-    if (m_serializedSize >= sizeof(ShaderCacheSerializedHeader)) {
-      if (blob && (*size) >= m_serializedSize) {
-        // First construct the header and copy it into the memory provided
-        ShaderCacheSerializedHeader header = {};
-        header.headerSize = sizeof(ShaderCacheSerializedHeader);
-        header.shaderCount = m_totalShaders;
-        header.shaderDataEnd = m_shaderDataEnd;
-        getBuildTime(&header.buildId);
-
-        memcpy(blob, &header, sizeof(ShaderCacheSerializedHeader));
-
-        void *dataDst = voidPtrInc(blob, sizeof(ShaderCacheSerializedHeader));
-
-        // Then iterate through all allocators (which hold the backing memory for the shader data)
-        // and copy their contents to the blob.
-        for (auto it : m_allocationList) {
-          assert(it.first);
-
-          const size_t copySize = it.second;
-          if (voidPtrDiff(dataDst, blob) + copySize > (*size)) {
-            result = Result::ErrorUnknown;
-            break;
-          }
-
-          memcpy(dataDst, it.first, copySize);
-          dataDst = voidPtrInc(dataDst, copySize);
-        }
-      } else {
-        llvm_unreachable("Should never be called!");
-        result = Result::ErrorUnknown;
+    (*size) = serializedSize;
+  } else if (blob && (*size) >= serializedSize) {
+    // Do serialize: copy the data of every Ready entry after the header.
+    void *dataDst = voidPtrInc(blob, sizeof(ShaderCacheSerializedHeader));
+    size_t shaderCount = 0;
+    for (auto &shard : m_shards) {
+      for (ShaderIndex *index : shard.map) {
+        if (index->state != ShaderEntryState::Ready)
+          continue;
+        memcpy(dataDst, index->dataBlob, index->header.size);
+        dataDst = voidPtrInc(dataDst, index->header.size);
+        ++shaderCount;
       }
     }
+
+    // Then construct the header and copy it into the memory provided
+    ShaderCacheSerializedHeader header = {};
+    header.headerSize = sizeof(ShaderCacheSerializedHeader);
+    header.formatVersion = ShaderCacheFormatVersion;
+    header.shaderCount = shaderCount;
+    header.shaderDataEnd = voidPtrDiff(dataDst, blob);
+    getBuildTime(&header.buildId);
+    assert(header.shaderDataEnd == serializedSize);
+
+    memcpy(blob, &header, sizeof(ShaderCacheSerializedHeader));
+  } else {
+    llvm_unreachable("Should never be called!");
+    result = Result::ErrorUnknown;
   }
 
+  unlockCacheMap(true);
   return result;
 }
 
@@ -219,27 +362,36 @@ Result ShaderCache::Merge(unsigned srcCacheCount, const IShaderCache **ppSrcCach
     ShaderCache *srcCache = static_cast<ShaderCache *>(const_cast<IShaderCache *>(ppSrcCaches[i]));
     srcCache->lockCacheMap(true);
 
-    for (auto it : srcCache->m_shaderIndexMap) {
-      uint64_t key = it.first;
+    for (auto &srcShard : srcCache->m_shards) {
+      for (ShaderIndex *srcIndex : srcShard.map) {
+        const MetroHash::Hash &key = srcIndex->header.key;
+        // Skip entries that are still being compiled (or failed) in the source cache.
+        if (srcIndex->state != ShaderEntryState::Ready)
+          continue;
 
-      auto indexMap = m_shaderIndexMap.find(key);
-      if (indexMap == m_shaderIndexMap.end()) {
-        ShaderIndex *index = nullptr;
-        void *mem = getCacheSpace(it.second->header.size);
-        memcpy(mem, it.second->dataBlob, it.second->header.size);
+        ShaderIndexMap &indexMap = getShard(key).map;
+        if (!indexMap.find(key)) {
+          ShaderIndex *index = new ShaderIndex();
+          void *mem = allocateEntryData(index, srcIndex->header.size);
+          memcpy(mem, srcIndex->dataBlob, srcIndex->header.size);
 
-        index = new ShaderIndex;
-        index->dataBlob = mem;
-        index->state = ShaderEntryState::Ready;
-        index->header = it.second->header;
+          index->dataBlob = mem;
+          index->state = ShaderEntryState::Ready;
+          index->header = srcIndex->header;
+          index->crcVerified = srcIndex->crcVerified;
 
-        m_shaderIndexMap[key] = index;
-        m_totalShaders++;
+          indexMap.insert(key, index);
+          m_totalShaders++;
+          m_liveBytes += index->header.size;
+        }
       }
     }
     srcCache->unlockCacheMap(true);
   }
 
+  if (m_maxSize != 0 && m_liveBytes > m_maxSize)
+    evictToBudget();
+
   unlockCacheMap(false);
 
   return result;
@@ -260,6 +412,8 @@ Result ShaderCache::init(const ShaderCacheCreateInfo *createInfo, const ShaderCa
     m_storeValueFunc = createInfo->pfnStoreValueFunc;
     m_gfxIp = auxCreateInfo->gfxIp;
     m_hash = auxCreateInfo->hash;
+    m_maxSize = static_cast<size_t>(ShaderCacheMaxSize) * 1024 * 1024;
+    m_evictionPolicy = ShaderCacheEviction;
 
     lockCacheMap(false);
 
@@ -280,6 +434,14 @@ Result ShaderCache::init(const ShaderCacheCreateInfo *createInfo, const ShaderCa
       result = buildFileName(auxCreateInfo->executableName, auxCreateInfo->cacheFilePath, auxCreateInfo->gfxIp,
                              &cacheFileExists);
 
+      // Writers of the cache file in other processes are kept out until it has been loaded (and repaired if needed).
+      if (result == Result::Success && auxCreateInfo->shaderCacheMode != ShaderCacheEnableOnDiskReadOnly) {
+        std::string lockFilePath = std::string(m_fileFullPath) + ".lock";
+        if (m_lockFile.open(lockFilePath.c_str(), (FileAccessRead | FileAccessAppend | FileAccessBinary)) ==
+            Result::Success)
+          lockCacheFile();
+      }
+
       if (result == Result::Success) {
         // Open the storage file if it exists
         if (cacheFileExists) {
@@ -296,9 +458,15 @@ Result ShaderCache::init(const ShaderCacheCreateInfo *createInfo, const ShaderCa
       // If the cache file already existed, then we can try loading the data from it
       if (result == Result::Success) {
         if (cacheFileExists) {
-          loadResult = loadCacheFromFile();
+          loadResult = loadCacheFromFile(auxCreateInfo->shaderCacheMode == ShaderCacheEnableOnDiskReadOnly);
           if (auxCreateInfo->shaderCacheMode == ShaderCacheEnableOnDiskReadOnly && loadResult == Result::Success)
             m_onDiskFile.close();
+
+          // If the file holds more than the budget allows, trim it now while nothing else uses the cache.
+          if (loadResult == Result::Success && m_maxSize != 0 && m_liveBytes > m_maxSize) {
+            evictToBudget();
+            compactLocked();
+          }
         } else
           resetCacheFile();
       }
@@ -307,6 +475,12 @@ Result ShaderCache::init(const ShaderCacheCreateInfo *createInfo, const ShaderCa
       // any memory allocated
       if (loadResult != Result::Success)
         resetRuntimeCache();
+
+      unlockCacheFile();
+
+      // New shaders are appended to the file by the background writer.
+      if (m_onDiskFile.isOpen())
+        startFileWriter();
     }
 
     unlockCacheMap(false);
@@ -359,20 +533,79 @@ Result ShaderCache::buildFileName(const char *executableName, const char *cacheF
 }
 
 // =====================================================================================================================
-// Resets the contents of the cache file, assumes the shader cache has been locked for writes.
+// Resets the contents of the cache file, assumes the shader cache has been locked for writes. If the file cannot be
+// replaced, the cache goes on without an on-disk file.
 void ShaderCache::resetCacheFile() {
-  m_onDiskFile.close();
-  Result fileResult = m_onDiskFile.open(m_fileFullPath, (FileAccessRead | FileAccessWrite | FileAccessBinary));
-  assert(fileResult == Result::Success);
-  (void(fileResult)); // unused
+  rewriteCacheFile({});
+}
 
+// =====================================================================================================================
+// Replaces the cache file with one holding the specified entries, and reopens it for appending. The new contents are
+// written to a temporary file that is then renamed over the cache file, so the file is never truncated in place: other
+// processes that have the old file open or mapped keep seeing its complete contents. The on-disk file is left closed
+// on failure.
+//
+// NOTE: This function assumes that the shader cache has been locked for writes, that the writer thread is not running
+// and that the caller holds the cache file lock. Any mapping of the file by this cache stays valid.
+//
+// @param entries : Ready entries to write to the new file, in order
+Result ShaderCache::rewriteCacheFile(ArrayRef<ShaderIndex *> entries) {
   ShaderCacheSerializedHeader header = {};
   header.headerSize = sizeof(ShaderCacheSerializedHeader);
-  header.shaderCount = 0;
+  header.formatVersion = ShaderCacheFormatVersion;
+  header.shaderCount = entries.size();
   header.shaderDataEnd = header.headerSize;
   getBuildTime(&header.buildId);
+  for (const ShaderIndex *index : entries)
+    header.shaderDataEnd += index->header.size;
+
+  std::string tempFilePath = std::string(m_fileFullPath) + ".tmp";
+  File tempFile;
+  Result result = tempFile.open(tempFilePath.c_str(), (FileAccessWrite | FileAccessBinary));
+  if (result == Result::Success) {
+    result = tempFile.write(&header, header.headerSize);
+    for (const ShaderIndex *index : entries) {
+      if (result != Result::Success)
+        break;
+      result = tempFile.write(index->dataBlob, index->header.size);
+    }
+    if (result == Result::Success)
+      result = tempFile.sync();
+    tempFile.close();
+  }
 
-  m_onDiskFile.write(&header, header.headerSize);
+  // Windows cannot rename over a file that is still open, so the old file is closed first.
+  m_onDiskFile.close();
+  if (result == Result::Success && sys::fs::rename(tempFilePath, m_fileFullPath))
+    result = Result::ErrorUnknown;
+  if (result != Result::Success)
+    sys::fs::remove(tempFilePath);
+
+  if (result == Result::Success)
+    result = m_onDiskFile.open(m_fileFullPath, (FileAccessReadUpdate | FileAccessBinary));
+  if (result == Result::Success) {
+    m_fileShaderCount = header.shaderCount;
+    m_fileDataEnd = header.shaderDataEnd;
+    m_uncheckpointedRecords = 0;
+  } else
+    LLVM_DEBUG(dbgs() << "Shader cache file " << m_fileFullPath << " could not be rewritten\n");
+
+  return result;
+}
+
+// =====================================================================================================================
+// Takes the lock that serializes the writes to the cache file by different processes. Does nothing if the cache has no
+// lock file, as in read-only mode.
+void ShaderCache::lockCacheFile() {
+  if (m_lockFile.isOpen())
+    m_lockFile.lock();
+}
+
+// =====================================================================================================================
+// Releases the lock taken by lockCacheFile.
+void ShaderCache::unlockCacheFile() {
+  if (m_lockFile.isOpen())
+    m_lockFile.unlock();
 }
 
 // =====================================================================================================================
@@ -383,6 +616,9 @@ void ShaderCache::resetCacheFile() {
 //    Compiling   - if an entry was created and must be compiled/populated by the caller
 //    Unavailable - if an unrecoverable error was encountered
 //
+// A returned handle holds a reference on the entry, which the caller must drop with releaseShader once it no longer
+// uses the handle or the data retrieved through it.
+//
 // @param hash : Hash code of shader
 // @param allocateOnMiss : Whether allocate a new entry for new hash
 // @param [out] phEntry : Handle of shader cache entry
@@ -399,57 +635,81 @@ ShaderEntryState ShaderCache::findShader(MetroHash::Hash hash, bool allocateOnMi
   Result mapResult = Result::Success;
   assert(phEntry);
 
-  bool readOnlyLock = (!allocateOnMiss);
-  lockCacheMap(readOnlyLock);
-  uint64_t hashKey = MetroHash::compact64(&hash);
-  auto indexMap = m_shaderIndexMap.find(hashKey);
-  if (indexMap != m_shaderIndexMap.end()) {
-    existed = true;
-    index = indexMap->second;
-  } else if (allocateOnMiss) {
-    index = new ShaderIndex;
-    m_shaderIndexMap[hashKey] = index;
+  ShaderIndexShard &shard = getShard(hash);
+
+  // Fast path: the entry exists and is already Ready, which only requires a shared lock on its shard. Ready entries
+  // are immutable, and the reference taken here keeps the entry and its data from being freed if it is evicted before
+  // the caller releases it.
+  {
+    sys::ScopedReader readLock(shard.lock);
+    if (ShaderIndex *found = shard.map.find(hash)) {
+      existed = true;
+      if (found->state == ShaderEntryState::Ready) {
+        found->refCount.fetch_add(1);
+        recordHit(found);
+        (*phEntry) = found;
+        return ShaderEntryState::Ready;
+      }
+    }
+  }
+
+  // Nothing to allocate and nothing to wait for.
+  if (!existed && !allocateOnMiss)
+    return result;
+
+  // Slow path: the entry is missing, new or being compiled, so take the shard exclusively. Re-check the map since
+  // another thread may have changed it after the shared lock was released.
+  shard.lock.lock();
+  index = shard.map.find(hash);
+  existed = index != nullptr;
+  if (!existed && allocateOnMiss) {
+    index = new ShaderIndex();
+    index->header.key = hash;
+    shard.map.insert(hash, index);
   }
 
   if (!index)
     mapResult = Result::ErrorUnavailable;
 
   if (mapResult == Result::Success) {
-    if (existed) {
-      // We don't need to hold on to the write lock if we're not the one doing the compile
-      if (!readOnlyLock) {
-        unlockCacheMap(readOnlyLock);
-        readOnlyLock = true;
-        lockCacheMap(readOnlyLock);
-      }
-    } else {
+    if (!existed) {
       bool needsInit = true;
 
       // We didn't find the entry in our own hash map, now search the external cache if available
       if (useExternalCache()) {
+        // The external cache interface is keyed on the compacted 64-bit hash; the full key stored in the returned
+        // data is checked below, so that a collision in the external cache is treated as a miss.
+        const uint64_t externalKey = MetroHash::compact64(&hash);
+
         // The first call to the external cache queries the existence and the size of the cached shader.
-        Result extResult = m_getValueFunc(m_clientData, hashKey, nullptr, &index->header.size);
+        Result extResult = m_getValueFunc(m_clientData, externalKey, nullptr, &index->header.size);
         if (extResult == Result::Success) {
           // An entry was found matching our hash, we should allocate memory to hold the data and call again
           assert(index->header.size > 0);
-          index->dataBlob = getCacheSpace(index->header.size);
+          index->dataBlob = allocateEntryData(index, index->header.size);
 
           if (!index->dataBlob)
             extResult = Result::ErrorOutOfMemory;
           else {
-            extResult = m_getValueFunc(m_clientData, hashKey, index->dataBlob, &index->header.size);
+            extResult = m_getValueFunc(m_clientData, externalKey, index->dataBlob, &index->header.size);
           }
         }
 
+        // The first item in the data blob is a ShaderHeader, followed by the serialized data blob for the shader.
+        // Data stored by another shader with the same compacted key, or in a different format, is not ours.
+        const auto *const header = static_cast<const ShaderHeader *>(index->dataBlob);
+        if (extResult == Result::Success &&
+            (index->header.size <= sizeof(ShaderHeader) || header->size != index->header.size ||
+             memcmp(&header->key, &hash, sizeof(hash)) != 0))
+          extResult = Result::NotFound;
+
         if (extResult == Result::Success) {
           // We now have a copy of the shader data from the external cache, just need to update the
-          // ShaderIndex. The first item in the data blob is a ShaderHeader, followed by the serialized
-          // data blob for the shader.
-          const auto *const header = static_cast<const ShaderHeader *>(index->dataBlob);
-          assert(index->header.size == header->size);
-
+          // ShaderIndex.
           index->header = (*header);
           index->state = ShaderEntryState::Ready;
+          index->crcVerified = true;
+          m_liveBytes += index->header.size;
           needsInit = false;
         } else if (extResult == Result::ErrorUnavailable) {
           // This means the external cache is unavailable and we shouldn't bother using it anymore. To
@@ -466,24 +726,19 @@ ShaderEntryState ShaderCache::findShader(MetroHash::Hash hash, bool allocateOnMi
       }
 
       if (needsInit) {
-        // This is a brand new cache entry so we need to initialize the ShaderIndex.
-        memset(index, 0, sizeof(*index));
-        index->header.key = hashKey;
+        // This is a brand new cache entry so we need to initialize the ShaderIndex. Space allocated for data from the
+        // external cache that turned out to be unusable is given back.
+        releaseEntryData(index);
+        index->header = {};
+        index->header.key = hash;
+        index->dataBlob = nullptr;
         index->state = ShaderEntryState::New;
       }
     } // End if (existed == false)
 
     if (index->state == ShaderEntryState::Compiling) {
       // The shader is being compiled by another thread, we should release the lock and wait for it to complete
-      while (index->state == ShaderEntryState::Compiling) {
-        unlockCacheMap(readOnlyLock);
-        {
-          std::unique_lock<std::mutex> lock(m_conditionMutex);
-
-          m_conditionVariable.wait_for(lock, std::chrono::seconds(1));
-        }
-        lockCacheMap(readOnlyLock);
-      }
+      waitForEntry(shard, index);
       // At this point the shader entry is either Ready, New or something failed. We've already
       // initialized our result code to an error code above, the Ready and New cases are handled below so
       // nothing else to do here.
@@ -492,18 +747,24 @@ ShaderEntryState ShaderCache::findShader(MetroHash::Hash hash, bool allocateOnMi
     if (index->state == ShaderEntryState::Ready) {
       // The shader has been compiled, just verify it has valid data and then return success.
       assert(index->dataBlob && index->header.size != 0);
+      recordHit(index);
     } else if (index->state == ShaderEntryState::New) {
       // The shader entry is new (or previously failed compilation) and we're the first thread to get a
       // crack at it, move it into the Compiling state
       index->state = ShaderEntryState::Compiling;
+      ++m_missCount;
     }
 
     // Return the ShaderIndex as a handle so subsequent calls into the cache can avoid the hash map lookup.
+    index->refCount.fetch_add(1);
     (*phEntry) = index;
     result = index->state;
   }
 
-  unlockCacheMap(readOnlyLock);
+  shard.lock.unlock();
+
+  // Shader data may have been fetched from the external cache.
+  checkBudget();
 
   return result;
 }
@@ -520,7 +781,8 @@ void ShaderCache::insertShader(CacheEntryHandle hEntry, const void *blob, size_t
   assert(m_disableCache == false);
   assert(index && index->state == ShaderEntryState::Compiling);
 
-  lockCacheMap(false);
+  ShaderIndexShard &shard = getShard(index->header.key);
+  shard.lock.lock();
 
   Result result = Result::Success;
 
@@ -528,13 +790,11 @@ void ShaderCache::insertShader(CacheEntryHandle hEntry, const void *blob, size_t
     // Allocate space to store the serialized shader and a copy of the header. The header is duplicated in the
     // data to simplify serialize/load.
     index->header.size = (shaderSize + sizeof(ShaderHeader));
-    index->dataBlob = getCacheSpace(index->header.size);
+    index->dataBlob = allocateEntryData(index, index->header.size);
 
     if (!index->dataBlob)
       result = Result::ErrorOutOfMemory;
     else {
-      ++m_totalShaders;
-
       auto *const header = static_cast<ShaderHeader *>(index->dataBlob);
       void *const dataBlob = (header + 1);
 
@@ -548,7 +808,8 @@ void ShaderCache::insertShader(CacheEntryHandle hEntry, const void *blob, size_t
 
       if (useExternalCache()) {
         // If we're making use of the external shader cache then we need to store the compiled shader data here.
-        Result externalResult = m_storeValueFunc(m_clientData, index->header.key, index->dataBlob, index->header.size);
+        Result externalResult = m_storeValueFunc(m_clientData, MetroHash::compact64(&index->header.key),
+                                                 index->dataBlob, index->header.size);
         if (externalResult == Result::ErrorUnavailable) {
           // This is the only return code we can do anything about. In this case it means the external cache
           // is not available and we should zero out the function pointers to avoid making useless calls on
@@ -561,10 +822,17 @@ void ShaderCache::insertShader(CacheEntryHandle hEntry, const void *blob, size_t
         }
       }
 
-      // Mark this entry as ready, we'll wake the waiting threads once we release the lock
+      // Mark this entry as ready, we'll wake the waiting threads before we release the lock
       index->state = ShaderEntryState::Ready;
+      index->crcVerified = true;
+      m_liveBytes += index->header.size;
+
+      // Advance the use clock once per insertion, so that hits only have to read it.
+      m_useClock.fetch_add(1, std::memory_order_relaxed);
 
-      // Finally, update the file if necessary.
+      // Finally, update the shader count and the file if necessary.
+      sys::ScopedLock allocLock(m_allocLock);
+      ++m_totalShaders;
       if (m_onDiskFile.isOpen())
         addShaderToFile(index);
     }
@@ -580,8 +848,11 @@ void ShaderCache::insertShader(CacheEntryHandle hEntry, const void *blob, size_t
     index->dataBlob = nullptr;
   }
 
-  unlockCacheMap(false);
-  m_conditionVariable.notify_all();
+  // Wake the threads waiting for this entry now that it is either Ready or New again.
+  signalEntry(index);
+  shard.lock.unlock();
+
+  checkBudget();
 }
 
 // =====================================================================================================================
@@ -592,12 +863,51 @@ void ShaderCache::resetShader(CacheEntryHandle hEntry) {
   auto *const index = static_cast<ShaderIndex *>(hEntry);
   assert(m_disableCache == false);
   assert(index && index->state == ShaderEntryState::Compiling);
-  lockCacheMap(false);
+  ShaderIndexShard &shard = getShard(index->header.key);
+  shard.lock.lock();
   index->state = ShaderEntryState::New;
   index->header.size = 0;
   index->dataBlob = nullptr;
-  unlockCacheMap(false);
-  m_conditionVariable.notify_all();
+  signalEntry(index);
+  shard.lock.unlock();
+}
+
+// =====================================================================================================================
+// Releases a handle returned by findShader. An entry that has been evicted is freed, together with its data, once all
+// of its handles have been released.
+//
+// @param hEntry : Handle of shader cache entry, or null
+void ShaderCache::releaseShader(CacheEntryHandle hEntry) {
+  auto *const index = static_cast<ShaderIndex *>(hEntry);
+  if (!index)
+    return;
+  assert(index->refCount > 0);
+  // No lock is needed: entries are only freed with every shard locked, and only once their count has dropped to zero.
+  index->refCount.fetch_sub(1);
+}
+
+// =====================================================================================================================
+// Blocks until the specified entry leaves the Compiling state. This function assumes that the shard lock has been taken
+// exclusively by the calling function; the lock is released while waiting and held again on return.
+//
+// @param shard : Shard the entry belongs to
+// @param index : Entry being compiled by another thread
+void ShaderCache::waitForEntry(ShaderIndexShard &shard, ShaderIndex *index) {
+  if (!index->readyEvent)
+    index->readyEvent.reset(new std::condition_variable_any);
+
+  // The state only changes under the shard lock and the producer signals before releasing it, so no wakeup is lost.
+  index->readyEvent->wait(shard.lock, [index] { return index->state != ShaderEntryState::Compiling; });
+}
+
+// =====================================================================================================================
+// Wakes all threads waiting for the specified entry. This function assumes that the shard lock has been taken
+// exclusively by the calling function.
+//
+// @param index : Entry that has just left the Compiling state
+void ShaderCache::signalEntry(ShaderIndex *index) {
+  if (index->readyEvent)
+    index->readyEvent->notify_all();
 }
 
 // =====================================================================================================================
@@ -607,49 +917,161 @@ void ShaderCache::resetShader(CacheEntryHandle hEntry) {
 // @param [out] ppBlob : Shader data
 // @param [out] size : size of shader data in bytes
 Result ShaderCache::retrieveShader(CacheEntryHandle hEntry, const void **ppBlob, size_t *size) {
-  const auto *const index = static_cast<ShaderIndex *>(hEntry);
+  auto *const index = static_cast<ShaderIndex *>(hEntry);
 
   assert(m_disableCache == false);
   assert(index);
-  assert(index->header.size >= sizeof(ShaderHeader));
 
-  lockCacheMap(true);
+  ShaderIndexShard &shard = getShard(index->header.key);
+  bool readOnlyLock = true;
+  shard.lock.lock_shared();
+
+  if (!index->crcVerified) {
+    // Entries loaded by mapping the cache file are verified on first retrieval rather than at load time.
+    shard.lock.unlock_shared();
+    shard.lock.lock();
+    readOnlyLock = false;
+
+    if (!index->crcVerified && index->state == ShaderEntryState::Ready) {
+      const uint64_t crc = calculateCrc(static_cast<const uint8_t *>(voidPtrInc(index->dataBlob, sizeof(ShaderHeader))),
+                                        index->header.size - sizeof(ShaderHeader));
+      if (crc == index->header.crc)
+        index->crcVerified = true;
+      else {
+        // The data is corrupted. Drop it so that the next lookup compiles the shader again.
+        LLVM_DEBUG(dbgs() << "Shader cache entry " << format_hex(MetroHash::compact64(&index->header.key), 18)
+                          << " failed CRC check\n");
+        if (shard.map.find(index->header.key) == index) // Evicted entries are no longer counted
+          m_liveBytes -= index->header.size;
+        index->state = ShaderEntryState::New;
+        index->header.size = 0;
+        releaseEntryData(index);
+      }
+    }
+  }
 
-  *ppBlob = voidPtrInc(index->dataBlob, sizeof(ShaderHeader));
-  *size = index->header.size - sizeof(ShaderHeader);
+  Result result = Result::ErrorUnknown;
+  if (index->state == ShaderEntryState::Ready) {
+    assert(index->header.size >= sizeof(ShaderHeader));
+    *ppBlob = voidPtrInc(index->dataBlob, sizeof(ShaderHeader));
+    *size = index->header.size - sizeof(ShaderHeader);
+    result = *size > 0 ? Result::Success : Result::ErrorUnknown;
+  }
 
-  unlockCacheMap(true);
+  if (readOnlyLock)
+    shard.lock.unlock_shared();
+  else
+    shard.lock.unlock();
 
-  return *size > 0 ? Result::Success : Result::ErrorUnknown;
+  return result;
 }
 
 // =====================================================================================================================
-// Adds data for a new shader to the on-disk file
+// Queues the data of a new shader to be appended to the on-disk file by the writer thread. This function assumes that
+// the allocation lock has been taken by the calling function.
 //
 // @param index : A new shader
 void ShaderCache::addShaderToFile(const ShaderIndex *index) {
   assert(m_onDiskFile.isOpen());
 
-  // We only need to update the parts of the file that changed, which is the number of shaders, the new data section,
-  // and the shaderDataEnd.
+  // The data blob is immutable once the entry is Ready and lives until the cache is destroyed, which stops the writer
+  // first, so only its location needs to be queued.
+  m_shaderDataEnd += index->header.size;
+  {
+    std::lock_guard<std::mutex> lock(m_writerMutex);
+    m_pendingRecords.push_back(std::make_pair(index->dataBlob, index->header.size));
+    ++m_queuedRecords;
+  }
+  m_writerCondition.notify_one();
+}
+
+// =====================================================================================================================
+// Starts the thread that appends new shaders to the on-disk file. The file must be open and positioned anywhere; the
+// writer continues from the current end of the shader data.
+void ShaderCache::startFileWriter() {
+  assert(m_onDiskFile.isOpen() && !m_writerThread.joinable());
+  m_fileDataEnd = m_shaderDataEnd;
+  m_fileShaderCount = m_totalShaders;
+  m_uncheckpointedRecords = 0;
+  m_stopWriter = false;
+  m_writerThread = std::thread([this] { runFileWriter(); });
+}
 
-  // Calculate the header offsets, then write the relavent data to the file.
+// =====================================================================================================================
+// Stops the writer thread, after it has written all queued records and a final checkpoint.
+void ShaderCache::stopFileWriter() {
+  if (!m_writerThread.joinable())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(m_writerMutex);
+    m_stopWriter = true;
+  }
+  m_writerCondition.notify_one();
+  m_writerThread.join();
+}
+
+// =====================================================================================================================
+// Body of the writer thread. Queued records are appended in groups: after the first record of a group arrives, the
+// writer waits up to the commit interval for more, writes them all at the end of the data and syncs the file once.
+// The file header is only rewritten at checkpoints, so a crash can at worst leave a torn record after the last
+// checkpoint, which is discarded by recoverCacheFileTail when the file is loaded again. Each group is written under
+// the cache file lock, so another process never loads (and repairs) the file while a group is half written.
+void ShaderCache::runFileWriter() {
+  std::vector<std::pair<const void *, size_t>> records;
+  std::unique_lock<std::mutex> lock(m_writerMutex);
+
+  for (;;) {
+    m_writerCondition.wait(lock, [this] { return m_stopWriter || !m_pendingRecords.empty(); });
+    if (!m_stopWriter) {
+      // Give other compile threads a chance to add their shaders to this group.
+      m_writerCondition.wait_for(lock, std::chrono::milliseconds(ShaderCacheCommitInterval),
+                                 [this] { return m_stopWriter; });
+    }
+    records.swap(m_pendingRecords);
+    const bool stop = m_stopWriter;
+    lock.unlock();
+
+    lockCacheFile();
+    if (!records.empty()) {
+      m_onDiskFile.seek(static_cast<int64_t>(m_fileDataEnd), true);
+      for (const auto &record : records) {
+        if (m_onDiskFile.write(record.first, record.second) != Result::Success)
+          break;
+        m_fileDataEnd += record.second;
+        ++m_fileShaderCount;
+        ++m_uncheckpointedRecords;
+      }
+      m_onDiskFile.sync();
+      // The data of evicted entries may be freed once the writer is done with their records.
+      m_processedRecords += records.size();
+      records.clear();
+    }
+
+    if (m_uncheckpointedRecords > 0 && (stop || m_uncheckpointedRecords >= CheckpointRecordCount))
+      writeFileCheckpoint();
+    unlockCacheFile();
+
+    if (stop)
+      return;
+    lock.lock();
+  }
+}
+
+// =====================================================================================================================
+// Records the shader count and data end of the records written so far in the file header. Only called once the
+// records themselves have been synced, so the header never refers to data that is not on disk.
+void ShaderCache::writeFileCheckpoint() {
   const unsigned shaderCountOffset = offsetof(struct ShaderCacheSerializedHeader, shaderCount);
   const unsigned dataEndOffset = offsetof(struct ShaderCacheSerializedHeader, shaderDataEnd);
 
   m_onDiskFile.seek(shaderCountOffset, true);
-  m_onDiskFile.write(&m_totalShaders, sizeof(size_t));
-
-  // Write the new shader data at the current end of the data section
-  m_onDiskFile.seek(static_cast<unsigned>(m_shaderDataEnd), true);
-  m_onDiskFile.write(index->dataBlob, index->header.size);
-
-  // Then update the data end value and write it out to the file.
-  m_shaderDataEnd += index->header.size;
+  m_onDiskFile.write(&m_fileShaderCount, sizeof(size_t));
   m_onDiskFile.seek(dataEndOffset, true);
-  m_onDiskFile.write(&m_shaderDataEnd, sizeof(size_t));
+  m_onDiskFile.write(&m_fileDataEnd, sizeof(size_t));
+  m_onDiskFile.sync();
 
-  m_onDiskFile.flush();
+  m_uncheckpointedRecords = 0;
 }
 
 // =====================================================================================================================
@@ -658,7 +1080,9 @@ void ShaderCache::addShaderToFile(const ShaderIndex *index) {
 //
 // NOTE: This function assumes that a write lock has already been taken by the calling function and that the on-disk
 // file has been successfully opened and the file position is the beginning of the file.
-Result ShaderCache::loadCacheFromFile() {
+//
+// @param readOnly : Whether the file was opened read-only, in which case it is never repaired
+Result ShaderCache::loadCacheFromFile(bool readOnly) {
   assert(m_onDiskFile.isOpen());
 
   // Read the header from the file and validate it
@@ -667,42 +1091,136 @@ Result ShaderCache::loadCacheFromFile() {
   m_onDiskFile.read(&header, sizeof(ShaderCacheSerializedHeader), nullptr);
 
   const size_t fileSize = File::getFileSize(m_fileFullPath);
-  const size_t dataSize = fileSize - sizeof(ShaderCacheSerializedHeader);
   Result result = validateAndLoadHeader(&header, fileSize);
 
+  // Only the data up to the last checkpoint is loaded here; records appended after it are recovered below.
+  const size_t dataSize = m_shaderDataEnd - sizeof(ShaderCacheSerializedHeader);
+
   void *dataMem = nullptr;
-  if (result == Result::Success) {
+  bool mapped = false;
+  if (result == Result::Success && ShaderCacheMapFile) {
+    // Map the file rather than reading it. Only the entry headers are touched here; the pages holding shader data are
+    // faulted in when an entry is first retrieved, and are shared with other processes mapping the same file. That
+    // is safe because the data up to a checkpoint is never rewritten in place: compaction and resets replace the file
+    // through rewriteCacheFile, which leaves the mapped one intact. The optional arguments of getFile differ between
+    // LLVM versions, so only the defaults are used; the file is read rather than mapped in the rare case that its size
+    // is a multiple of the page size.
+    auto bufferOrErr = MemoryBuffer::getFile(m_fileFullPath);
+    if (bufferOrErr && (*bufferOrErr)->getBufferSize() >= m_shaderDataEnd) {
+      m_mappedFile = std::move(*bufferOrErr);
+      dataMem = const_cast<char *>(m_mappedFile->getBufferStart() + sizeof(ShaderCacheSerializedHeader));
+      mapped = true;
+    }
+  }
+
+  if (result == Result::Success && !mapped) {
     // The header is valid, so allocate space to fit all of the shader data.
     dataMem = getCacheSpace(dataSize);
-  }
 
-  if (result == Result::Success) {
     if (dataMem) {
-      // Read the shader data into the allocated memory.
-      m_onDiskFile.seek(sizeof(ShaderCacheSerializedHeader), true);
-      size_t bytesRead = 0;
-      result = m_onDiskFile.read(dataMem, dataSize, &bytesRead);
-
-      // If we didn't read the correct number of bytes then something went wrong and we should return a failure
-      if (bytesRead != dataSize)
-        result = Result::ErrorUnknown;
+      if (dataSize > 0) {
+        // Read the shader data into the allocated memory.
+        m_onDiskFile.seek(sizeof(ShaderCacheSerializedHeader), true);
+        size_t bytesRead = 0;
+        result = m_onDiskFile.read(dataMem, dataSize, &bytesRead);
+
+        // If we didn't read the correct number of bytes then something went wrong and we should return a failure
+        if (bytesRead != dataSize)
+          result = Result::ErrorUnknown;
+      }
     } else
       result = Result::ErrorOutOfMemory;
   }
 
   if (result == Result::Success) {
-    // Now setup the shader index hash map.
-    result = populateIndexMap(dataMem, dataSize);
+    // Now setup the shader index hash map. CRCs of mapped entries are checked lazily in retrieveShader.
+    result = populateIndexMap(dataMem, dataSize, !mapped);
   }
 
+  if (result == Result::Success)
+    result = recoverCacheFileTail(fileSize, readOnly);
+
+  // With a size budget, give every entry read into memory an allocation of its own, so that evicting it frees it.
+  // Mapped entries do not need that: their pages belong to the file and can be reclaimed by the system.
+  if (result == Result::Success && m_maxSize != 0 && !m_mappedFile)
+    unshareEntryData();
+
   if (result != Result::Success) {
-    // Something went wrong in loading the file, so reset it
+    // Something went wrong in loading the file, so reset it.
+    resetRuntimeCache();
     resetCacheFile();
   }
 
   return result;
 }
 
+// =====================================================================================================================
+// Recovers the records that were appended to the on-disk file after its last checkpoint. Records are accepted in order
+// as long as they are complete and their CRC matches; the file is truncated after the last valid record (so that new
+// records are appended right after it) and a new checkpoint is written.
+//
+// NOTE: This function assumes that a write lock has already been taken by the calling function, and that it holds the
+// cache file lock unless the file is read-only.
+//
+// @param fileSize : Size of the on-disk file in bytes
+// @param readOnly : Whether the file was opened read-only, in which case it is left untouched
+Result ShaderCache::recoverCacheFileTail(size_t fileSize, bool readOnly) {
+  const size_t checkpointDataEnd = m_shaderDataEnd;
+  std::vector<uint8_t> record;
+
+  m_onDiskFile.seek(static_cast<int64_t>(m_shaderDataEnd), true);
+  while (m_shaderDataEnd + sizeof(ShaderHeader) <= fileSize) {
+    ShaderHeader header = {};
+    if (m_onDiskFile.read(&header, sizeof(ShaderHeader), nullptr) != Result::Success)
+      break;
+    if (header.size <= sizeof(ShaderHeader) || header.size > fileSize - m_shaderDataEnd)
+      break;
+
+    record.resize(header.size);
+    memcpy(record.data(), &header, sizeof(ShaderHeader));
+    if (m_onDiskFile.read(record.data() + sizeof(ShaderHeader), header.size - sizeof(ShaderHeader), nullptr) !=
+        Result::Success)
+      break;
+    if (calculateCrc(record.data() + sizeof(ShaderHeader), header.size - sizeof(ShaderHeader)) != header.crc)
+      break;
+
+    ShaderIndexMap &indexMap = getShard(header.key).map;
+    if (!indexMap.find(header.key)) {
+      ShaderIndex *index = new ShaderIndex();
+      void *dataBlob = allocateEntryData(index, header.size);
+      memcpy(dataBlob, record.data(), header.size);
+
+      index->header = header;
+      index->dataBlob = dataBlob;
+      index->state = ShaderEntryState::Ready;
+      index->crcVerified = true;
+      indexMap.insert(header.key, index);
+      m_liveBytes += header.size;
+    }
+    // A record whose key is already known is kept in the file, but not in memory.
+
+    ++m_totalShaders;
+    m_shaderDataEnd += header.size;
+  }
+
+  if (readOnly || (m_shaderDataEnd == checkpointDataEnd && fileSize == checkpointDataEnd))
+    return Result::Success;
+
+  LLVM_DEBUG(dbgs() << "Shader cache recovered " << (m_shaderDataEnd - checkpointDataEnd) << " bytes, discarded "
+                    << (fileSize - m_shaderDataEnd) << " bytes after the last checkpoint\n");
+
+  // Drop the mapping before truncating, since touching a mapped page past the new end of the file raises SIGBUS.
+  if (m_mappedFile)
+    unshareEntryData();
+  Result result = m_onDiskFile.truncate(m_shaderDataEnd);
+  if (result == Result::Success) {
+    m_fileShaderCount = m_totalShaders;
+    m_fileDataEnd = m_shaderDataEnd;
+    writeFileCheckpoint();
+  }
+  return result;
+}
+
 // =====================================================================================================================
 // Loads all shader data from a client provided initial data blob. Returns true if the file contents were loaded
 // successfully or false if invalid data was found.
@@ -726,7 +1244,11 @@ Result ShaderCache::loadCacheFromBlob(const void *initialData, size_t initialDat
     if (dataMem) {
       // Then copy the data and setup the shader index hash map.
       memcpy(dataMem, voidPtrInc(initialData, header->headerSize), dataSize);
-      result = populateIndexMap(dataMem, dataSize);
+      result = populateIndexMap(dataMem, dataSize, true);
+
+      // With a size budget, give every entry an allocation of its own, so that evicting it frees it.
+      if (result == Result::Success && m_maxSize != 0)
+        unshareEntryData();
     } else
       result = Result::ErrorOutOfMemory;
   }
@@ -740,7 +1262,8 @@ Result ShaderCache::loadCacheFromBlob(const void *initialData, size_t initialDat
 //
 // @param dataStart : Start pointer of cached shader data
 // @param dataSize : Shader data size in bytes
-Result ShaderCache::populateIndexMap(void *dataStart, size_t dataSize) {
+// @param verifyCrc : Whether to check the CRCs now; otherwise only the entry headers are read and validated
+Result ShaderCache::populateIndexMap(void *dataStart, size_t dataSize, bool verifyCrc) {
   Result result = Result::Success;
 
   // Iterate through all of the entries to verify the data CRC, zero out the GPU memory pointer/offset and add to the
@@ -750,7 +1273,12 @@ Result ShaderCache::populateIndexMap(void *dataStart, size_t dataSize) {
 
   for (unsigned shader = 0; (shader < m_totalShaders && result == Result::Success); ++shader) {
     // Guard against buffer overruns.
-    assert(voidPtrDiff(header, dataStart) <= dataSize);
+    const size_t offset = voidPtrDiff(header, dataStart);
+    if (offset + sizeof(ShaderHeader) > dataSize || header->size < sizeof(ShaderHeader) ||
+        header->size > dataSize - offset) {
+      result = Result::ErrorUnknown;
+      break;
+    }
 
     // TODO: Add a static function to RelocatableShader to validate the input data.
 
@@ -758,18 +1286,21 @@ Result ShaderCache::populateIndexMap(void *dataStart, size_t dataSize) {
     void *const dataBlob = (header + 1);
 
     // Verify the CRC
-    const uint64_t crc = calculateCrc(static_cast<uint8_t *>(dataBlob), (header->size - sizeof(ShaderHeader)));
+    const uint64_t crc =
+        verifyCrc ? calculateCrc(static_cast<uint8_t *>(dataBlob), (header->size - sizeof(ShaderHeader))) : header->crc;
 
     if (crc == header->crc) {
       // It all checks out, so add this shader to the hash map!
       ShaderIndex *index = nullptr;
-      auto indexMap = m_shaderIndexMap.find(header->key);
-      if (indexMap == m_shaderIndexMap.end()) {
-        index = new ShaderIndex;
+      ShaderIndexMap &indexMap = getShard(header->key).map;
+      if (!indexMap.find(header->key)) {
+        index = new ShaderIndex();
         index->header = (*header);
         index->dataBlob = header;
         index->state = ShaderEntryState::Ready;
-        m_shaderIndexMap[header->key] = index;
+        index->crcVerified = verifyCrc;
+        indexMap.insert(header->key, index);
+        m_liveBytes += header->size;
       }
     } else
       result = Result::ErrorUnknown;
@@ -809,7 +1340,7 @@ Result ShaderCache::validateAndLoadHeader(const ShaderCacheSerializedHeader *hea
 
   Result result = Result::Success;
 
-  if (header->headerSize == sizeof(ShaderCacheSerializedHeader) &&
+  if (header->headerSize == sizeof(ShaderCacheSerializedHeader) && header->formatVersion == ShaderCacheFormatVersion &&
       memcmp(header->buildId.buildDate, buildId.buildDate, sizeof(buildId.buildDate)) == 0 &&
       memcmp(header->buildId.buildTime, buildId.buildTime, sizeof(buildId.buildTime)) == 0 &&
       memcmp(&header->buildId.gfxIp, &buildId.gfxIp, sizeof(buildId.gfxIp)) == 0 &&
@@ -829,17 +1360,284 @@ Result ShaderCache::validateAndLoadHeader(const ShaderCacheSerializedHeader *hea
 }
 
 // =====================================================================================================================
-// Allocates memory from the shader cache's linear allocator. This function assumes that a write lock has been taken by
-// the calling function.
+// Allocates memory from the shader cache's linear allocator. Safe to call concurrently from different shards.
 //
 // @param numBytes : Allocation size in bytes
 void *ShaderCache::getCacheSpace(size_t numBytes) {
+  sys::ScopedLock allocLock(m_allocLock);
   auto p = new uint8_t[numBytes];
   m_allocationList.push_back(std::pair<uint8_t *, size_t>(p, numBytes));
-  m_serializedSize += numBytes;
   return p;
 }
 
+// =====================================================================================================================
+// Allocates memory for the data of the specified entry, which is freed together with the entry.
+//
+// @param index : Entry the data belongs to; must not own data already
+// @param numBytes : Size of the data in bytes
+void *ShaderCache::allocateEntryData(ShaderIndex *index, size_t numBytes) {
+  assert(!index->ownsData);
+  index->ownsData = true;
+  return new uint8_t[numBytes];
+}
+
+// =====================================================================================================================
+// Frees the data of the specified entry if it is an allocation of its own, and clears its data pointer.
+//
+// @param index : Entry whose data is released
+void ShaderCache::releaseEntryData(ShaderIndex *index) {
+  if (index->ownsData)
+    delete[] static_cast<uint8_t *>(index->dataBlob);
+  index->ownsData = false;
+  index->dataBlob = nullptr;
+}
+
+// =====================================================================================================================
+// Deletes the specified entry together with its data.
+//
+// @param index : Entry to delete
+void ShaderCache::freeEntry(ShaderIndex *index) {
+  releaseEntryData(index);
+  delete index;
+}
+
+// =====================================================================================================================
+// Gives the data of every entry that lives in a shared block (data loaded from a blob or a file) or in the mapped cache
+// file an allocation of its own, then releases the shared blocks and the mapping. This function assumes that every
+// shard has been locked exclusively by the calling function and that no pointer returned by retrieveShader is still in
+// use.
+void ShaderCache::unshareEntryData() {
+  auto unshare = [this](ShaderIndex *index) {
+    if (index->ownsData || !index->dataBlob)
+      return;
+    void *data = allocateEntryData(index, index->header.size);
+    memcpy(data, index->dataBlob, index->header.size);
+    index->dataBlob = data;
+  };
+  for (auto &shard : m_shards) {
+    for (ShaderIndex *index : shard.map)
+      unshare(index);
+  }
+  for (ShaderIndex *index : m_retiredEntries)
+    unshare(index);
+
+  for (auto allocIt : m_allocationList)
+    delete[] allocIt.first;
+  m_allocationList.clear();
+  m_mappedFile.reset();
+}
+
+// =====================================================================================================================
+// Records a lookup that found the specified entry Ready.
+//
+// @param index : Entry that was found
+void ShaderCache::recordHit(ShaderIndex *index) {
+  getShard(index->header.key).hitCount.fetch_add(1, std::memory_order_relaxed);
+
+  // Use tracking is only needed to pick eviction victims, so skip it when there is no budget. The use clock only
+  // advances on insertions, so hits just read it, and the entry is only written when its stamp actually changes; this
+  // keeps concurrent hits from contending on a shared cache line, at the cost of ordering uses between two insertions
+  // arbitrarily.
+  if (m_maxSize != 0) {
+    if (m_evictionPolicy == ShaderCacheEvictLfu)
+      index->hitCount.fetch_add(1, std::memory_order_relaxed);
+    const uint64_t now = m_useClock.load(std::memory_order_relaxed);
+    if (index->lastUse.load(std::memory_order_relaxed) != now)
+      index->lastUse.store(now, std::memory_order_relaxed);
+  }
+}
+
+// =====================================================================================================================
+// Evicts entries if the cache has grown beyond its size budget. Must be called without any shard lock held.
+void ShaderCache::checkBudget() {
+  if (m_maxSize == 0 || m_liveBytes <= m_maxSize)
+    return;
+
+  lockCacheMap(false);
+  // Another thread may have evicted entries while we were waiting for the locks.
+  if (m_liveBytes > m_maxSize)
+    evictToBudget();
+  unlockCacheMap(false);
+}
+
+// =====================================================================================================================
+// Evicts Ready entries, least valuable first according to the eviction policy, until the live data is back under
+// 7/8 of the budget, so that evictions are batched. Entries being compiled are never evicted. This function assumes
+// that every shard has been locked exclusively by the calling function.
+//
+// Evicted entries are unlinked from the index, so later lookups miss. Entries in use can be evicted too: their handles
+// and data stay valid until every handle to them has been released. Evicted entries are freed by a later eviction
+// batch once that has happened and the file writer is done with their records. Their records are dropped from the
+// on-disk file by the next compaction.
+void ShaderCache::evictToBudget() {
+  // Free the entries evicted by earlier batches that are no longer in use.
+  if (m_processedRecords >= m_retiredRecordMark)
+    freeRetiredEntries();
+
+  struct Candidate {
+    uint64_t primary;   // Hit count (LFU) or last use (LRU)
+    uint64_t secondary; // Last use (LFU only)
+    ShaderIndexShard *shard;
+    ShaderIndex *index;
+  };
+
+  std::vector<Candidate> candidates;
+  for (auto &shard : m_shards) {
+    for (ShaderIndex *index : shard.map) {
+      if (index->state != ShaderEntryState::Ready)
+        continue;
+      if (m_evictionPolicy == ShaderCacheEvictLfu)
+        candidates.push_back({index->hitCount, index->lastUse, &shard, index});
+      else
+        candidates.push_back({index->lastUse, 0, &shard, index});
+    }
+  }
+
+  std::sort(candidates.begin(), candidates.end(), [](const Candidate &lhs, const Candidate &rhs) {
+    return lhs.primary != rhs.primary ? lhs.primary < rhs.primary : lhs.secondary < rhs.secondary;
+  });
+
+  const size_t target = m_maxSize - m_maxSize / 8;
+  for (const Candidate &candidate : candidates) {
+    if (m_liveBytes <= target)
+      break;
+    ShaderIndex *index = candidate.index;
+    candidate.shard->map.erase(index->header.key);
+    m_liveBytes -= index->header.size;
+    m_retiredEntries.push_back(index);
+    ++m_evictCount;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_writerMutex);
+    m_retiredRecordMark = m_queuedRecords;
+  }
+  if (m_onDiskFile.isOpen() && !m_retiredEntries.empty())
+    m_fileHasEvictedRecords = true;
+}
+
+// =====================================================================================================================
+// Frees the evicted entries to which no handle is held any more. This function assumes that every shard has been
+// locked exclusively by the calling function, and that the file writer is done with the records of the entries.
+void ShaderCache::freeRetiredEntries() {
+  auto inUseEnd = std::partition(m_retiredEntries.begin(), m_retiredEntries.end(),
+                                 [](const ShaderIndex *index) { return index->refCount != 0; });
+  for (auto it = inUseEnd; it != m_retiredEntries.end(); ++it)
+    freeEntry(*it);
+  m_retiredEntries.erase(inUseEnd, m_retiredEntries.end());
+}
+
+// =====================================================================================================================
+// Returns true if a handle to any entry, evicted or not, is held. This function assumes that every shard has been
+// locked by the calling function, so that no new handle can be taken meanwhile.
+bool ShaderCache::hasEntriesInUse() const {
+  for (const auto &shard : m_shards) {
+    for (const ShaderIndex *index : shard.map) {
+      if (index->refCount != 0)
+        return true;
+    }
+  }
+  for (const ShaderIndex *index : m_retiredEntries) {
+    if (index->refCount != 0)
+      return true;
+  }
+  return false;
+}
+
+// =====================================================================================================================
+// Compacts the cache: evicted entries are freed, every live entry gets an allocation of its own (so that the blocks
+// loaded from a blob or a file and a mapped cache file are released), and the on-disk file, if open, is rewritten with
+// the live entries only.
+//
+// Moving the data would invalidate the data retrieved through handles still held, so nothing is done while any handle
+// returned by findShader has not been released. Call this between batches of compiles.
+//
+// @returns : True if the cache was compacted, false if it was in use
+bool ShaderCache::compact() {
+  lockCacheMap(false);
+  const bool inUse = hasEntriesInUse();
+  if (!inUse) {
+    stopFileWriter();
+    lockCacheFile();
+    compactLocked();
+    unlockCacheFile();
+    if (m_onDiskFile.isOpen())
+      startFileWriter();
+  }
+  unlockCacheMap(false);
+  return !inUse;
+}
+
+// =====================================================================================================================
+// Implementation of compact. This function assumes that every shard has been locked exclusively by the calling
+// function, that the writer thread is not running, that no handle returned by findShader is still held and that the
+// cache file lock is held.
+void ShaderCache::compactLocked() {
+  assert(!hasEntriesInUse());
+  freeRetiredEntries();
+  m_fileHasEvictedRecords = false;
+
+  unshareEntryData();
+
+  // Gather the live entries in the order their data will be written.
+  std::vector<ShaderIndex *> liveEntries;
+  size_t liveSize = 0;
+  for (auto &shard : m_shards) {
+    for (ShaderIndex *index : shard.map) {
+      if (index->state == ShaderEntryState::Ready) {
+        liveEntries.push_back(index);
+        liveSize += index->header.size;
+      }
+    }
+  }
+
+  m_shaderDataEnd = sizeof(ShaderCacheSerializedHeader) + liveSize;
+  m_totalShaders = liveEntries.size();
+
+  if (m_onDiskFile.isOpen())
+    rewriteCacheFile(liveEntries);
+
+  LLVM_DEBUG(dbgs() << "Shader cache compacted to " << m_totalShaders << " shaders, " << liveSize << " bytes\n");
+}
+
+// =====================================================================================================================
+// Returns the counters of the cache activity so far.
+ShaderCacheStatistics ShaderCache::getStatistics() const {
+  ShaderCacheStatistics statistics = {};
+  for (const auto &shard : m_shards)
+    statistics.hits += shard.hitCount.load(std::memory_order_relaxed);
+  statistics.misses = m_missCount;
+  statistics.evictions = m_evictCount;
+  statistics.liveBytes = m_liveBytes;
+  return statistics;
+}
+
+// =====================================================================================================================
+// Locks every shard of the cache map, in shard order. Used by operations that touch the whole cache.
+//
+// @param readOnly : Whether the shards are only read, in which case they are locked in shared mode
+void ShaderCache::lockCacheMap(bool readOnly) {
+  for (auto &shard : m_shards) {
+    if (readOnly)
+      shard.lock.lock_shared();
+    else
+      shard.lock.lock();
+  }
+}
+
+// =====================================================================================================================
+// Unlocks every shard of the cache map.
+//
+// @param readOnly : Whether the shards were locked in shared mode
+void ShaderCache::unlockCacheMap(bool readOnly) {
+  for (auto &shard : m_shards) {
+    if (readOnly)
+      shard.lock.unlock_shared();
+    else
+      shard.lock.unlock();
+  }
+}
+
 // =====================================================================================================================
 // Returns the time & date that pipeline.cpp was compiled.
 //
@@ -34,19 +34,30 @@
 #include "llpcFile.h"
 #include "llpcUtil.h"
 #include "vkgcMetroHash.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Mutex.h"
+#include "llvm/Support/RWMutex.h"
+#include <atomic>
 #include <condition_variable>
 #include <list>
+#include <memory>
 #include <mutex>
-#include <unordered_map>
+#include <string.h>
+#include <thread>
+#include <vector>
 
 namespace Llpc {
 
+// Version of the layout of the serialized shader cache data (ShaderCacheSerializedHeader followed by ShaderHeader
+// records). Must be incremented whenever that layout changes, so that data written by another version is rejected.
+static constexpr unsigned ShaderCacheFormatVersion = 2;
+
 // Header data that is stored with each shader in the cache.
 struct ShaderHeader {
-  uint64_t key; // Compacted hash key used to identify shaders
-  uint64_t crc; // CRC of the shader cache entry, used to detect data corruption.
-  size_t size;  // Total size of the shader data in the storage file
+  MetroHash::Hash key; // Full 128-bit hash key used to identify shaders
+  uint64_t crc;        // CRC of the shader cache entry, used to detect data corruption.
+  size_t size;         // Total size of the shader data in the storage file
 };
 
 // Enum defining the states a shader cache entry can be in
@@ -66,16 +77,98 @@ enum ShaderCacheMode {
   ShaderCacheEnableOnDiskReadOnly = 4,     // Only read on-disk file with write-protection
 };
 
+// Enumerates policies used to choose the entries evicted when the shader cache exceeds its size budget.
+enum ShaderCacheEvictionPolicy {
+  ShaderCacheEvictLru = 0, // Evict the least recently used entries first
+  ShaderCacheEvictLfu = 1, // Evict the least frequently used entries first, least recently used among equals
+};
+
 // Stores data in the hash map of cached shaders and helps correlated a shader in the hash to a location in the
 // cache's linear allocators where the shader is actually stored.
 struct ShaderIndex {
   ShaderHeader header;             // Shader header data (key, crc, size)
   volatile ShaderEntryState state; // Shader entry state
   void *dataBlob;                  // Serialized data blob representing a cached RelocatableShader object.
+  bool crcVerified;                // Whether the CRC of the data blob has been checked (deferred for mapped files)
+  bool ownsData;                   // Whether dataBlob is an allocation of its own, freed together with the entry
+  std::atomic<unsigned> hitCount;  // Number of lookups that found this entry Ready (tracked for LFU only)
+  std::atomic<uint64_t> lastUse;   // Use clock value of the last such lookup (tracked with a size budget only)
+  std::atomic<unsigned> refCount;  // Number of handles to this entry returned by findShader and not released yet
+  // Completion event of an in-flight entry. Created on demand by the first thread that has to wait for the entry to
+  // leave the Compiling state, and signaled (under the shard lock) by insertShader/resetShader.
+  std::unique_ptr<std::condition_variable_any> readyEvent;
+};
+
+// =====================================================================================================================
+// Hash map from the full 128-bit shader hash to its ShaderIndex, using open addressing. The keys are MetroHash values,
+// which are already uniformly distributed, so the low 64 bits are used directly as the bucket index. Keys are stored
+// inline in the slots, so probing never touches the ShaderIndex objects. Collisions are resolved by linear probing,
+// and erase moves later entries of the probe sequence back instead of leaving tombstones.
+class ShaderIndexMap {
+  // A slot in the table; empty if index is null
+  struct Slot {
+    MetroHash::Hash key; // Hash key of the shader
+    ShaderIndex *index;  // Index data of the shader
+  };
+
+public:
+  // Iterator over the ShaderIndex pointers in the map, in no particular order
+  class iterator {
+  public:
+    iterator(const Slot *slot, const Slot *end) : m_slot(slot), m_end(end) { skipEmpty(); }
+    ShaderIndex *operator*() const { return m_slot->index; }
+    iterator &operator++() {
+      ++m_slot;
+      skipEmpty();
+      return *this;
+    }
+    bool operator!=(const iterator &other) const { return m_slot != other.m_slot; }
+
+  private:
+    void skipEmpty() {
+      while (m_slot != m_end && !m_slot->index)
+        ++m_slot;
+    }
+
+    const Slot *m_slot; // Current slot
+    const Slot *m_end;  // End of the slots
+  };
+
+  ShaderIndex *find(const MetroHash::Hash &key) const;
+  void insert(const MetroHash::Hash &key, ShaderIndex *index);
+  bool erase(const MetroHash::Hash &key);
+  void clear();
+
+  size_t size() const { return m_size; }
+  iterator begin() const { return iterator(m_slots.data(), m_slots.data() + m_slots.size()); }
+  iterator end() const { return iterator(m_slots.data() + m_slots.size(), m_slots.data() + m_slots.size()); }
+
+private:
+  // Gets the bucket that the specified key hashes to. The slot count is always a power of two.
+  size_t getBucket(const MetroHash::Hash &key) const {
+    return ((static_cast<uint64_t>(key.dwords[1]) << 32) | key.dwords[0]) & (m_slots.size() - 1);
+  }
+
+  static bool isEqual(const MetroHash::Hash &lhs, const MetroHash::Hash &rhs) {
+    return memcmp(&lhs, &rhs, sizeof(MetroHash::Hash)) == 0;
+  }
+
+  void grow();
+
+  std::vector<Slot> m_slots; // Slots of the table
+  size_t m_size = 0;         // Number of occupied slots
 };
 
-// The key in hash map is a 64-bit compacted Shader Hash
-typedef std::unordered_map<uint64_t, ShaderIndex *> ShaderIndexMap;
+// Number of hash-partitioned shards of the shader index map. Must be a power of two.
+static constexpr unsigned ShaderIndexShardCount = 16;
+
+// One partition of the shader index map, guarded by its own reader/writer lock. Lookups of entries that are already
+// Ready only take the lock in shared mode, so concurrent cache hits never serialize each other.
+struct ShaderIndexShard {
+  llvm::sys::RWMutex lock;           // Reader/writer lock for access to this shard of the hash map
+  ShaderIndexMap map;                // Shader indices whose key maps to this shard
+  std::atomic<uint64_t> hitCount{0}; // Lookups in this shard that found a Ready entry
+};
 
 // Specifies auxiliary info necessary to create a shader cache object.
 struct ShaderCacheAuxCreateInfo {
@@ -105,15 +198,24 @@ struct BuildUniqueId {
 
 // This the header for the shader cache data when the cache is serialized/written to disk
 struct ShaderCacheSerializedHeader {
-  size_t headerSize;     // Size of the header structure. This member must always be first
-                         // since it is used to validate the serialized data.
-  BuildUniqueId buildId; // Build time/date of the PAL version that created the cache file
-  size_t shaderCount;    // Number of shaders in the shaderIndex array
-  size_t shaderDataEnd;  // Offset to the end of shader data
+  size_t headerSize;      // Size of the header structure. This member must always be first
+                          // since it is used to validate the serialized data.
+  unsigned formatVersion; // Layout version of the serialized data (ShaderCacheFormatVersion)
+  BuildUniqueId buildId;  // Build time/date of the PAL version that created the cache file
+  size_t shaderCount;     // Number of shaders in the shaderIndex array
+  size_t shaderDataEnd;   // Offset to the end of shader data
 };
 
 constexpr unsigned MaxFilePathLen = 512;
 
+// Counters of shader cache activity, see ShaderCache::getStatistics.
+struct ShaderCacheStatistics {
+  uint64_t hits;      // Lookups that found a Ready entry
+  uint64_t misses;    // Lookups that created an entry to be compiled by the caller
+  uint64_t evictions; // Entries evicted to stay within the size budget
+  size_t liveBytes;   // Bytes of shader data in Ready entries
+};
+
 typedef void *CacheEntryHandle;
 
 // =====================================================================================================================
@@ -137,10 +239,16 @@ public:
 
   void resetShader(CacheEntryHandle hEntry);
 
+  void releaseShader(CacheEntryHandle hEntry);
+
   Result retrieveShader(CacheEntryHandle hEntry, const void **ppBlob, size_t *size);
 
   bool isCompatible(const ShaderCacheCreateInfo *createInfo, const ShaderCacheAuxCreateInfo *auxCreateInfo);
 
+  bool compact();
+
+  ShaderCacheStatistics getStatistics() const;
+
 private:
   ShaderCache(const ShaderCache &) = delete;
   ShaderCache &operator=(const ShaderCache &) = delete;
@@ -149,50 +257,103 @@ private:
                        bool *cacheFileExists);
   Result validateAndLoadHeader(const ShaderCacheSerializedHeader *header, size_t dataSourceSize);
   Result loadCacheFromBlob(const void *initialData, size_t initialDataSize);
-  Result populateIndexMap(void *dataStart, size_t dataSize);
+  Result populateIndexMap(void *dataStart, size_t dataSize, bool verifyCrc);
   uint64_t calculateCrc(const uint8_t *data, size_t numBytes);
 
-  Result loadCacheFromFile();
+  Result loadCacheFromFile(bool readOnly);
+  Result recoverCacheFileTail(size_t fileSize, bool readOnly);
   void resetCacheFile();
+  Result rewriteCacheFile(llvm::ArrayRef<ShaderIndex *> entries);
+  void lockCacheFile();
+  void unlockCacheFile();
   void addShaderToFile(const ShaderIndex *index);
+  void startFileWriter();
+  void stopFileWriter();
+  void runFileWriter();
+  void writeFileCheckpoint();
+
+  void recordHit(ShaderIndex *index);
+  void checkBudget();
+  void evictToBudget();
+  void freeRetiredEntries();
+  bool hasEntriesInUse() const;
+  void compactLocked();
 
   void *getCacheSpace(size_t numBytes);
+  void *allocateEntryData(ShaderIndex *index, size_t numBytes);
+  void releaseEntryData(ShaderIndex *index);
+  void freeEntry(ShaderIndex *index);
+  void unshareEntryData();
 
-  // Lock cache map
-  void lockCacheMap(bool readOnly) { m_lock.lock(); }
+  // Gets the shard of the index map that the specified key belongs to. This uses different bits of the key from the
+  // bucket index within the shard's map.
+  ShaderIndexShard &getShard(const MetroHash::Hash &hashKey) {
+    return m_shards[hashKey.dwords[3] & (ShaderIndexShardCount - 1)];
+  }
 
-  // Unlock cache map
-  void unlockCacheMap(bool readOnly) { m_lock.unlock(); }
+  void lockCacheMap(bool readOnly);
+  void unlockCacheMap(bool readOnly);
 
   bool useExternalCache() { return m_getValueFunc && m_storeValueFunc; }
 
   void resetRuntimeCache();
+  void waitForEntry(ShaderIndexShard &shard, ShaderIndex *index);
+  void signalEntry(ShaderIndex *index);
   void getBuildTime(BuildUniqueId *buildId);
 
-  llvm::sys::Mutex m_lock; // Read/Write lock for access to the shader cache hash map
-  File m_onDiskFile;       // File for on-disk storage of the cache
-  bool m_disableCache;     // Whether disable cache completely
+  llvm::sys::Mutex m_allocLock;                     // Lock for the allocation list, shader count and the on-disk file
+  File m_onDiskFile;                                // File for on-disk storage of the cache
+  File m_lockFile;                                  // File locked while the cache file is written
+  std::unique_ptr<llvm::MemoryBuffer> m_mappedFile; // Mapped contents of the on-disk file, if loaded by mapping
+  bool m_disableCache;                              // Whether disable cache completely
 
-  // Map of shader index data which detail the hash, crc, size and CPU memory location for each shader
+  // Sharded map of shader index data which detail the hash, crc, size and CPU memory location for each shader
   // in the cache.
-  ShaderIndexMap m_shaderIndexMap;
+  ShaderIndexShard m_shards[ShaderIndexShardCount];
 
   // In memory copy of the shaderDataEnd and totalShaders stored in the on-disk file. We keep a copy to avoid having
-  //  to do a read/modify/write of the value when adding a new shader.
+  //  to do a read/modify/write of the value when adding a new shader. The records of evicted entries stay in the file,
+  //  and are counted here, until the next compaction; Serialize only writes and counts the Ready entries.
   size_t m_shaderDataEnd;
   size_t m_totalShaders;
 
   char m_fileFullPath[MaxFilePathLen]; // Full path/filename of the shader cache on-disk file
 
-  std::list<std::pair<uint8_t *, size_t>> m_allocationList; // Memory allcoated by GetCacheSpace
-  unsigned m_serializedSize;                                // Serialized byte size of whole shader cache
-  std::mutex m_conditionMutex;                              // Mutex that will be used with the condition variable
-  std::condition_variable m_conditionVariable; // Condition variable that will be used to wait compile finish
-  const void *m_clientData;                    // Client data that will be used by function GetValue and StoreValue
-  ShaderCacheGetValue m_getValueFunc;          // GetValue function used to query an external cache for shader data
-  ShaderCacheStoreValue m_storeValueFunc;      // StoreValue function used to store shader data in an external cache
-  GfxIpVersion m_gfxIp;                        // Graphics IP version info
-  MetroHash::Hash m_hash;                      // Hash code of compilation options
+  // State of the background writer that appends new shaders to the on-disk file. Records are queued by insertShader
+  // and written in groups followed by a single sync; the file header is only rewritten at checkpoints, and records
+  // past the checkpoint are validated and recovered when the file is loaded.
+  std::thread m_writerThread;                                    // Writer thread
+  std::mutex m_writerMutex;                                      // Lock for the pending record queue
+  std::condition_variable m_writerCondition;                     // Signaled when records are queued or the writer stops
+  std::vector<std::pair<const void *, size_t>> m_pendingRecords; // Records waiting to be written
+  bool m_stopWriter;                                             // Whether the writer thread has been asked to stop
+  size_t m_fileDataEnd;                                          // End of the data written to the file so far
+  size_t m_fileShaderCount;                                      // Number of shaders written to the file so far
+  unsigned m_uncheckpointedRecords;                              // Records written since the last checkpoint
+  size_t m_queuedRecords;                                        // Records queued for the writer so far
+  std::atomic<size_t> m_processedRecords;                        // Queued records the writer is done with so far
+
+  // Blocks of shader data shared by several entries (data loaded from a blob or a file), allocated by getCacheSpace.
+  // Entries added at runtime have allocations of their own.
+  std::list<std::pair<uint8_t *, size_t>> m_allocationList;
+
+  // Size budget and eviction state. Evicted entries are unlinked from the index straight away, but their handles and
+  // data stay valid until every handle to them has been released, since other threads may still be using them.
+  size_t m_maxSize;                            // Budget in bytes for the data of Ready entries (0 means unlimited)
+  ShaderCacheEvictionPolicy m_evictionPolicy;  // Policy used to choose the entries to evict
+  std::atomic<size_t> m_liveBytes;             // Bytes of shader data in Ready entries
+  std::atomic<uint64_t> m_useClock;            // Approximate clock used to order entry uses, advanced per insertion
+  std::vector<ShaderIndex *> m_retiredEntries; // Entries evicted but not freed yet (still in use or being written)
+  size_t m_retiredRecordMark;                  // Records queued for the writer when m_retiredEntries was last added to
+  bool m_fileHasEvictedRecords;                // Whether the on-disk file holds records of evicted entries
+  std::atomic<uint64_t> m_missCount;           // Lookups that created an entry to be compiled
+  std::atomic<uint64_t> m_evictCount;          // Entries evicted
+
+  const void *m_clientData;               // Client data that will be used by function GetValue and StoreValue
+  ShaderCacheGetValue m_getValueFunc;     // GetValue function used to query an external cache for shader data
+  ShaderCacheStoreValue m_storeValueFunc; // StoreValue function used to store shader data in an external cache
+  GfxIpVersion m_gfxIp;                   // Graphics IP version info
+  MetroHash::Hash m_hash;                 // Hash code of compilation options
 };
 
 } // namespace Llpc
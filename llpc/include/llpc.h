@@ -105,6 +105,65 @@ struct ComputePipelineBuildOut {
   BinaryData pipelineBin; ///< Output pipeline binary data
 };
 
+/// Enumerates the kinds of compile call that compile telemetry is reported for.
+enum class CompileTelemetryKind : unsigned {
+  ShaderModule,     ///< BuildShaderModule
+  GraphicsPipeline, ///< BuildGraphicsPipeline
+  ComputePipeline,  ///< BuildComputePipeline
+};
+
+/// Enumerates the compile phases that compile telemetry reports the time of.
+enum class CompilePhase : unsigned {
+  Translate, ///< SPIR-V translation
+  Lower,     ///< SPIR-V lowering
+  LoadBc,    ///< Loading of LLVM bitcode
+  Patch,     ///< LLVM patching
+  Opt,       ///< LLVM optimization
+  CodeGen,   ///< Backend code generation
+  Count
+};
+
+/// Enumerates the outcomes of looking up a compile result in the shader caches.
+enum class CompileCacheOutcome : unsigned {
+  NotLookedUp, ///< No cache was looked up
+  Hit,         ///< All results looked up were found in a cache
+  Miss,        ///< At least one result looked up was not found, and was compiled
+};
+
+/// Represents the time spent in a compile, a compile phase or a pass, in seconds.
+struct CompileTime {
+  double wallTime; ///< Elapsed wall-clock time
+  double cpuTime;  ///< User plus system CPU time of the process over the same interval; this includes other
+                   ///  threads of the process, so is only an upper bound when compiling on several threads
+};
+
+/// Represents the time spent in one module pass over a compile.
+struct CompilePassTime {
+  const char *pPassName; ///< Name of the pass
+  CompileTime time;      ///< Time spent in all runs of the pass
+};
+
+/// Represents the compile telemetry of one BuildShaderModule, BuildGraphicsPipeline or BuildComputePipeline call.
+struct CompileTelemetry {
+  CompileTelemetryKind kind;                                          ///< Kind of compile call
+  uint64_t hash;                                                      ///< Pipeline hash, or shader module hash
+  Result result;                                                      ///< Result returned by the call
+  CompileCacheOutcome cacheOutcome;                                   ///< Outcome of the shader cache lookups
+  CompileTime totalTime;                                              ///< Time spent in the whole call
+  CompileTime phaseTimes[static_cast<unsigned>(CompilePhase::Count)]; ///< Time spent in each compile phase
+  unsigned passTimeCount;                                             ///< Count of entries in pPassTimes
+  const CompilePassTime *pPassTimes;                                  ///< Time spent in each module pass, slowest first
+  size_t peakMemory;                                                  ///< Highest heap usage of the process seen during
+                                                                      ///  the call, in bytes (0 if unknown)
+  unsigned skippedBitcodeFunctionCount;                               ///< Count of functions in pre-lowered shader
+                                                                      ///  bitcode that were not loaded, because no
+                                                                      ///  entry-point reaches them
+};
+
+/// Defines callback function used to report the compile telemetry of each compile call. The record, and the strings
+/// it points to, are only valid for the duration of the callback.
+typedef void (*CompileTelemetryCallback)(void *pUserData, const CompileTelemetry *pTelemetry);
+
 /// Defines callback function used to lookup shader cache info in an external cache
 typedef Result (*ShaderCacheGetValue)(const void *pClientData, uint64_t hash, void *pValue, size_t *pValueLen);
 
@@ -241,6 +300,18 @@ protected:
   ICompiler() {}
   /// Destructor
   virtual ~ICompiler() {}
+
+public:
+  /// Sets the callback that the compile telemetry of each BuildShaderModule, BuildGraphicsPipeline and
+  /// BuildComputePipeline call is reported to. The callback is invoked on the thread that made the call, just before
+  /// the call returns. Gathering the telemetry adds a little time to each compile, so it is only done while a
+  /// callback is set. This must not be called while compiles are in progress.
+  ///
+  /// NOTE: This is declared after the destructor, so that the vtable slots of the older methods do not move.
+  ///
+  /// @param [in]  pfnCallback    Telemetry callback, or nullptr to stop gathering telemetry
+  /// @param [in]  pUserData      User data passed to the callback
+  virtual void SetCompileTelemetryCallback(CompileTelemetryCallback pfnCallback, void *pUserData) = 0;
 };
 
 } // namespace Llpc
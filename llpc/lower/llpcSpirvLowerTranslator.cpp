@@ -30,10 +30,11 @@
  */
 #include "llpcSpirvLowerTranslator.h"
 #include "LLVMSPIRVLib.h"
+#include "SPIRVStream.h"
 #include "llpcCompiler.h"
 #include "llpcContext.h"
 #include "lgc/Builder.h"
-#include <sstream>
+#include <istream>
 #include <string>
 
 #define DEBUG_TYPE "llpc-spirv-lower-translator"
@@ -85,8 +86,9 @@ void SpirvLowerTranslator::translateSpirvToLlvm(const PipelineShaderInfo *shader
   if (ShaderModuleHelper::optimizeSpirv(spirvBin, &optimizedSpirvBin) == Result::Success)
     spirvBin = &optimizedSpirvBin;
 
-  std::string spirvCode(static_cast<const char *>(spirvBin->pCode), spirvBin->codeSize);
-  std::istringstream spirvStream(spirvCode);
+  // Decode the SPIR-V in place, rather than copying it into a string stream.
+  SPIRV::SPIRVMemoryBuf spirvBuf(spirvBin->pCode, spirvBin->codeSize);
+  std::istream spirvStream(&spirvBuf);
   std::string errMsg;
   SPIRV::SPIRVSpecConstMap specConstMap;
   ShaderStage entryStage = shaderInfo->entryStage;
@@ -104,7 +106,7 @@ void SpirvLowerTranslator::translateSpirvToLlvm(const PipelineShaderInfo *shader
   Context *context = static_cast<Context *>(&module->getContext());
 
   if (!readSpirv(context->getBuilder(), &(moduleData->usage), spirvStream, convertToExecModel(entryStage),
-                 shaderInfo->pEntryTarget, specConstMap, module, errMsg)) {
+                 shaderInfo->pEntryTarget, specConstMap, module, errMsg, &spirvBuf)) {
     report_fatal_error(Twine("Failed to translate SPIR-V to LLVM (") +
                            getShaderStageName(static_cast<ShaderStage>(entryStage)) + " shader): " + errMsg,
                        false);
@@ -39,7 +39,7 @@ config.name = 'LLPC_SHADERTEST'
 config.test_format = lit.formats.ShTest(True)
 
 # suffixes: A list of file extensions to treat as test files.
-config.suffixes = ['.vert', '.tesc', '.tese', '.geom', '.frag', '.comp', '.spvasm', '.pipe', '.ll']
+config.suffixes = ['.vert', '.tesc', '.tese', '.geom', '.frag', '.comp', '.spvasm', '.pipe', '.ll', '.test']
 
 # excludes: A list of directories  and fles to exclude from the testsuite.
 config.excludes = ['CMakeLists.txt', 'litScripts', 'internal', 'avoid', 'error']
@@ -57,6 +57,9 @@ if config.llvm_assertions == 'ON' or config.llvm_assertions == '1':
 if config.llpc_enable_shader_cache == 'ON' or config.llpc_enable_shader_cache == '1':
     config.available_features.add('llpc-shader-cache')
 
+if config.llpc_build_benchmarks == 'ON' or config.llpc_build_benchmarks == '1':
+    config.available_features.add('llpc-benchmarks')
+
 llvm_config.use_default_substitutions()
 
 config.substitutions.append(('%PATH%', config.environment['PATH']))
@@ -66,5 +69,7 @@ config.substitutions.append(('%spvgendir%', config.spvgen_dir))
 tool_dirs = [config.llvm_tools_dir, config.amdllpc_dir]
 
 tools = ['amdllpc', 'llvm-objdump']
+if 'llpc-benchmarks' in config.available_features:
+    tools.append('llpcbench')
 
 llvm_config.add_tool_substitutions(tools, tool_dirs)
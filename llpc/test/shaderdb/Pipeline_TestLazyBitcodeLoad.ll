@@ -0,0 +1,43 @@
+; This test case checks that, when pre-lowered IR is loaded into a pipeline, functions that no entry-point reaches are
+; not materialized and are reported in the compile telemetry; with -lazy-load-shader-bitcode=false they are loaded.
+; BEGIN_SHADERTEST
+; RUN: amdllpc -spvgen-dir=%spvgendir% -telemetry-json=%t.json %gfxip %s && FileCheck -check-prefix=SHADERTEST %s < %t.json
+; SHADERTEST: "kind": "GraphicsPipeline"
+; SHADERTEST: "skippedBitcodeFunctions": 2
+; RUN: amdllpc -spvgen-dir=%spvgendir% -telemetry-json=%t.eager.json -lazy-load-shader-bitcode=false %gfxip %s && FileCheck -check-prefix=EAGER %s < %t.eager.json
+; EAGER: "kind": "GraphicsPipeline"
+; EAGER: "skippedBitcodeFunctions": 0
+; END_SHADERTEST
+
+target datalayout = "e-p:64:64-p1:64:64-p2:32:32-p3:32:32-p4:64:64-p5:32:32-p6:32:32-i64:64-v16:16-v24:32-v32:32-v48:64-v96:128-v192:256-v256:256-v512:512-v1024:1024-v2048:2048-n32:64-S32-A5-ni:7"
+target triple = "amdgcn--amdpal"
+
+; Function Attrs: nounwind
+define spir_func void @lgc.shader.FS.main() local_unnamed_addr #0 !spirv.ExecutionModel !0 !lgc.shaderstage !0 {
+.entry:
+  call spir_func void @reached()
+  ret void
+}
+
+; Function Attrs: nounwind
+define internal spir_func void @reached() #0 {
+.entry:
+  ret void
+}
+
+; Function Attrs: nounwind
+define internal spir_func void @unreached() #0 {
+.entry:
+  call spir_func void @unreachedCallee()
+  ret void
+}
+
+; Function Attrs: nounwind
+define internal spir_func void @unreachedCallee() #0 {
+.entry:
+  ret void
+}
+
+attributes #0 = { nounwind }
+
+!0 = !{i32 4}
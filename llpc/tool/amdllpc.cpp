@@ -42,6 +42,8 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Format.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/PrettyStackTrace.h"
@@ -61,8 +63,14 @@
 #endif
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <sstream>
 #include <stdlib.h> // getenv
+#include <thread>
 
 // NOTE: To enable VLD, please add option BUILD_WIN_VLD=1 in build option.To run amdllpc with VLD enabled,
 // please copy vld.ini and all files in.\winVisualMemDetector\bin\Win64 to current directory of amdllpc.
@@ -243,6 +251,18 @@ static cl::opt<bool> CheckAutoLayoutCompatible(
     "check-auto-layout-compatible",
     cl::desc("check if auto descriptor layout got from spv file is commpatible with real layout"));
 
+// -j: number of threads used to compile independent pipeline files
+static cl::opt<unsigned> NumThreads("j",
+                                    cl::desc("Number of threads used to compile independent pipeline files "
+                                             "(0 means one per hardware thread)"),
+                                    cl::value_desc("N"), cl::init(1));
+
+// -telemetry-json: write the compile telemetry of each compile to a JSON file
+static cl::opt<std::string> TelemetryJson("telemetry-json",
+                                          cl::desc("Write compile telemetry (phase and pass times, cache outcome, "
+                                                   "peak memory) of each compile to a JSON file"),
+                                          cl::value_desc("filename (\"-\" for stdout)"));
+
 namespace llvm {
 
 namespace cl {
@@ -1131,6 +1151,85 @@ static Result outputElf(CompileInfo *compileInfo, const std::string &suppliedOut
   return result;
 }
 
+// Represents the compile telemetry records gathered for -telemetry-json.
+struct TelemetryLog {
+  std::mutex lock;      // Lock for records, as compiles may run on several threads with -j
+  json::Array records;  // One JSON object per compile call
+  bool written = false; // Whether an attempt has been made to write the log
+};
+
+static ManagedStatic<TelemetryLog> STelemetryLog;
+
+// =====================================================================================================================
+// Converts a compile time to a JSON object.
+//
+// @param time : Compile time
+static json::Object compileTimeToJson(const CompileTime &time) {
+  return json::Object{{"wall", time.wallTime}, {"cpu", time.cpuTime}};
+}
+
+// =====================================================================================================================
+// Compile telemetry callback for -telemetry-json: adds the record of one compile call to the telemetry log.
+//
+// @param userData : Telemetry log
+// @param telemetry : Compile telemetry of the call
+static void recordTelemetry(void *userData, const CompileTelemetry *telemetry) {
+  static const char *const KindNames[] = {"ShaderModule", "GraphicsPipeline", "ComputePipeline"};
+  static const char *const CacheOutcomeNames[] = {"none", "hit", "miss"};
+  static const char *const PhaseNames[] = {"translate", "lower", "loadBc", "patch", "opt", "codeGen"};
+  static_assert(sizeof(PhaseNames) / sizeof(PhaseNames[0]) == static_cast<unsigned>(CompilePhase::Count),
+                "Unexpected phase count");
+
+  std::string hash;
+  raw_string_ostream(hash) << format("0x%016" PRIX64, telemetry->hash);
+
+  json::Object phases;
+  for (unsigned phase = 0; phase < static_cast<unsigned>(CompilePhase::Count); ++phase)
+    phases[PhaseNames[phase]] = compileTimeToJson(telemetry->phaseTimes[phase]);
+
+  json::Array passes;
+  for (unsigned i = 0; i < telemetry->passTimeCount; ++i) {
+    json::Object pass = compileTimeToJson(telemetry->pPassTimes[i].time);
+    pass["name"] = telemetry->pPassTimes[i].pPassName;
+    passes.push_back(std::move(pass));
+  }
+
+  json::Object record{
+      {"kind", KindNames[static_cast<unsigned>(telemetry->kind)]},
+      {"hash", hash},
+      {"result", static_cast<int>(telemetry->result)},
+      {"cache", CacheOutcomeNames[static_cast<unsigned>(telemetry->cacheOutcome)]},
+      {"total", compileTimeToJson(telemetry->totalTime)},
+      {"phases", std::move(phases)},
+      {"passes", std::move(passes)},
+      {"peakMemory", static_cast<int64_t>(telemetry->peakMemory)},
+      {"skippedBitcodeFunctions", static_cast<int64_t>(telemetry->skippedBitcodeFunctionCount)},
+  };
+
+  auto log = static_cast<TelemetryLog *>(userData);
+  std::lock_guard<std::mutex> lock(log->lock);
+  log->records.push_back(std::move(record));
+}
+
+// =====================================================================================================================
+// Writes the telemetry log gathered for -telemetry-json to the specified file. Only the first call writes it.
+static Result outputTelemetryJson() {
+  std::lock_guard<std::mutex> lock(STelemetryLog->lock);
+  if (STelemetryLog->written)
+    return Result::Success;
+  STelemetryLog->written = true;
+
+  std::error_code errorCode;
+  raw_fd_ostream outStream(TelemetryJson, errorCode, sys::fs::OF_Text);
+  if (errorCode) {
+    LLPC_ERRS("Failed to open telemetry file: " << TelemetryJson << ": " << errorCode.message() << "\n");
+    return Result::ErrorUnavailable;
+  }
+
+  outStream << formatv("{0:2}", json::Value(json::Object{{"compiles", std::move(STelemetryLog->records)}})) << "\n";
+  return Result::Success;
+}
+
 #ifdef WIN_OS
 // =====================================================================================================================
 // Callback function for SIGABRT.
@@ -1437,6 +1536,130 @@ static Result processPipeline(ICompiler *compiler, ArrayRef<std::string> inFiles
   return result;
 }
 
+// Represents the outcome of compiling one input file in batch mode.
+struct BatchFileResult {
+  Result result;  // Result of compiling the file
+  double seconds; // Wall-clock time spent compiling the file
+  bool done;      // Whether the file has been compiled
+};
+
+// =====================================================================================================================
+// Compiles each input file as a separate pipeline, on a pool of threads that share the one compiler. The result of
+// each file is reported in input order as soon as it and all files before it are done, so the output does not depend
+// on scheduling. A summary of timing and failures follows.
+//
+// @param compiler : LLPC compiler
+// @param inFiles : Input filenames, each one a complete pipeline
+// @param threadCount : Number of compile threads
+// @returns Result::Success if all files compiled, otherwise the result of the first file that failed
+static Result processPipelinesInParallel(ICompiler *compiler, ArrayRef<std::string> inFiles, unsigned threadCount) {
+  // Every worker would write its output to the same file.
+  if (!OutFile.empty()) {
+    LLPC_ERRS("-o cannot be used with -j and several input files; omit it to name each output after its input\n");
+    return Result::ErrorInvalidValue;
+  }
+
+  std::vector<BatchFileResult> fileResults(inFiles.size(), BatchFileResult{Result::Success, 0.0, false});
+  std::atomic<unsigned> nextIndex(0);
+  std::mutex resultMutex;
+  std::condition_variable resultReady;
+
+  auto compileFiles = [&] {
+    for (unsigned index = nextIndex++; index < inFiles.size(); index = nextIndex++) {
+      unsigned nextFile = 0;
+      auto startTime = std::chrono::steady_clock::now();
+      Result result = processPipeline(compiler, {inFiles[index]}, 0, &nextFile);
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+
+      std::lock_guard<std::mutex> lock(resultMutex);
+      fileResults[index] = {result, elapsed.count(), true};
+      resultReady.notify_one();
+    }
+  };
+
+  // SPVGEN is loaded lazily; make sure that happens once, before any of the threads need it.
+  InitSpvGen();
+
+  auto batchStartTime = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < threadCount; ++i)
+    workers.emplace_back(compileFiles);
+
+  Result result = Result::Success;
+  unsigned fileCount = inFiles.size();
+  for (unsigned index = 0; index < fileCount; ++index) {
+    BatchFileResult fileResult = {};
+    {
+      std::unique_lock<std::mutex> lock(resultMutex);
+      resultReady.wait(lock, [&] { return fileResults[index].done; });
+      fileResult = fileResults[index];
+    }
+    if (fileResult.result != Result::Success && result == Result::Success)
+      result = fileResult.result;
+
+    const char *status = fileResult.result == Result::Success ? "PASS" : "FAIL";
+    outs() << format("[%u/%u] %s %9.3fs ", index + 1, fileCount, status, fileResult.seconds) << inFiles[index] << "\n";
+    outs().flush();
+  }
+
+  for (std::thread &worker : workers)
+    worker.join();
+  std::chrono::duration<double> wallTime = std::chrono::steady_clock::now() - batchStartTime;
+
+  // Print the summary.
+  constexpr unsigned MaxSlowestFiles = 10;
+  std::vector<unsigned> failedFiles;
+  std::vector<unsigned> sortedFiles;
+  double totalTime = 0.0;
+  for (unsigned index = 0; index < fileCount; ++index) {
+    totalTime += fileResults[index].seconds;
+    sortedFiles.push_back(index);
+    if (fileResults[index].result != Result::Success)
+      failedFiles.push_back(index);
+  }
+  std::stable_sort(sortedFiles.begin(), sortedFiles.end(), [&fileResults](unsigned lhs, unsigned rhs) {
+    return fileResults[lhs].seconds > fileResults[rhs].seconds;
+  });
+  sortedFiles.resize(std::min(MaxSlowestFiles, fileCount));
+
+  outs() << "\n===============================================================================\n";
+  outs() << "// Batch compile summary\n";
+  outs() << format("Files: %u, passed: %u, failed: %u, threads: %u\n", fileCount,
+                   fileCount - unsigned(failedFiles.size()), unsigned(failedFiles.size()), threadCount);
+  outs() << format("Wall time: %.3fs, total compile time: %.3fs, average per file: %.3fs\n", wallTime.count(),
+                   totalTime, fileCount ? totalTime / fileCount : 0.0);
+  outs() << "Slowest files:\n";
+  for (unsigned index : sortedFiles)
+    outs() << format("  %9.3fs ", fileResults[index].seconds) << inFiles[index] << "\n";
+  if (!failedFiles.empty()) {
+    outs() << "Failed files:\n";
+    for (unsigned index : failedFiles)
+      outs() << "  " << inFiles[index] << "\n";
+  }
+  outs().flush();
+
+  return result;
+}
+
+// =====================================================================================================================
+// Gets the number of threads to use to compile the given number of independent pipeline files, as requested by the
+// -j option. Batch mode is not used for verbose output, timers or output to stdout, as those are written directly
+// by each compile and would interleave.
+//
+// @param fileCount : Number of input files
+static unsigned getBatchThreadCount(unsigned fileCount) {
+  unsigned threadCount = NumThreads;
+  if (threadCount == 0)
+    threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+  threadCount = std::min(threadCount, fileCount);
+
+  if (threadCount > 1 && (EnableOuts() || TimePassesIsEnabled || cl::EnableTimerProfile || OutFile == "-")) {
+    errs() << "Warning: -j is ignored with verbose output, timers or output to stdout\n";
+    threadCount = 1;
+  }
+  return threadCount;
+}
+
 #ifdef WIN_OS
 // =====================================================================================================================
 // Finds all filenames which can match input file name
@@ -1527,6 +1750,8 @@ int main(int argc, char *argv[]) {
 #endif
 
   result = init(argc, argv, &compiler);
+  if (result == Result::Success && !TelemetryJson.empty())
+    compiler->SetCompileTelemetryCallback(recordTelemetry, &*STelemetryLog);
 
 #ifdef WIN_OS
   if (AssertToMsgBox) {
@@ -1536,10 +1761,12 @@ int main(int argc, char *argv[]) {
 
   // Simplify error handling and enable early returns. These assume that result statuses
   // are always written to the |result| local variable.
-  auto isFailure = [result] { return result != Result::Success; };
-  auto onFailure = [compiler, result] {
+  auto isFailure = [&result] { return result != Result::Success; };
+  auto onFailure = [compiler, &result] {
     assert(result != Result::Success);
     (void)result;
+    if (compiler && !TelemetryJson.empty())
+      outputTelemetryJson();
     compiler->Destroy();
     LLPC_ERRS("\n=====  AMDLLPC FAILED  =====\n");
     return 1;
@@ -1573,21 +1800,35 @@ int main(int argc, char *argv[]) {
       return onFailure();
     }
 
-    unsigned nextFile = 0;
-    for (const std::string &file : expandedInputFiles) {
-      result = processPipeline(compiler, {file}, 0, &nextFile);
+    unsigned threadCount = getBatchThreadCount(expandedInputFiles.size());
+    if (threadCount > 1) {
+      result = processPipelinesInParallel(compiler, expandedInputFiles, threadCount);
       if (isFailure())
         return onFailure();
+    } else {
+      unsigned nextFile = 0;
+      for (const std::string &file : expandedInputFiles) {
+        result = processPipeline(compiler, {file}, 0, &nextFile);
+        if (isFailure())
+          return onFailure();
+      }
     }
   } else if (isPipelineInfoFile(expandedInputFiles[0]) || isLlvmIrFile(expandedInputFiles[0])) {
     // The first input file is a pipeline file or LLVM IR file. Assume they all are, and compile each one
-    // separately but in the same context.
-    unsigned nextFile = 0;
-
-    for (const std::string &file : expandedInputFiles) {
-      result = processPipeline(compiler, {file}, 0, &nextFile);
+    // separately but in the same context. With -j, compile them on several threads.
+    unsigned threadCount = getBatchThreadCount(expandedInputFiles.size());
+    if (threadCount > 1) {
+      result = processPipelinesInParallel(compiler, expandedInputFiles, threadCount);
       if (isFailure())
         return onFailure();
+    } else {
+      unsigned nextFile = 0;
+
+      for (const std::string &file : expandedInputFiles) {
+        result = processPipeline(compiler, {file}, 0, &nextFile);
+        if (isFailure())
+          return onFailure();
+      }
     }
   } else {
     // Otherwise, join all input files into the same pipeline.
@@ -1599,6 +1840,11 @@ int main(int argc, char *argv[]) {
   }
 
   assert(!isFailure());
+  if (!TelemetryJson.empty()) {
+    result = outputTelemetryJson();
+    if (isFailure())
+      return onFailure();
+  }
   compiler->Destroy();
   LLPC_OUTS("\n=====  AMDLLPC SUCCESS  =====\n");
   return 0;
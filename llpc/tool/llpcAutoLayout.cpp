@@ -36,6 +36,7 @@
 #include "SPIRVFunction.h"
 #include "SPIRVInstruction.h"
 #include "SPIRVModule.h"
+#include "SPIRVStream.h"
 #include "SPIRVType.h"
 #include "amdllpc.h"
 #include "llpcDebug.h"
@@ -276,9 +277,10 @@ bool checkPipelineStateCompatible(const ICompiler *compiler, Llpc::GraphicsPipel
 void doAutoLayoutDesc(ShaderStage shaderStage, BinaryData spirvBin, GraphicsPipelineBuildInfo *pipelineInfo,
                       PipelineShaderInfo *shaderInfo, unsigned &topLevelOffset, bool checkAutoLayoutCompatible) {
   // Read the SPIR-V.
-  std::string spirvCode(static_cast<const char *>(spirvBin.pCode), spirvBin.codeSize);
-  std::istringstream spirvStream(spirvCode);
+  SPIRVMemoryBuf spirvBuf(spirvBin.pCode, spirvBin.codeSize);
+  std::istream spirvStream(&spirvBuf);
   std::unique_ptr<SPIRVModule> module(SPIRVModule::createSPIRVModule());
+  module->setInputBuf(&spirvBuf);
   spirvStream >> *module;
 
   // Find the entry target.
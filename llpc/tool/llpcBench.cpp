@@ -0,0 +1,101 @@
+/*
+ ***********************************************************************************************************************
+ *
+ *  Copyright (c) 2020 Advanced Micro Devices, Inc. All Rights Reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ **********************************************************************************************************************/
+/**
+ ***********************************************************************************************************************
+ * @file  llpcBench.cpp
+ * @brief LLPC source file: microbenchmarks of LLPC internals that are on the pipeline creation critical path
+ ***********************************************************************************************************************
+ */
+#include "llpcBench.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include <algorithm>
+#include <vector>
+
+using namespace llvm;
+using namespace LlpcBench;
+
+// -benchmark: the benchmark to run
+static cl::opt<std::string> Benchmark("benchmark", cl::desc("Benchmark to run:\n"
+                                                            "  shader-cache-contention\n"
+                                                            "  shader-cache-wakeup\n"
+                                                            "  spirv-decode\n"
+                                                            "  elf-link"),
+                                      cl::value_desc("name"), cl::Required);
+
+// -threads: maximum number of threads
+static cl::opt<unsigned> Threads("threads", cl::desc("Maximum number of threads for multithreaded benchmarks"),
+                                 cl::init(8));
+
+// -iterations: number of timed iterations
+static cl::opt<unsigned> Iterations("iterations", cl::desc("Number of timed iterations (per thread)"),
+                                    cl::init(100000));
+
+// Input files, for the benchmarks that take them
+static cl::list<std::string> Inputs(cl::Positional, cl::ZeroOrMore, cl::desc("<input files>"));
+
+namespace LlpcBench {
+
+// =====================================================================================================================
+// Print one result line.
+//
+// @param benchmark : Name of the benchmark
+// @param config : Configuration measured, such as the thread count
+// @param value : Measured value
+// @param unit : Unit of the value
+void reportResult(StringRef benchmark, StringRef config, double value, StringRef unit) {
+  outs() << benchmark << ": " << config << " " << format("%.1f", value) << " " << unit << "\n";
+}
+
+} // namespace LlpcBench
+
+// =====================================================================================================================
+// Main function of llpcbench.
+//
+// @param argc : Count of arguments
+// @param argv : List of arguments
+int main(int argc, char **argv) {
+  InitLLVM initLlvm(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv, "LLPC microbenchmarks\n");
+
+  BenchOptions options = {};
+  options.threads = std::max(1U, unsigned(Threads));
+  options.iterations = std::max(1U, unsigned(Iterations));
+  std::vector<std::string> inputs(Inputs.begin(), Inputs.end());
+  options.inputs = inputs;
+
+  if (Benchmark == "shader-cache-contention")
+    return runShaderCacheContention(options);
+  if (Benchmark == "shader-cache-wakeup")
+    return runShaderCacheWakeup(options);
+  if (Benchmark == "spirv-decode")
+    return runSpirvDecode(options);
+  if (Benchmark == "elf-link")
+    return runElfLink(options);
+
+  errs() << "llpcbench: unknown benchmark '" << Benchmark << "'\n";
+  return 1;
+}
@@ -0,0 +1,72 @@
+/*
+ ***********************************************************************************************************************
+ *
+ *  Copyright (c) 2020 Advanced Micro Devices, Inc. All Rights Reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ **********************************************************************************************************************/
+/**
+ ***********************************************************************************************************************
+ * @file  llpcBench.h
+ * @brief LLPC header file: common header for the llpcbench microbenchmark utility
+ ***********************************************************************************************************************
+ */
+#pragma once
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+#include <chrono>
+#include <string>
+
+namespace LlpcBench {
+
+// Options shared by all benchmarks
+struct BenchOptions {
+  unsigned threads;                   // Maximum threads; multithreaded benchmarks run with 1, 2, 4, ... up to this
+  unsigned iterations;                // Number of timed iterations (per thread, for multithreaded benchmarks)
+  llvm::ArrayRef<std::string> inputs; // Input files given on the command line, for benchmarks that take them
+};
+
+// =====================================================================================================================
+// Simple wall-clock stopwatch used by the benchmarks.
+class Stopwatch {
+public:
+  Stopwatch() : m_start(std::chrono::steady_clock::now()) {}
+
+  // Get elapsed time in nanoseconds since construction
+  double getNanoseconds() const {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - m_start).count();
+  }
+
+private:
+  std::chrono::steady_clock::time_point m_start; // Start time
+};
+
+// Print one result line in the common "benchmark: name=value ..." format
+void reportResult(llvm::StringRef benchmark, llvm::StringRef config, double value, llvm::StringRef unit);
+
+// Benchmarks. Each returns 0 on success, or non-zero if it failed or a checked bound was exceeded.
+int runShaderCacheContention(const BenchOptions &options);
+int runShaderCacheWakeup(const BenchOptions &options);
+int runSpirvDecode(const BenchOptions &options);
+int runElfLink(const BenchOptions &options);
+
+} // namespace LlpcBench
@@ -0,0 +1,119 @@
+/*
+ ***********************************************************************************************************************
+ *
+ *  Copyright (c) 2020 Advanced Micro Devices, Inc. All Rights Reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ **********************************************************************************************************************/
+/**
+ ***********************************************************************************************************************
+ * @file  llpcBenchElfLink.cpp
+ * @brief LLPC source file: microbenchmark of ELF linking of pipelines that share a fragment shader
+ ***********************************************************************************************************************
+ */
+#include "llpcBench.h"
+#include "lgc/ElfLinker.h"
+#include "lgc/LgcContext.h"
+#include "lgc/Pipeline.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+using namespace lgc;
+using namespace llvm;
+
+namespace LlpcBench {
+
+// Maximum number of links the ELF link benchmark times
+static constexpr unsigned MaxLinkIterations = 1000;
+
+// -link-gpu: GPU that the ELFs linked by elf-link were compiled for
+static cl::opt<std::string> LinkGpu("link-gpu", cl::desc("GPU that the elf-link input ELFs were compiled for"),
+                                    cl::value_desc("name"), cl::init("gfx900"));
+
+// =====================================================================================================================
+// Benchmark of the link latency of N pipelines that share a fragment shader, as when an application builds many
+// pipelines from relocatable shader ELFs with one FS. The inputs are, as for "lgc -l", an IR module giving the
+// pipeline state, then the unlinked FS ELF, then one or more unlinked VS ELFs, one per distinct pipeline. Each
+// timed link creates a Pipeline from the state module and links the next VS with the FS, so every pipeline after
+// the first can reuse the parsed FS from the LgcContext's LinkableShaderCache. Run it again with
+// -linkable-shader-cache-size=0 to measure the links without that reuse. Reports the average time per link.
+//
+// @param options : Benchmark options
+int runElfLink(const BenchOptions &options) {
+  if (options.inputs.size() < 3) {
+    errs() << "elf-link: expected a pipeline state IR file, a FS ELF and at least one VS ELF\n";
+    return 1;
+  }
+
+  LgcContext::initialize();
+  LLVMContext context;
+  std::unique_ptr<LgcContext> lgcContext(LgcContext::Create(context, LinkGpu, PAL_CLIENT_INTERFACE_MAJOR_VERSION));
+  if (!lgcContext) {
+    errs() << "elf-link: GPU type '" << LinkGpu << "' not recognized\n";
+    return 1;
+  }
+
+  SMDiagnostic diag;
+  std::unique_ptr<Module> stateModule = parseIRFile(options.inputs[0], diag, context);
+  if (!stateModule) {
+    diag.print("elf-link", errs());
+    return 1;
+  }
+
+  std::vector<std::unique_ptr<MemoryBuffer>> elfs;
+  for (const std::string &input : options.inputs.drop_front()) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(input);
+    if (!buffer) {
+      errs() << "elf-link: cannot read " << input << "\n";
+      return 1;
+    }
+    elfs.push_back(std::move(*buffer));
+  }
+  const unsigned pipelineCount = elfs.size() - 1;
+
+  const unsigned iterations = std::min(options.iterations, MaxLinkIterations);
+  Stopwatch stopwatch;
+  for (unsigned iteration = 0; iteration != iterations; ++iteration) {
+    std::unique_ptr<Pipeline> pipeline(lgcContext->createPipeline());
+    pipeline->setStateFromModule(&*stateModule);
+    MemoryBufferRef elfRefs[] = {elfs[1 + iteration % pipelineCount]->getMemBufferRef(), elfs[0]->getMemBufferRef()};
+    std::unique_ptr<ElfLinker> elfLinker(pipeline->createElfLinker(elfRefs));
+    SmallString<0> pipelineElf;
+    raw_svector_ostream pipelineElfStream(pipelineElf);
+    if (!elfLinker->link(pipelineElfStream)) {
+      errs() << "elf-link: link failed: " << pipeline->getLastError() << "\n";
+      return 1;
+    }
+  }
+  const double elapsed = stopwatch.getNanoseconds();
+
+  reportResult("elf-link", formatv("pipelines={0}", pipelineCount).str(), elapsed / iterations / 1000.0, "us/link");
+  return 0;
+}
+
+} // namespace LlpcBench
@@ -0,0 +1,238 @@
+/*
+ ***********************************************************************************************************************
+ *
+ *  Copyright (c) 2020 Advanced Micro Devices, Inc. All Rights Reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ **********************************************************************************************************************/
+/**
+ ***********************************************************************************************************************
+ * @file  llpcBenchShaderCache.cpp
+ * @brief LLPC source file: shader cache microbenchmarks
+ ***********************************************************************************************************************
+ */
+#include "llpcBench.h"
+#include "llpcShaderCache.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FormatVariadic.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace Llpc;
+using namespace llvm;
+
+namespace LlpcBench {
+
+// Number of entries in the cache used by the lookup benchmarks
+static constexpr unsigned CacheEntryCount = 4096;
+
+// Size in bytes of the data of each entry
+static constexpr unsigned CacheEntrySize = 1024;
+
+// Maximum number of rounds of the wakeup benchmark, each of which sleeps to let the waiters block
+static constexpr unsigned MaxWakeupRounds = 1000;
+
+// -max-wakeup-latency-us: bound on the worst wakeup latency, checked by the wakeup benchmark
+static cl::opt<unsigned> MaxWakeupLatency("max-wakeup-latency-us",
+                                          cl::desc("Fail shader-cache-wakeup if a waiter takes longer than this to "
+                                                   "resume (0 means no check)"),
+                                          cl::value_desc("us"), cl::init(0));
+
+// =====================================================================================================================
+// Get the hash key of the benchmark cache entry with the given number.
+//
+// @param entryIdx : Number of the entry
+static MetroHash::Hash getEntryKey(unsigned entryIdx) {
+  MetroHash::Hash hash = {};
+  MetroHash::MetroHash128 hasher;
+  hasher.Update(reinterpret_cast<const uint8_t *>(&entryIdx), sizeof(entryIdx));
+  hasher.Finalize(hash.bytes);
+  return hash;
+}
+
+// =====================================================================================================================
+// Initialize a runtime shader cache for a benchmark.
+//
+// @param [out] cache : Shader cache to initialize
+static void initRuntimeCache(ShaderCache &cache) {
+  ShaderCacheCreateInfo createInfo = {};
+  ShaderCacheAuxCreateInfo auxCreateInfo = {};
+  auxCreateInfo.shaderCacheMode = ShaderCacheEnableRuntime;
+  auxCreateInfo.gfxIp.major = 9;
+  cache.init(&createInfo, &auxCreateInfo);
+}
+
+// =====================================================================================================================
+// Benchmark of concurrent cache hits: a cache is filled with CacheEntryCount entries, then each thread repeatedly looks
+// up a pseudo-random entry with findShader and reads it with retrieveShader, as compile threads do on a warm cache.
+// Reports the average time per lookup and the total lookup throughput for each thread count.
+//
+// @param options : Benchmark options
+int runShaderCacheContention(const BenchOptions &options) {
+  ShaderCache cache;
+  initRuntimeCache(cache);
+
+  std::vector<uint8_t> data(CacheEntrySize, 0xA5);
+  for (unsigned entryIdx = 0; entryIdx != CacheEntryCount; ++entryIdx) {
+    CacheEntryHandle hEntry = nullptr;
+    if (cache.findShader(getEntryKey(entryIdx), true, &hEntry) != ShaderEntryState::Compiling) {
+      errs() << "shader-cache-contention: failed to fill the cache\n";
+      return 1;
+    }
+    cache.insertShader(hEntry, data.data(), data.size());
+    cache.releaseShader(hEntry);
+  }
+
+  std::vector<MetroHash::Hash> keys;
+  for (unsigned entryIdx = 0; entryIdx != CacheEntryCount; ++entryIdx)
+    keys.push_back(getEntryKey(entryIdx));
+
+  for (unsigned threadCount = 1; threadCount <= options.threads; threadCount *= 2) {
+    std::atomic<unsigned> failures(0);
+    std::vector<std::thread> threads;
+    Stopwatch stopwatch;
+    for (unsigned threadIdx = 0; threadIdx != threadCount; ++threadIdx) {
+      threads.push_back(std::thread([&, threadIdx] {
+        // Each thread walks the keys with its own odd stride, so threads do not hit the same entries in lockstep.
+        unsigned entryIdx = threadIdx;
+        const unsigned stride = 2 * threadIdx + 1;
+        for (unsigned iteration = 0; iteration != options.iterations; ++iteration) {
+          entryIdx = (entryIdx + stride) % CacheEntryCount;
+          CacheEntryHandle hEntry = nullptr;
+          const void *blob = nullptr;
+          size_t size = 0;
+          if (cache.findShader(keys[entryIdx], false, &hEntry) != ShaderEntryState::Ready ||
+              cache.retrieveShader(hEntry, &blob, &size) != Result::Success || size != CacheEntrySize)
+            ++failures;
+          cache.releaseShader(hEntry);
+        }
+      }));
+    }
+    for (std::thread &thread : threads)
+      thread.join();
+    const double elapsed = stopwatch.getNanoseconds();
+
+    if (failures != 0) {
+      errs() << "shader-cache-contention: " << failures << " lookups failed\n";
+      return 1;
+    }
+    const double lookups = double(threadCount) * options.iterations;
+    reportResult("shader-cache-contention", formatv("threads={0}", threadCount).str(),
+                 elapsed * threadCount / lookups, "ns/lookup");
+    reportResult("shader-cache-contention", formatv("threads={0}", threadCount).str(), lookups * 1e3 / elapsed,
+                 "Mlookups/s");
+  }
+  return 0;
+}
+
+// =====================================================================================================================
+// Benchmark of the wakeup latency of threads waiting for an entry that another thread is compiling. In each round, one
+// thread takes a new entry into the Compiling state and the waiter threads look it up and block on it; the producer
+// then either inserts the shader (even rounds, with options.threads - 1 waiters) or fails it with resetShader (odd
+// rounds, with one waiter, which then owns the entry). The latency is the time from just before the insert or reset to
+// the return of each waiter's findShader. Reports the average and worst latency of both cases, and fails if the worst
+// exceeds -max-wakeup-latency-us.
+//
+// @param options : Benchmark options
+int runShaderCacheWakeup(const BenchOptions &options) {
+  ShaderCache cache;
+  initRuntimeCache(cache);
+
+  std::vector<uint8_t> data(CacheEntrySize, 0x5A);
+  const unsigned rounds = std::min(options.iterations, MaxWakeupRounds);
+  double totalLatency[2] = {};
+  double maxLatency[2] = {};
+  unsigned wakeups[2] = {};
+
+  for (unsigned round = 0; round != rounds; ++round) {
+    const bool isReset = round % 2 != 0;
+    const unsigned waiterCount = isReset ? 1 : std::max(1U, options.threads - 1);
+    const MetroHash::Hash key = getEntryKey(CacheEntryCount + round);
+
+    CacheEntryHandle hProducerEntry = nullptr;
+    if (cache.findShader(key, true, &hProducerEntry) != ShaderEntryState::Compiling) {
+      errs() << "shader-cache-wakeup: failed to create an entry\n";
+      return 1;
+    }
+
+    std::atomic<unsigned> blockedWaiters(0);
+    std::atomic<unsigned> failures(0);
+    std::vector<double> wakeTimes(waiterCount);
+    Stopwatch stopwatch;
+    std::vector<std::thread> waiters;
+    for (unsigned waiterIdx = 0; waiterIdx != waiterCount; ++waiterIdx) {
+      waiters.push_back(std::thread([&, waiterIdx] {
+        CacheEntryHandle hEntry = nullptr;
+        ++blockedWaiters;
+        ShaderEntryState state = cache.findShader(key, true, &hEntry);
+        wakeTimes[waiterIdx] = stopwatch.getNanoseconds();
+        if (state != (isReset ? ShaderEntryState::Compiling : ShaderEntryState::Ready))
+          ++failures;
+        if (state == ShaderEntryState::Compiling)
+          cache.resetShader(hEntry);
+        cache.releaseShader(hEntry);
+      }));
+    }
+
+    // Give the waiters time to get from findShader's lookup into the wait.
+    while (blockedWaiters != waiterCount)
+      std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+
+    const double signalTime = stopwatch.getNanoseconds();
+    if (isReset)
+      cache.resetShader(hProducerEntry);
+    else
+      cache.insertShader(hProducerEntry, data.data(), data.size());
+    cache.releaseShader(hProducerEntry);
+
+    for (std::thread &waiter : waiters)
+      waiter.join();
+    if (failures != 0) {
+      errs() << "shader-cache-wakeup: unexpected entry state after wakeup\n";
+      return 1;
+    }
+    for (double wakeTime : wakeTimes) {
+      const double latency = std::max(0.0, wakeTime - signalTime);
+      totalLatency[isReset] += latency;
+      maxLatency[isReset] = std::max(maxLatency[isReset], latency);
+      ++wakeups[isReset];
+    }
+  }
+
+  int result = 0;
+  for (unsigned isReset = 0; isReset != 2; ++isReset) {
+    if (wakeups[isReset] == 0)
+      continue;
+    const char *config = isReset ? "reset" : "insert";
+    reportResult("shader-cache-wakeup", formatv("{0} avg", config).str(),
+                 totalLatency[isReset] / wakeups[isReset] / 1e3, "us");
+    reportResult("shader-cache-wakeup", formatv("{0} max", config).str(), maxLatency[isReset] / 1e3, "us");
+    if (MaxWakeupLatency != 0 && maxLatency[isReset] > MaxWakeupLatency * 1e3) {
+      errs() << "shader-cache-wakeup: " << config << " wakeup latency exceeds " << MaxWakeupLatency << " us\n";
+      result = 1;
+    }
+  }
+  return result;
+}
+
+} // namespace LlpcBench
@@ -0,0 +1,125 @@
+/*
+ ***********************************************************************************************************************
+ *
+ *  Copyright (c) 2020 Advanced Micro Devices, Inc. All Rights Reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ **********************************************************************************************************************/
+/**
+ ***********************************************************************************************************************
+ * @file  llpcBenchSpirvDecode.cpp
+ * @brief LLPC source file: microbenchmark of SPIR-V module decoding
+ ***********************************************************************************************************************
+ */
+#include "llpcBench.h"
+#include "SPIRVModule.h"
+#include "SPIRVStream.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+using namespace SPIRV;
+using namespace llvm;
+
+namespace LlpcBench {
+
+// Maximum number of passes the decode benchmark makes over the corpus
+static constexpr unsigned MaxDecodePasses = 100;
+
+// =====================================================================================================================
+// Add a SPIR-V binary, or the .spv files under a directory, to the corpus.
+//
+// @param path : File or directory
+// @param [in/out] corpus : Buffers of the SPIR-V binaries read so far
+// @return : False if something could not be read
+static bool addToCorpus(StringRef path, std::vector<std::unique_ptr<MemoryBuffer>> &corpus) {
+  if (sys::fs::is_directory(path)) {
+    std::error_code errCode;
+    for (sys::fs::recursive_directory_iterator it(path, errCode), end; it != end && !errCode; it.increment(errCode)) {
+      if (sys::path::extension(it->path()) == ".spv" && !addToCorpus(it->path(), corpus))
+        return false;
+    }
+    return !errCode;
+  }
+  ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path);
+  if (!buffer)
+    return false;
+  corpus.push_back(std::move(*buffer));
+  return true;
+}
+
+// =====================================================================================================================
+// Benchmark of SPIR-V module decoding over a corpus of SPIR-V binaries, such as the shaderdb tests assembled to .spv.
+// Each binary is decoded into a SPIRVModule by both decoders: through std::istringstream over a copy, as the SPIR-V
+// reader used to, and in place through SPIRVMemoryBuf, as it does now. The inputs are SPIR-V binaries, or directories
+// searched recursively for .spv files. Reports the average time per module for each decoder.
+//
+// @param options : Benchmark options
+int runSpirvDecode(const BenchOptions &options) {
+  std::vector<std::unique_ptr<MemoryBuffer>> corpus;
+  for (const std::string &input : options.inputs) {
+    if (!addToCorpus(input, corpus)) {
+      errs() << "spirv-decode: cannot read " << input << "\n";
+      return 1;
+    }
+  }
+  if (corpus.empty()) {
+    errs() << "spirv-decode: no SPIR-V binaries given\n";
+    return 1;
+  }
+
+  size_t corpusWords = 0;
+  for (const auto &buffer : corpus)
+    corpusWords += buffer->getBufferSize() / sizeof(SPIRVWord);
+
+  const unsigned passes = std::min(options.iterations, MaxDecodePasses);
+  double elapsed[2] = {};
+  for (unsigned pass = 0; pass != passes; ++pass) {
+    for (unsigned inPlace = 0; inPlace != 2; ++inPlace) {
+      Stopwatch stopwatch;
+      for (const auto &buffer : corpus) {
+        std::unique_ptr<SPIRVModule> module(SPIRVModule::createSPIRVModule());
+        if (inPlace) {
+          SPIRVMemoryBuf spirvBuf(buffer->getBufferStart(), buffer->getBufferSize());
+          std::istream spirvStream(&spirvBuf);
+          module->setInputBuf(&spirvBuf);
+          spirvStream >> *module;
+        } else {
+          std::istringstream spirvStream(buffer->getBuffer().str());
+          spirvStream >> *module;
+        }
+      }
+      elapsed[inPlace] += stopwatch.getNanoseconds();
+    }
+  }
+
+  const double modules = double(passes) * corpus.size();
+  const std::string config = formatv("modules={0} words={1}", corpus.size(), corpusWords).str();
+  reportResult("spirv-decode", config + " stream", elapsed[0] / modules / 1000.0, "us/module");
+  reportResult("spirv-decode", config + " in-place", elapsed[1] / modules / 1000.0, "us/module");
+  return 0;
+}
+
+} // namespace LlpcBench
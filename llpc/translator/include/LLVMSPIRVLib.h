@@ -74,6 +74,7 @@ void initializeSPIRVLowerMemmovePass(PassRegistry&);
 #include "llvm/Pass.h"
 
 namespace SPIRV {
+class SPIRVMemoryBuf;
 class SPIRVModule;
 
 /// \brief Represents one entry in specialization constant map.
@@ -106,7 +107,8 @@ class raw_pwrite_stream;
 /// \returns true if succeeds.
 bool writeSpirv(llvm::Module *M, llvm::raw_ostream &OS, std::string &ErrMsg);
 
-/// \brief Load SPIRV from istream and translate to LLVM module.
+/// \brief Load SPIRV from istream and translate to LLVM module. If IS reads
+/// from InputBuf, pass that too so that the SPIR-V is decoded in place.
 /// \returns true if succeeds.
 bool readSpirv(lgc::Builder *Builder,
                const Vkgc::ShaderModuleUsage* ModuleData,
@@ -115,7 +117,8 @@ bool readSpirv(lgc::Builder *Builder,
                const char *EntryName,
                const SPIRV::SPIRVSpecConstMap &SpecConstMap,
                llvm::Module *M,
-               std::string &ErrMsg);
+               std::string &ErrMsg,
+               SPIRV::SPIRVMemoryBuf *InputBuf = nullptr);
 
 /// \brief Regularize LLVM module by removing entities not representable by
 /// SPIRV.
@@ -7861,11 +7861,12 @@ llvm::GlobalValue::LinkageTypes SPIRVToLLVM::transLinkageType(const SPIRVValue *
 
 bool llvm::readSpirv(Builder *builder, const ShaderModuleUsage *shaderInfo, std::istream &is,
                      spv::ExecutionModel entryExecModel, const char *entryName, const SPIRVSpecConstMap &specConstMap,
-                     Module *m, std::string &errMsg) {
+                     Module *m, std::string &errMsg, SPIRVMemoryBuf *inputBuf) {
   assert(entryExecModel != ExecutionModelKernel && "Not support ExecutionModelKernel");
 
   std::unique_ptr<SPIRVModule> bm(SPIRVModule::createSPIRVModule());
 
+  bm->setInputBuf(inputBuf);
   is >> *bm;
 
   SPIRVToLLVM btl(m, bm.get(), specConstMap, builder, shaderInfo);
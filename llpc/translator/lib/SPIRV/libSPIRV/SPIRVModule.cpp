@@ -54,7 +54,7 @@
 namespace SPIRV {
 
 SPIRVModule::SPIRVModule()
-    : AutoAddCapability(true), ValidateCapability(false) {}
+    : AutoAddCapability(true), ValidateCapability(false), InputBuf(nullptr) {}
 
 SPIRVModule::~SPIRVModule() {}
 
@@ -1258,8 +1258,12 @@ void SPIRVModuleImpl::addUnknownStructField(SPIRVTypeStruct *Struct, unsigned I,
 }
 
 std::istream &operator>>(std::istream &I, SPIRVModule &M) {
-  SPIRVDecoder Decoder(I, M);
   SPIRVModuleImpl &MI = *static_cast<SPIRVModuleImpl *>(&M);
+  // If the caller said the stream reads from memory, decoders take words
+  // straight from the buffer instead of through stream extraction.
+  assert((!MI.InputBuf || I.rdbuf() == MI.InputBuf) &&
+         "Input buffer is not the stream's buffer");
+  SPIRVDecoder Decoder(I, M);
   // Disable automatic capability filling.
   MI.setAutoAddCapability(false);
 
@@ -1284,6 +1288,7 @@ std::istream &operator>>(std::istream &I, SPIRVModule &M) {
 
   while(Decoder.getWordCountAndOpCode())
     Decoder.getEntry();
+  MI.InputBuf = nullptr;
 
   MI.optimizeDecorates();
   MI.resolveUnknownStructFields();
@@ -56,6 +56,7 @@ class SPIRVConstant;
 class SPIRVEntry;
 class SPIRVFunction;
 class SPIRVInstruction;
+class SPIRVMemoryBuf;
 class SPIRVType;
 class SPIRVTypeArray;
 class SPIRVTypeBool;
@@ -344,10 +345,17 @@ public:
                                                        SPIRVBasicBlock *) = 0;
   // Input functions
   friend std::istream &operator>>(std::istream &I, SPIRVModule &M);
+  // Set the in-memory buffer that the input stream of the next read of this
+  // module reads from, so that decoders take words straight from it. The
+  // read clears it again.
+  void setInputBuf(SPIRVMemoryBuf *Buf) { InputBuf = Buf; }
+  // In-memory buffer being decoded, if the input stream reads from one
+  SPIRVMemoryBuf *getInputBuf() const { return InputBuf; }
 
 protected:
   bool AutoAddCapability;
   bool ValidateCapability;
+  SPIRVMemoryBuf *InputBuf;
 };
 
 } // namespace SPIRV
@@ -45,12 +45,12 @@
 namespace SPIRV {
 
 SPIRVDecoder::SPIRVDecoder(std::istream &InputStream, SPIRVFunction &F)
-    : IS(InputStream), M(*F.getModule()), WordCount(0), OpCode(OpNop),
-      Scope(&F) {}
+    : IS(InputStream), Buf(F.getModule()->getInputBuf()), M(*F.getModule()),
+      WordCount(0), OpCode(OpNop), Scope(&F) {}
 
 SPIRVDecoder::SPIRVDecoder(std::istream &InputStream, SPIRVBasicBlock &BB)
-    : IS(InputStream), M(*BB.getModule()), WordCount(0), OpCode(OpNop),
-      Scope(&BB) {}
+    : IS(InputStream), Buf(BB.getModule()->getInputBuf()),
+      M(*BB.getModule()), WordCount(0), OpCode(OpNop), Scope(&BB) {}
 
 void SPIRVDecoder::setScope(SPIRVEntry *TheScope) {
   assert(TheScope && (TheScope->getOpCode() == OpFunction ||
@@ -77,6 +77,11 @@ SPIRV_DEF_ENCDEC(LinkageType)
 // Read a string with padded 0's at the end so that they form a stream of
 // words.
 const SPIRVDecoder &operator>>(const SPIRVDecoder &I, std::string &Str) {
+  if (I.Buf) {
+    if (!I.Buf->readString(Str))
+      I.IS.setstate(std::ios::eofbit | std::ios::failbit);
+    return I;
+  }
   uint64_t Count = 0;
   char Ch;
   while (I.IS.get(Ch) && Ch != '\0') {
@@ -93,6 +98,17 @@ const SPIRVDecoder &operator>>(const SPIRVDecoder &I, std::string &Str) {
 }
 
 bool SPIRVDecoder::getWordCountAndOpCode() {
+  if (Buf) {
+    SPIRVWord WordCountAndOpCode;
+    if (!Buf->readWord(WordCountAndOpCode)) {
+      WordCount = 0;
+      OpCode = OpNop;
+      return false;
+    }
+    WordCount = WordCountAndOpCode >> 16;
+    OpCode = static_cast<Op>(WordCountAndOpCode & 0xFFFF);
+    return true;
+  }
   if (IS.eof()) {
     WordCount = 0;
     OpCode = OpNop;
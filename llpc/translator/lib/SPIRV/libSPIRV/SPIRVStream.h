@@ -45,8 +45,10 @@
 #include "SPIRVModule.h"
 #include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <iterator>
+#include <streambuf>
 #include <string>
 #include <vector>
 
@@ -55,10 +57,49 @@ namespace SPIRV {
 class SPIRVFunction;
 class SPIRVBasicBlock;
 
+// Read-only stream buffer over a SPIR-V binary in memory, without copying it.
+// When a module is read from an std::istream on one of these, and the buffer
+// was passed to SPIRVModule::setInputBuf first, SPIRVDecoder takes words
+// straight from the buffer rather than through stream extraction.
+// The memory must outlive the buffer.
+class SPIRVMemoryBuf : public std::streambuf {
+public:
+  SPIRVMemoryBuf(const void *Data, size_t Size) {
+    char *Begin = const_cast<char *>(static_cast<const char *>(Data));
+    setg(Begin, Begin, Begin + Size);
+  }
+
+  // Read a word. Returns false, reading nothing, if there is not a whole word
+  // left.
+  bool readWord(SPIRVWord &W) {
+    if (egptr() - gptr() < static_cast<std::ptrdiff_t>(sizeof(W)))
+      return false;
+    memcpy(&W, gptr(), sizeof(W));
+    gbump(sizeof(W));
+    return true;
+  }
+
+  // Read a nul-terminated string and the padding to the next word boundary.
+  // Returns false, reading nothing, if there is no terminator.
+  bool readString(std::string &Str) {
+    const char *Begin = gptr();
+    size_t Avail = egptr() - Begin;
+    const char *End = static_cast<const char *>(memchr(Begin, '\0', Avail));
+    if (!End)
+      return false;
+    Str.append(Begin, End);
+    size_t Len = (End - Begin) / sizeof(SPIRVWord) * sizeof(SPIRVWord) +
+                 sizeof(SPIRVWord);
+    gbump(std::min(Len, Avail));
+    return true;
+  }
+};
+
 class SPIRVDecoder {
 public:
   SPIRVDecoder(std::istream &InputStream, SPIRVModule &Module)
-      : IS(InputStream), M(Module), WordCount(0), OpCode(OpNop), Scope(NULL) {}
+      : IS(InputStream), Buf(Module.getInputBuf()), M(Module), WordCount(0),
+        OpCode(OpNop), Scope(NULL) {}
   SPIRVDecoder(std::istream &InputStream, SPIRVFunction &F);
   SPIRVDecoder(std::istream &InputStream, SPIRVBasicBlock &BB);
 
@@ -68,6 +109,7 @@ public:
   void validate() const;
 
   std::istream &IS;
+  SPIRVMemoryBuf *Buf; // IS's buffer, if it reads from memory
   SPIRVModule &M;
   SPIRVWord WordCount;
   Op OpCode;
@@ -77,7 +119,13 @@ public:
 template <typename T>
 const SPIRVDecoder &decodeBinary(const SPIRVDecoder &I, T &V) {
   uint32_t W;
-  I.IS.read(reinterpret_cast<char *>(&W), sizeof(W));
+  if (I.Buf) {
+    if (!I.Buf->readWord(W)) {
+      I.IS.setstate(std::ios::eofbit | std::ios::failbit);
+      W = 0;
+    }
+  } else
+    I.IS.read(reinterpret_cast<char *>(&W), sizeof(W));
   V = static_cast<T>(W);
   return I;
 }
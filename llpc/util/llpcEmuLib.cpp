@@ -37,6 +37,9 @@
 #include "llvm/Object/Archive.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Error.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/Mutex.h"
+#include <mutex>
 
 #define DEBUG_TYPE "llpc-emu-lib"
 
@@ -44,18 +47,49 @@ using namespace Llpc;
 using namespace llvm;
 using namespace object;
 
+namespace {
+
+// Process-wide cache of parsed emulation archives, keyed by the start and size of the archive data. The archive
+// data is expected to stay in memory for the lifetime of the process.
+struct EmuLibArchiveCache {
+  sys::Mutex lock;                                                                          // Lock for the map
+  std::map<std::pair<const char *, size_t>, std::shared_ptr<const EmuLibArchiveIndex>> map; // Parsed archives
+};
+
+} // anonymous namespace
+
+static ManagedStatic<EmuLibArchiveCache> SArchiveCache;
+
+// =====================================================================================================================
+// Gets the parsed form of an archive, parsing it only the first time it is seen in this process.
+//
+// @param buffer : Buffer containing the archive
+static std::shared_ptr<const EmuLibArchiveIndex> getArchiveIndex(MemoryBufferRef buffer) {
+  std::lock_guard<sys::Mutex> lock(SArchiveCache->lock);
+  auto &index = SArchiveCache->map[std::make_pair(buffer.getBufferStart(), buffer.getBufferSize())];
+  if (!index) {
+    auto newIndex = std::make_shared<EmuLibArchiveIndex>();
+    newIndex->archive = cantFail(Archive::create(buffer), "Failed to parse archive");
+    for (auto &symbol : newIndex->archive->symbols())
+      newIndex->symbols.push_back(symbol.getName());
+    index = std::move(newIndex);
+  } else
+    LLVM_DEBUG(dbgs() << "Reused parsed emulation archive with " << index->symbols.size() << " symbols\n");
+  return index;
+}
+
 // =====================================================================================================================
 // Adds an archive to the emulation library.
 //
 // @param buffer : Buffer required to create the archive
 void EmuLib::addArchive(MemoryBufferRef buffer) {
-  m_archives.emplace_back(cantFail(Archive::create(buffer), "Failed to parse archive"));
+  m_archives.emplace_back(getArchiveIndex(buffer));
 
   // Update symbol index in the symbol index map
   auto &archive = m_archives.back();
   auto index = m_archives.size() - 1;
-  for (auto &symbol : archive.archive->symbols())
-    m_symbolIndices.insert(std::make_pair(symbol.getName(), index));
+  for (StringRef symbol : archive.index->symbols)
+    m_symbolIndices.insert(std::make_pair(symbol, index));
 }
 
 // =====================================================================================================================
@@ -78,7 +112,7 @@ Function *EmuLib::getFunction(StringRef funcName, bool nativeOnly) {
       return funcMapIt->second.function;
     }
     // Find the function in the symbol table of the archive.
-    auto child = cantFail(archive.archive->findSym(funcName), "Failed in archive symbol search");
+    auto child = cantFail(archive.index->archive->findSym(funcName), "Failed in archive symbol search");
     assert(child.hasValue());
     // Found the symbol. Get the bitcode for its module.
     StringRef childBitcode = cantFail(child->getBuffer(), "Failed in archive module extraction");
@@ -34,6 +34,7 @@
 #include "llvm/Object/Archive.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include <map>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
@@ -55,6 +56,14 @@ template <> struct hash<llvm::StringRef> {
 namespace Llpc {
 class Context;
 
+// =====================================================================================================================
+// A parsed emulation archive together with the names of its symbols. This is immutable once created, so one copy is
+// shared by the EmuLib of every context that adds the same archive.
+struct EmuLibArchiveIndex {
+  std::unique_ptr<llvm::object::Archive> archive; // The bitcode archive
+  std::vector<llvm::StringRef> symbols;           // Names of the symbols in the archive symbol table
+};
+
 // =====================================================================================================================
 // Represents an emulation archive library, together with already-loaded modules from it.
 class EmuLib {
@@ -72,11 +81,11 @@ class EmuLib {
   // avoid accidentally getting the wrong one if the module containing that function from a later
   // archive in search order has already been loaded.
   struct EmuLibArchive {
-    std::unique_ptr<llvm::object::Archive> archive; // The bitcode archive
+    std::shared_ptr<const EmuLibArchiveIndex> index; // The parsed bitcode archive, shared between contexts
     std::unordered_map<llvm::StringRef, EmuLibFunction>
         functions; // Store of already-parsed functions from this archive
 
-    EmuLibArchive(std::unique_ptr<llvm::object::Archive> archive) : archive(std::move(archive)) {}
+    EmuLibArchive(std::shared_ptr<const EmuLibArchiveIndex> index) : index(std::move(index)) {}
   };
 
   Context *m_context;                                          // The LLPC context
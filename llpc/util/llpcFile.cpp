@@ -32,6 +32,15 @@
 #include <cassert>
 #include <stdarg.h>
 #include <sys/stat.h>
+#if defined(_WIN32)
+#include <io.h>
+// NOTE: Disable Windows-defined min()/max() because we use STL-defined std::min()/std::max() in LLPC.
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/file.h>
+#include <unistd.h>
+#endif
 
 #define DEBUG_TYPE "llpc-file"
 
@@ -275,6 +284,73 @@ Result File::flush() const {
   return result;
 }
 
+// =====================================================================================================================
+// Flushes pending I/O to the file and waits until the data has reached the storage device.
+Result File::sync() const {
+  Result result = flush();
+
+  if (result == Result::Success) {
+#if defined(_WIN32)
+    if (_commit(_fileno(m_fileHandle)) != 0)
+#else
+    if (fsync(fileno(m_fileHandle)) != 0)
+#endif
+      result = Result::ErrorUnknown;
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+// Truncates (or extends) the file to the specified size. Pending I/O is flushed first.
+//
+// @param size : New size of the file in bytes
+Result File::truncate(size_t size) {
+  Result result = flush();
+
+  if (result == Result::Success) {
+#if defined(_WIN32)
+    if (_chsize_s(_fileno(m_fileHandle), size) != 0)
+#else
+    if (ftruncate(fileno(m_fileHandle), size) != 0)
+#endif
+      result = Result::ErrorUnknown;
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+// Takes an exclusive advisory lock on the whole file, waiting until no other process holds it. The lock only excludes
+// other callers of lock, not plain reads and writes.
+Result File::lock() {
+  if (!m_fileHandle)
+    return Result::ErrorUnavailable;
+#if defined(_WIN32)
+  OVERLAPPED overlapped = {};
+  HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(m_fileHandle)));
+  if (!LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &overlapped))
+#else
+  if (flock(fileno(m_fileHandle), LOCK_EX) != 0)
+#endif
+    return Result::ErrorUnknown;
+  return Result::Success;
+}
+
+// =====================================================================================================================
+// Releases the advisory lock taken by lock.
+void File::unlock() {
+  if (!m_fileHandle)
+    return;
+#if defined(_WIN32)
+  OVERLAPPED overlapped = {};
+  HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(m_fileHandle)));
+  UnlockFileEx(handle, 0, MAXDWORD, MAXDWORD, &overlapped);
+#else
+  flock(fileno(m_fileHandle), LOCK_UN);
+#endif
+}
+
 // =====================================================================================================================
 // Sets the file position to the beginning of the file.
 void File::rewind() {
@@ -283,14 +359,18 @@ void File::rewind() {
 }
 
 // =====================================================================================================================
-// Sets the file position to the beginning of the file.
+// Sets the file position. The offset is 64-bit on every platform, so files larger than 2GB can be positioned in.
 //
 // @param offset : Number of bytes to offset
 // @param fromOrigin : If true, the seek will be relative to the file origin; if false, it will be from the current
 // position
-void File::seek(int offset, bool fromOrigin) {
+void File::seek(int64_t offset, bool fromOrigin) {
   if (m_fileHandle) {
-    int ret = fseek(m_fileHandle, offset, fromOrigin ? SEEK_SET : SEEK_CUR);
+#if defined(_WIN32)
+    int ret = _fseeki64(m_fileHandle, offset, fromOrigin ? SEEK_SET : SEEK_CUR);
+#else
+    int ret = fseeko(m_fileHandle, static_cast<off_t>(offset), fromOrigin ? SEEK_SET : SEEK_CUR);
+#endif
 
     assert(ret == 0);
     (void(ret)); // unused
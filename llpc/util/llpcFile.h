@@ -31,6 +31,7 @@
 #pragma once
 
 #include "llpc.h"
+#include <cstdint>
 #include <cstdio>
 
 namespace Llpc {
@@ -65,8 +66,12 @@ public:
   Result printf(const char *formatStr, ...) const;
   Result vPrintf(const char *formatStr, va_list argList);
   Result flush() const;
+  Result sync() const;
+  Result truncate(size_t size);
+  Result lock();
+  void unlock();
   void rewind();
-  void seek(int offset, bool fromOrigin);
+  void seek(int64_t offset, bool fromOrigin);
 
   // Returns true if the file is presently open.
   bool isOpen() const { return (m_fileHandle); }
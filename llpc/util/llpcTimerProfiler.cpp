@@ -38,6 +38,8 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Format.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <vector>
 
 using namespace llvm;
 
@@ -59,9 +61,13 @@ namespace Llpc {
 // @param hash64 : Hash code
 // @param descriptionPrefix : Profiler description prefix string
 // @param enableMask : Mask of enabled phase timers
-TimerProfiler::TimerProfiler(uint64_t hash64, const char *descriptionPrefix, unsigned enableMask)
-    : m_total("", "", getDummyTimeRecords()), m_phases("", "", getDummyTimeRecords()) {
-  if (TimePassesIsEnabled || cl::EnableTimerProfile) {
+// @param telemetry : Telemetry recorder to add the phase times to (nullptr if none)
+TimerProfiler::TimerProfiler(uint64_t hash64, const char *descriptionPrefix, unsigned enableMask,
+                             CompileTelemetryRecorder *telemetry)
+    : m_total("", "", getDummyTimeRecords()), m_phases("", "", getDummyTimeRecords()),
+      m_telemetry(telemetry && telemetry->isEnabled() ? telemetry : nullptr),
+      m_enabled(isReportEnabled() || m_telemetry) {
+  if (m_enabled) {
     std::string hashString;
     raw_string_ostream ostream(hashString);
     ostream << format("0x%016" PRIX64, hash64);
@@ -107,9 +113,23 @@ TimerProfiler::TimerProfiler(uint64_t hash64, const char *descriptionPrefix, uns
 
 // =====================================================================================================================
 TimerProfiler::~TimerProfiler() {
-  if (TimePassesIsEnabled || cl::EnableTimerProfile) {
+  if (m_enabled) {
     // Stop whole timer
     m_wholeTimer.stopTimer();
+
+    if (m_telemetry) {
+      for (unsigned timerKind = 0; timerKind < TimerCount; ++timerKind) {
+        if (m_phaseTimers[timerKind].isInitialized())
+          m_telemetry->addPhaseTime(static_cast<TimerKind>(timerKind), m_phaseTimers[timerKind].getTotalTime());
+      }
+
+      // If the timers only ran for telemetry, clear them so the timer groups do not print a report.
+      if (!isReportEnabled()) {
+        m_wholeTimer.clear();
+        for (Timer &phaseTimer : m_phaseTimers)
+          phaseTimer.clear();
+      }
+    }
   }
 }
 
@@ -120,7 +140,7 @@ TimerProfiler::~TimerProfiler() {
 // @param timerKind : Kind of phase timer
 // @param start : Start or  stop timer
 void TimerProfiler::addTimerStartStopPass(lgc::PassManager *passMgr, TimerKind timerKind, bool start) {
-  if (TimePassesIsEnabled || cl::EnableTimerProfile)
+  if (m_enabled)
     passMgr->add(lgc::LgcContext::createStartStopTimer(&m_phaseTimers[timerKind], start));
 }
 
@@ -130,7 +150,7 @@ void TimerProfiler::addTimerStartStopPass(lgc::PassManager *passMgr, TimerKind t
 // @param timerKind : Kind of phase timer
 // @param start : Start or  stop timer
 void TimerProfiler::startStopTimer(TimerKind timerKind, bool start) {
-  if (TimePassesIsEnabled || cl::EnableTimerProfile) {
+  if (m_enabled) {
     if (start)
       m_phaseTimers[timerKind].startTimer();
     else
@@ -139,18 +159,24 @@ void TimerProfiler::startStopTimer(TimerKind timerKind, bool start) {
 }
 
 // =====================================================================================================================
-// Gets a specific timer. Returns nullptr if TimePassesIsEnabled isn't enabled.
+// Gets a specific timer. Returns nullptr if neither the timer report nor telemetry is enabled.
 //
 // @param timerKind : Kind of phase timer
 Timer *TimerProfiler::getTimer(TimerKind timerKind) {
-  return TimePassesIsEnabled || cl::EnableTimerProfile ? &m_phaseTimers[timerKind] : nullptr;
+  return m_enabled ? &m_phaseTimers[timerKind] : nullptr;
+}
+
+// =====================================================================================================================
+// Returns whether the timer report is enabled, that is, whether timers print their results when destroyed.
+bool TimerProfiler::isReportEnabled() {
+  return TimePassesIsEnabled || cl::EnableTimerProfile;
 }
 
 // =====================================================================================================================
 // Gets dummy TimeRecords.
 const StringMap<TimeRecord> &TimerProfiler::getDummyTimeRecords() {
   static StringMap<TimeRecord> DummyTimeRecords;
-  if ((TimePassesIsEnabled || cl::EnableTimerProfile) && DummyTimeRecords.empty()) {
+  if (isReportEnabled() && DummyTimeRecords.empty()) {
     // NOTE: It is a workaround to get fixed layout in timer reports. Please remove it if we find a better solution.
     // LLVM timer skips the field if it is zero in all timers, it causes the layout of the report isn't stable when
     // compile multiple pipelines. so we add a dummy record to force all fields is shown.
@@ -171,4 +197,81 @@ const StringMap<TimeRecord> &TimerProfiler::getDummyTimeRecords() {
   return DummyTimeRecords;
 }
 
+// =====================================================================================================================
+//
+// @param callback : Telemetry callback (nullptr if telemetry is disabled)
+// @param userData : User data passed to the callback
+// @param kind : Kind of compile call
+// @param hash : Pipeline or shader module hash
+CompileTelemetryRecorder::CompileTelemetryRecorder(CompileTelemetryCallback callback, void *userData,
+                                                   CompileTelemetryKind kind, uint64_t hash)
+    : m_callback(callback), m_userData(userData), m_kind(kind), m_hash(hash) {
+  if (m_callback)
+    m_startTime = TimeRecord::getCurrentTime(/*Start=*/true);
+}
+
+// =====================================================================================================================
+// Adds the outcome of a shader cache lookup. The call as a whole counts as a hit only if every lookup hit.
+//
+// @param hit : Whether the lookup found the result in a cache
+void CompileTelemetryRecorder::addCacheLookup(bool hit) {
+  if (!hit)
+    m_cacheOutcome = CompileCacheOutcome::Miss;
+  else if (m_cacheOutcome == CompileCacheOutcome::NotLookedUp)
+    m_cacheOutcome = CompileCacheOutcome::Hit;
+}
+
+// =====================================================================================================================
+// Adds time spent in a compile phase. A phase may be run several times in one call, for example once per stage when
+// building a pipeline from relocatable shader ELFs.
+//
+// @param timerKind : Kind of phase timer
+// @param time : Time spent in the phase
+void CompileTelemetryRecorder::addPhaseTime(TimerKind timerKind, const TimeRecord &time) {
+  if (m_callback)
+    m_phaseTimes[timerKind] += time;
+}
+
+// =====================================================================================================================
+// Finishes the telemetry record of the call, and reports it to the callback.
+CompileTelemetryRecorder::~CompileTelemetryRecorder() {
+  if (!m_callback)
+    return;
+
+  TimeRecord endTime = TimeRecord::getCurrentTime(/*Start=*/false);
+  size_t peakMemory = m_passProfile.peakMemory;
+  if (endTime.getMemUsed() > 0)
+    peakMemory = std::max(peakMemory, static_cast<size_t>(endTime.getMemUsed()));
+  if (m_startTime.getMemUsed() > 0)
+    peakMemory = std::max(peakMemory, static_cast<size_t>(m_startTime.getMemUsed()));
+  TimeRecord totalTime = endTime;
+  totalTime -= m_startTime;
+
+  std::vector<CompilePassTime> passTimes;
+  passTimes.reserve(m_passProfile.passTimes.size());
+  for (const auto &passTime : m_passProfile.passTimes) {
+    // StringMap keys are null-terminated.
+    passTimes.push_back(
+        {passTime.getKey().data(), {passTime.getValue().getWallTime(), passTime.getValue().getProcessTime()}});
+  }
+  std::stable_sort(passTimes.begin(), passTimes.end(), [](const CompilePassTime &lhs, const CompilePassTime &rhs) {
+    return lhs.time.wallTime > rhs.time.wallTime;
+  });
+
+  CompileTelemetry telemetry = {};
+  telemetry.kind = m_kind;
+  telemetry.hash = m_hash;
+  telemetry.result = m_result;
+  telemetry.cacheOutcome = m_cacheOutcome;
+  telemetry.totalTime = {totalTime.getWallTime(), totalTime.getProcessTime()};
+  for (unsigned timerKind = 0; timerKind < TimerCount; ++timerKind)
+    telemetry.phaseTimes[timerKind] = {m_phaseTimes[timerKind].getWallTime(), m_phaseTimes[timerKind].getProcessTime()};
+  telemetry.passTimeCount = passTimes.size();
+  telemetry.pPassTimes = passTimes.data();
+  telemetry.peakMemory = peakMemory;
+  telemetry.skippedBitcodeFunctionCount = m_skippedBitcodeFunctionCount;
+
+  m_callback(m_userData, &telemetry);
+}
+
 } // namespace Llpc
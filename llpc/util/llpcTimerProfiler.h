@@ -32,15 +32,10 @@
 #pragma once
 
 #include "llpc.h"
+#include "lgc/PassManager.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/Support/Timer.h"
 
-namespace lgc {
-
-class PassManager;
-
-} // namespace lgc
-
 namespace Llpc {
 
 // =====================================================================================================================
@@ -56,11 +51,55 @@ enum TimerKind : unsigned {
   TimerCount
 };
 
+static_assert(TimerCount == static_cast<unsigned>(CompilePhase::Count), "Timer kinds do not match compile phases");
+
+// =====================================================================================================================
+// Gathers the compile telemetry of one BuildShaderModule, BuildGraphicsPipeline or BuildComputePipeline call, and
+// reports it to the client's telemetry callback when destroyed. All methods do nothing if there is no callback. It must
+// outlive the TimerProfiler objects that add phase times to it.
+class CompileTelemetryRecorder {
+public:
+  CompileTelemetryRecorder(CompileTelemetryCallback callback, void *userData, CompileTelemetryKind kind,
+                           uint64_t hash);
+
+  ~CompileTelemetryRecorder();
+
+  bool isEnabled() const { return m_callback != nullptr; }
+
+  void addCacheLookup(bool hit);
+
+  void addPhaseTime(TimerKind timerKind, const llvm::TimeRecord &time);
+
+  // Gets the profile for pass managers to record module pass times into, or nullptr if telemetry is disabled
+  lgc::PassProfile *getPassProfile() { return isEnabled() ? &m_passProfile : nullptr; }
+
+  void setResult(Result result) { m_result = result; }
+
+  // Adds to the count of functions in pre-lowered shader bitcode that were not loaded
+  void addSkippedBitcodeFunctions(unsigned count) { m_skippedBitcodeFunctionCount += count; }
+
+private:
+  CompileTelemetryRecorder(const CompileTelemetryRecorder &) = delete;
+  CompileTelemetryRecorder &operator=(const CompileTelemetryRecorder &) = delete;
+
+  CompileTelemetryCallback m_callback;                                   // Telemetry callback, or nullptr
+  void *m_userData;                                                      // User data passed to the callback
+  CompileTelemetryKind m_kind;                                           // Kind of compile call
+  uint64_t m_hash;                                                       // Pipeline or shader module hash
+  Result m_result = Result::Success;                                     // Result returned by the call
+  CompileCacheOutcome m_cacheOutcome = CompileCacheOutcome::NotLookedUp; // Outcome of cache lookups so far
+  llvm::TimeRecord m_startTime;                                          // Time at the start of the call
+  llvm::TimeRecord m_phaseTimes[TimerCount];                             // Accumulated time of each phase
+  lgc::PassProfile m_passProfile;                                        // Module pass times and peak memory
+  unsigned m_skippedBitcodeFunctionCount = 0;                            // Functions not loaded from shader bitcode
+};
+
 // =====================================================================================================================
 // Represents a utility class for time profile, it wraps LLVM Timer and TimerGroup in internal.
 class TimerProfiler {
 public:
-  TimerProfiler(uint64_t hash64, const char *descriptionPrefix, unsigned enableMask);
+  TimerProfiler(uint64_t hash64, const char *descriptionPrefix, unsigned enableMask,
+                CompileTelemetryRecorder *telemetry = nullptr);
 
   ~TimerProfiler();
 
@@ -70,6 +109,8 @@ public:
 
   llvm::Timer *getTimer(TimerKind timerKind);
 
+  static bool isReportEnabled();
+
   static const llvm::StringMap<llvm::TimeRecord> &getDummyTimeRecords();
 
   static const unsigned PipelineTimerEnableMask = ((1 << TimerCount) - 1);
@@ -83,6 +124,8 @@ private:
   llvm::TimerGroup m_phases;             // TimeGroup for each phase
   llvm::Timer m_wholeTimer;              // Whole timer
   llvm::Timer m_phaseTimers[TimerCount]; // Phase timer
+  CompileTelemetryRecorder *m_telemetry; // Telemetry recorder to add the phase times to, if enabled
+  bool m_enabled;                        // Whether the timers are running, for the report or for telemetry
 };
 
 } // namespace Llpc
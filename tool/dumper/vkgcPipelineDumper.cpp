@@ -627,6 +627,7 @@ void PipelineDumper::dumpPipelineOptions(const PipelineOptions *options, std::os
   dumpFile << "options.extendedRobustness.robustImageAccess = " << options->extendedRobustness.robustImageAccess
            << "\n";
   dumpFile << "options.extendedRobustness.nullDescriptor = " << options->extendedRobustness.nullDescriptor << "\n";
+  dumpFile << "options.enableScalarLoadMerge = " << options->enableScalarLoadMerge << "\n";
 }
 
 // =====================================================================================================================
@@ -842,6 +843,7 @@ MetroHash::Hash PipelineDumper::generateHashForComputePipeline(const ComputePipe
   hasher.Update(pipeline->options.extendedRobustness.robustBufferAccess);
   hasher.Update(pipeline->options.extendedRobustness.robustImageAccess);
   hasher.Update(pipeline->options.extendedRobustness.nullDescriptor);
+  hasher.Update(pipeline->options.enableScalarLoadMerge);
 
   MetroHash::Hash hash = {};
   hasher.Finalize(hash.bytes);
@@ -945,6 +947,7 @@ void PipelineDumper::updateHashForNonFragmentState(const GraphicsPipelineBuildIn
     hasher->Update(pipeline->options.extendedRobustness.robustBufferAccess);
     hasher->Update(pipeline->options.extendedRobustness.robustImageAccess);
     hasher->Update(pipeline->options.extendedRobustness.nullDescriptor);
+    hasher->Update(pipeline->options.enableScalarLoadMerge);
   }
 }
 